@@ -2,13 +2,25 @@
 //
 //  --- CheckError.h ---
 //
+//   Debug builds collect OpenGL errors and report them once per frame,
+//   grouped by the place they were detected.  When the KHR_debug callback
+//   is available the driver reports errors as they happen and CheckError()
+//   only attributes the pending ones to its position; otherwise CheckError()
+//   drains glGetError().  With NDEBUG defined every macro compiles away.
+//
+//     CheckErrorInit();    // once, after glewInit()
+//     CheckError();        // after GL calls worth attributing
+//     CheckErrorFrame();   // at the end of each frame - prints the summary
+//
 //////////////////////////////////////////////////////////////////////////////
 
 #ifndef __CHECKERROR_H__
 #define __CHECKERROR_H__
 
 #include <stdio.h>
-//#include <GL/gl.h>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
 #include <GL/glut.h>
 
 //----------------------------------------------------------------------------
@@ -16,38 +28,153 @@
 static const char*
 ErrorString( GLenum error )
 {
-    const char*  msg;
+    const char*  msg = "unknown error";
     switch( error ) {
 #define Case( Token )  case Token: msg = #Token; break;
 	Case( GL_NO_ERROR );
 	Case( GL_INVALID_VALUE );
 	Case( GL_INVALID_ENUM );
 	Case( GL_INVALID_OPERATION );
+	Case( GL_INVALID_FRAMEBUFFER_OPERATION );
 	Case( GL_STACK_OVERFLOW );
 	Case( GL_STACK_UNDERFLOW );
 	Case( GL_OUT_OF_MEMORY );
-#undef Case	
+#undef Case
     }
 
     return msg;
 }
 
+#ifdef NDEBUG
+
+#define CheckErrorInit()   ((void) 0)
+#define CheckError()       ((void) 0)
+#define CheckErrorFrame()  ((void) 0)
+
+#else // !NDEBUG
+
+//----------------------------------------------------------------------------
+
+//  One kind of error seen at one place during the current frame
+struct CheckErrorEntry {
+    const char*  file;
+    int          line;
+    GLenum       error;     // glGetError() value, or the debug message id
+    unsigned     count;
+    std::string  message;
+};
+
+//  Errors of the current frame, plus the debug messages received since the
+//    last CheckError() that still need a position
+struct CheckErrorLog {
+    std::vector<CheckErrorEntry>  entries;
+    std::vector<CheckErrorEntry>  pending;
+    bool         callback;
+
+    CheckErrorLog() : callback( false ) {}
+
+    void add( const char* file, int line, GLenum error, const char* message,
+	      unsigned count = 1 ) {
+	for ( size_t i = 0; i < entries.size(); ++i ) {
+	    CheckErrorEntry& e = entries[i];
+	    if ( e.error == error && e.line == line && e.file == file ) {
+		e.count += count;
+		return;
+	    }
+	}
+	CheckErrorEntry e = { file, line, error, count, message };
+	entries.push_back( e );
+    }
+};
+
+//  A single log shared by every translation unit
+inline CheckErrorLog&
+_CheckErrorLog()
+{
+    static CheckErrorLog  log;
+    return log;
+}
+
 //----------------------------------------------------------------------------
 
-static void
+static void GLAPIENTRY
+_CheckErrorCallback( GLenum, GLenum type, GLuint id, GLenum severity,
+		     GLsizei, const GLchar* message, const void* )
+{
+    if ( type != GL_DEBUG_TYPE_ERROR && severity != GL_DEBUG_SEVERITY_HIGH ) {
+	return;
+    }
+    std::vector<CheckErrorEntry>&  pending = _CheckErrorLog().pending;
+    for ( size_t i = 0; i < pending.size(); ++i ) {
+	if ( pending[i].error == id ) { pending[i].count++; return; }
+    }
+    CheckErrorEntry e = { NULL, 0, id, 1, message };
+    pending.push_back( e );
+}
+
+//----------------------------------------------------------------------------
+
+inline void
+_CheckErrorInit()
+{
+    if ( !GLEW_KHR_debug ) { return; }
+
+    // synchronous output makes the callback run inside the failing call,
+    // so its errors are pending by the time the next CheckError() runs
+    glEnable( GL_DEBUG_OUTPUT );
+    glEnable( GL_DEBUG_OUTPUT_SYNCHRONOUS );
+    glDebugMessageControl( GL_DONT_CARE, GL_DONT_CARE,
+			   GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE );
+    glDebugMessageCallback( _CheckErrorCallback, NULL );
+    _CheckErrorLog().callback = true;
+}
+
+//----------------------------------------------------------------------------
+
+inline void
 _CheckError( const char* file, int line )
 {
-    GLenum  error = glGetError();
+    CheckErrorLog&  log = _CheckErrorLog();
+
+    if ( log.callback ) {
+	// the driver already reported everything - no need to sync with it
+	for ( size_t i = 0; i < log.pending.size(); ++i ) {
+	    const CheckErrorEntry&  e = log.pending[i];
+	    log.add( file, line, e.error, e.message.c_str(), e.count );
+	}
+	log.pending.clear();
+	return;
+    }
 
-    do {
-	fprintf( stderr, "[%s:%d] %s\n", file, line, ErrorString(error) );
-    } while ((error = glGetError()) != GL_NO_ERROR );
-	
+    GLenum  error;
+    while ( (error = glGetError()) != GL_NO_ERROR ) {
+	log.add( file, line, error, ErrorString(error) );
+    }
 }
 
 //----------------------------------------------------------------------------
 
-#define CheckError()  _CheckError( __FILE__, __LINE__ )
+inline void
+_CheckErrorFrame( const char* file, int line )
+{
+    _CheckError( file, line );
+
+    CheckErrorLog&  log = _CheckErrorLog();
+    for ( size_t i = 0; i < log.entries.size(); ++i ) {
+	const CheckErrorEntry&  e = log.entries[i];
+	fprintf( stderr, "[%s:%d] %s (x%u)\n", e.file, e.line,
+		 e.message.c_str(), e.count );
+    }
+    log.entries.clear();
+}
+
+//----------------------------------------------------------------------------
+
+#define CheckErrorInit()   _CheckErrorInit()
+#define CheckError()       _CheckError( __FILE__, __LINE__ )
+#define CheckErrorFrame()  _CheckErrorFrame( __FILE__, __LINE__ )
+
+#endif // NDEBUG
 
 //----------------------------------------------------------------------------
 
@@ -6,6 +6,8 @@
 //   as the default projetion.
 
 #include "Angel.h"
+#include "../../OpenGL - Teapot/OpenGL/Profiler.h"
+#include "../../OpenGL - Teapot/OpenGL/StreamBuffer.h"
 
 void init();
 void idle(void);
@@ -79,6 +81,15 @@ GLfloat  zNear = 0.5, zFar = 3.0;
 
 GLuint  projection; // projection matrix uniform shader variable location
 
+// Frame timing, shown in the window title
+Profiler profiler;
+bool     showProfile = false;
+
+// The rotated vertices of every frame, written straight into a ring of
+// regions the GPU reads them from
+StreamBuffer transformedBuffer;
+GLuint       vPosition;  // position attribute location
+
 
 //----------------------------------------------------------------------------
 
@@ -130,22 +141,24 @@ void init() {
 	GLuint program = InitShader("vshader42.glsl", "fshader42.glsl");
 	glUseProgram(program);
 
-	// set up vertex arrays
-	GLuint vPosition = glGetAttribLocation(program, "vPosition");
+	// set up vertex arrays; the positions are pointed at the rotated ones
+	// of each frame in display
+	vPosition = glGetAttribLocation(program, "vPosition");
 	glEnableVertexAttribArray(vPosition);
-	glVertexAttribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0,
-		BUFFER_OFFSET(0));
 
 	GLuint vColor = glGetAttribLocation(program, "vColor");
 	glEnableVertexAttribArray(vColor);
 	glVertexAttribPointer(vColor, 4, GL_FLOAT, GL_FALSE, 0,
 		BUFFER_OFFSET(sizeof(points)));
 
+	transformedBuffer.Init(GL_ARRAY_BUFFER, sizeof(point4) * NumVertices);
+
 	model_view = glGetUniformLocation(program, "model_view");
 	projection = glGetUniformLocation(program, "projection");
 
 	glEnable(GL_DEPTH_TEST);
 	glClearColor(1.0, 1.0, 1.0, 1.0);
+	CheckError();
 }
 
 //----------------------------------------------------------------------------
@@ -277,23 +290,35 @@ void reshape(int width, int height) {
 //----------------------------------------------------------------------------
 
 void display(void) {
+	profiler.BeginFrame();
+	transformedBuffer.BeginFrame();
+	profiler.Begin("clear");
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	profiler.End();
 
-	//Rotate setup
+	//Rotate setup, each vertex written once into this frame's region
+	profiler.Begin("transform");
 	mat4  transform = (RotateX(Theta[Xaxis]) *
 		RotateY(Theta[Yaxis]) *
 		RotateZ(Theta[Zaxis]));
 
-	point4  transformed_points[NumVertices];
+	point4 *transformed_points = (point4 *)transformedBuffer.Map(sizeof(point4) * NumVertices);
 
 	for (int i = 0; i < NumVertices; ++i) {
 		transformed_points[i] = transform * points[i];
 	}
 
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(transformed_points),
-		transformed_points);
+	profiler.End();
+
+	profiler.Begin("upload");
+	transformedBuffer.Unmap();
+	glVertexAttribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0,
+		BUFFER_OFFSET(transformedBuffer.Offset()));
+	CheckError();
+	profiler.End();
 
 	//Viewing setup
+	profiler.Begin("uniforms");
 	point4  eye(radius*sin(theta)*cos(phi),
 		radius*sin(theta)*sin(phi),
 		radius*cos(theta),
@@ -306,9 +331,25 @@ void display(void) {
 
 	mat4  p = Ortho(left, right, bottom, top, zNear, zFar);
 	glUniformMatrix4fv(projection, 1, GL_TRUE, p);
+	profiler.End();
 
+	profiler.Begin("draw");
 	glDrawArrays(GL_TRIANGLES, 0, NumVertices);
+	CheckError();
+	profiler.End();
+
+	transformedBuffer.EndFrame();
+
+	profiler.Begin("swap");
 	glutSwapBuffers();
+	profiler.End();
+	profiler.EndFrame();
+	CheckErrorFrame();
+
+	// the core profile has no raster text - report in the title instead
+	if (showProfile && profiler.FrameCount() % 30 == 0) {
+		glutSetWindowTitle(profiler.Summary().c_str());
+	}
 }
 
 //----------------------------------------------------------------------------
@@ -333,6 +374,16 @@ void keyboard(unsigned char key, int x, int y) {
 	case 'p': phi += dr; break;
 	case 'P': phi -= dr; break;
 
+	case 'f':  // toggle frame timings in the window title
+		showProfile = !showProfile;
+		if (!showProfile) glutSetWindowTitle("Color Cube");
+		break;
+	case 'F':  // export frame timings
+		profiler.WriteCSV("profile.csv");
+		profiler.WriteJSON("profile.json");
+		std::cout << profiler.Report();
+		break;
+
 	case ' ':  // reset values to their defaults
 		left = -1.0;
 		right = 1.0;
@@ -358,10 +409,16 @@ int main(int argc, char **argv) {
 	glutInitWindowSize(512, 512);
 	glutInitContextVersion(3, 2);
 	glutInitContextProfile(GLUT_CORE_PROFILE);
+#ifndef NDEBUG
+	glutInitContextFlags(GLUT_DEBUG);
+#endif
 	glutCreateWindow("Color Cube");
 
 	glewExperimental = GL_TRUE;
 	glewInit();
+	// glewInit can leave GL_INVALID_ENUM behind on core profiles
+	glGetError();
+	CheckErrorInit();
 
 	init();
 	setupMenu();
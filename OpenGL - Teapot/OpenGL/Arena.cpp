@@ -0,0 +1,55 @@
+#include <new>
+#include <algorithm>
+
+#include "Arena.h"
+
+Arena::Arena(size_t block_size):
+_blocks(NULL), _next_size(block_size), _allocated(0), _reserved(0), _block_count(0)
+{
+}
+
+Arena::~Arena() {
+    Release();
+}
+
+void Arena::Reserve(size_t bytes) {
+    _next_size = std::max(_next_size, bytes);
+}
+
+// |pointer| rounded up to a multiple of |alignment|
+static char *align(char *pointer, size_t alignment) {
+    return (char *)(((size_t)pointer + alignment - 1) & ~(alignment - 1));
+}
+
+void *Arena::Allocate(size_t bytes, size_t alignment) {
+    char *start = _blocks != NULL ? align(_blocks->top, alignment) : NULL;
+    if (start == NULL || start + bytes > _blocks->end) {
+        // the rest of the current block is left unused
+        size_t size = std::max(_next_size, bytes + alignment);
+        Block *block = (Block *)::operator new(sizeof(Block) + size);
+        block->next = _blocks;
+        block->top = (char *)(block + 1);
+        block->end = block->top + size;
+        _blocks = block;
+        _next_size = size * 2;
+        _reserved += size;
+        _block_count++;
+        start = align(block->top, alignment);
+    }
+    _blocks->top = start + bytes;
+    _allocated += bytes;
+    return start;
+}
+
+void Arena::Release() {
+    while (_blocks != NULL) {
+        Block *next = _blocks->next;
+        // start over from the size of the first block
+        _next_size = _blocks->end - (char *)(_blocks + 1);
+        ::operator delete(_blocks);
+        _blocks = next;
+    }
+    _allocated = 0;
+    _reserved = 0;
+    _block_count = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef _arena_H
+#define _arena_H
+
+#include <cstddef>
+
+/**
+ * A linear allocator for scratch data that is thrown away all at once
+ *
+ * Allocating bumps a pointer through large blocks taken from the heap, and
+ * nothing is freed on its own: Release gives every block back in one go.
+ * That makes a pass that builds a lot of small or growing temporaries cost
+ * a handful of heap allocations instead of one per element, as long as all
+ * of them are dropped together when the pass is done.
+ *
+ * Each block is twice the size of the one before, so memory handed out
+ * beyond the first block takes a number of allocations that only grows with
+ * its logarithm. Sizing the first block with Reserve avoids even those.
+ */
+class Arena {
+    struct Block {
+        Block *next;
+        char *top, *end;  // the free space left after the header
+    };
+
+    Block *_blocks;  // the newest first
+    size_t _next_size;
+    size_t _allocated, _reserved;
+    int _block_count;
+
+    // owns its blocks, so it can't be copied
+    Arena(const Arena &);
+    Arena &operator=(const Arena &);
+
+    public:
+        /** An arena whose first block will be |block_size| bytes **/
+        Arena(size_t block_size = 1 << 16);
+        ~Arena();
+
+        /** Make the next block at least |bytes|, for what is about to be allocated **/
+        void Reserve(size_t bytes);
+
+        /** |bytes| of memory aligned to |alignment|, a power of two **/
+        void *Allocate(size_t bytes, size_t alignment);
+
+        /** Free every block; all memory allocated so far becomes invalid **/
+        void Release();
+
+        /** Bytes handed out, and taken from the heap, since the last Release **/
+        size_t Allocated() { return _allocated; }
+        size_t Reserved() { return _reserved; }
+        int Blocks() { return _block_count; }
+};
+
+/**
+ * Lets standard containers allocate from an Arena
+ * Deallocating does nothing; the memory comes back with Arena::Release,
+ * which must not happen while a container still uses it
+ */
+template <typename T>
+class ArenaAllocator {
+    template <typename U> friend class ArenaAllocator;
+    Arena *_arena;
+
+    public:
+        typedef T value_type;
+
+        ArenaAllocator(Arena &arena): _arena(&arena) {}
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U> &other): _arena(other._arena) {}
+
+        T *allocate(size_t count) {
+            return (T *)_arena->Allocate(count * sizeof(T), alignof(T));
+        }
+        void deallocate(T *, size_t) {}
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U> &other) const { return _arena == other._arena; }
+        template <typename U>
+        bool operator!=(const ArenaAllocator<U> &other) const { return _arena != other._arena; }
+};
+
+#endif
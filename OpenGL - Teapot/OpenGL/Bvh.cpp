@@ -0,0 +1,426 @@
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "Bvh.h"
+#include "ThreadPool.h"
+
+// number of centroid bins the surface area heuristic is evaluated over
+static const int BIN_COUNT = 16;
+// leaves this big are split even when the heuristic says otherwise
+static const unsigned int MAX_LEAF_SIZE = 8;
+// deeper nodes always become leaves, so traversal stacks can't overflow
+static const int MAX_DEPTH = 60;
+static const int STACK_SIZE = 64;
+// ranges smaller than this aren't worth a task of their own
+static const unsigned int PARALLEL_THRESHOLD = 4096;
+
+///////////////////////////////////////////////////////////////////////////////
+//                                   Build                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+struct Bvh::BuildNode {
+    glm::vec3 min, max;
+    BuildNode *left, *right;
+    unsigned int first, count;
+};
+
+struct Bvh::BuildState {
+    std::vector<glm::vec3> centroids, mins, maxs;
+    int parallel_depth;
+};
+
+struct Bin {
+    glm::vec3 min, max;
+    unsigned int count;
+};
+
+static float surface_area(const glm::vec3 &min, const glm::vec3 &max) {
+    glm::vec3 d = glm::max(max - min, glm::vec3(0.0f));
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+Bvh::BuildNode *Bvh::BuildRange(BuildState &state, unsigned int first, unsigned int count, int depth) {
+    BuildNode *node = new BuildNode();
+    node->left = node->right = NULL;
+    node->first = first;
+    node->count = count;
+    node->min = glm::vec3(FLT_MAX);
+    node->max = glm::vec3(-FLT_MAX);
+    glm::vec3 centroid_min(FLT_MAX), centroid_max(-FLT_MAX);
+    for (unsigned int i = first; i < first + count; i++) {
+        unsigned int t = _triangles[i];
+        node->min = glm::min(node->min, state.mins[t]);
+        node->max = glm::max(node->max, state.maxs[t]);
+        centroid_min = glm::min(centroid_min, state.centroids[t]);
+        centroid_max = glm::max(centroid_max, state.centroids[t]);
+    }
+    // a leaf of four is tested in one go, splitting it further gains nothing
+    if (count <= 4 || depth >= MAX_DEPTH) return node;
+
+    // binned surface area heuristic: the cost of a split is the chance of a
+    // ray hitting each side times the triangles it would then test
+    // (small ranges don't need more bins than triangles)
+    int bin_count = std::min(BIN_COUNT, (int)count);
+    float best_cost = FLT_MAX;
+    int best_axis = -1, best_split = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = centroid_max[axis] - centroid_min[axis];
+        if (extent <= 0.0f) continue;
+        float scale = bin_count / extent;
+        Bin bins[BIN_COUNT];
+        for (int b = 0; b < bin_count; b++) {
+            bins[b].min = glm::vec3(FLT_MAX);
+            bins[b].max = glm::vec3(-FLT_MAX);
+            bins[b].count = 0;
+        }
+        for (unsigned int i = first; i < first + count; i++) {
+            unsigned int t = _triangles[i];
+            int b = std::min(bin_count - 1, (int)((state.centroids[t][axis] - centroid_min[axis]) * scale));
+            bins[b].min = glm::min(bins[b].min, state.mins[t]);
+            bins[b].max = glm::max(bins[b].max, state.maxs[t]);
+            bins[b].count++;
+        }
+        // sweep from the right, then from the left
+        float right_area[BIN_COUNT];
+        unsigned int right_count[BIN_COUNT];
+        glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+        unsigned int n = 0;
+        for (int b = bin_count - 1; b > 0; b--) {
+            min = glm::min(min, bins[b].min);
+            max = glm::max(max, bins[b].max);
+            n += bins[b].count;
+            right_area[b] = surface_area(min, max);
+            right_count[b] = n;
+        }
+        min = glm::vec3(FLT_MAX);
+        max = glm::vec3(-FLT_MAX);
+        n = 0;
+        for (int b = 0; b < bin_count - 1; b++) {
+            min = glm::min(min, bins[b].min);
+            max = glm::max(max, bins[b].max);
+            n += bins[b].count;
+            if (n == 0 || right_count[b + 1] == 0) continue;
+            float cost = n * surface_area(min, max) + right_count[b + 1] * right_area[b + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b + 1;
+            }
+        }
+    }
+
+    float area = surface_area(node->min, node->max);
+    float leaf_cost = (float)count;
+    float split_cost = area > 0.0f ? 1.0f + best_cost / area : FLT_MAX;
+    unsigned int left_count;
+    if (best_axis >= 0 && split_cost < leaf_cost) {
+        int axis = best_axis;
+        float scale = bin_count / (centroid_max[axis] - centroid_min[axis]);
+        float offset = centroid_min[axis];
+        int split = best_split;
+        const std::vector<glm::vec3> &centroids = state.centroids;
+        unsigned int *middle = std::partition(&_triangles[first], &_triangles[first] + count,
+            [&](unsigned int t) { return std::min(bin_count - 1, (int)((centroids[t][axis] - offset) * scale)) < split; });
+        left_count = middle - &_triangles[first];
+    } else if (count > MAX_LEAF_SIZE) {
+        // too many triangles for a leaf: split at the median of the widest axis
+        glm::vec3 extent = centroid_max - centroid_min;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        left_count = count / 2;
+        const std::vector<glm::vec3> &centroids = state.centroids;
+        std::nth_element(&_triangles[first], &_triangles[first] + left_count, &_triangles[first] + count,
+            [&](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+    } else {
+        return node;
+    }
+
+    if (depth < state.parallel_depth && count > PARALLEL_THRESHOLD) {
+        // the left half left for another thread to steal
+        ThreadPool &pool = thread_pool();
+        ThreadPool::Group group;
+        pool.Spawn(group, [&]() { node->left = BuildRange(state, first, left_count, depth + 1); });
+        node->right = BuildRange(state, first + left_count, count - left_count, depth + 1);
+        pool.Wait(group);
+    } else {
+        node->left = BuildRange(state, first, left_count, depth + 1);
+        node->right = BuildRange(state, first + left_count, count - left_count, depth + 1);
+    }
+    return node;
+}
+
+// lays out |node| and its children depth first and frees them
+unsigned int Bvh::Flatten(BuildNode *node) {
+    unsigned int index = _nodes.size();
+    Node flat;
+    flat.min = node->min;
+    flat.max = node->max;
+    flat.offset = node->first;
+    flat.count = node->count;
+    _nodes.push_back(flat);
+    if (node->left) {
+        Flatten(node->left);
+        unsigned int right = Flatten(node->right);
+        _nodes[index].offset = right;
+        _nodes[index].count = 0;
+    }
+    delete node;
+    return index;
+}
+
+void Bvh::Build(const std::vector<glm::vec3> &vertices, int threads) {
+    unsigned int triangle_count = vertices.size() / 3;
+    _nodes.clear();
+    _triangles.resize(triangle_count);
+    for (int k = 0; k < 3; k++) {
+        _v0[k].clear();
+        _e1[k].clear();
+        _e2[k].clear();
+    }
+    if (triangle_count == 0) return;
+
+    BuildState state;
+    state.centroids.resize(triangle_count);
+    state.mins.resize(triangle_count);
+    state.maxs.resize(triangle_count);
+    for (unsigned int t = 0; t < triangle_count; t++) {
+        const glm::vec3 &a = vertices[3 * t], &b = vertices[3 * t + 1], &c = vertices[3 * t + 2];
+        state.mins[t] = glm::min(a, glm::min(b, c));
+        state.maxs[t] = glm::max(a, glm::max(b, c));
+        state.centroids[t] = (a + b + c) / 3.0f;
+        _triangles[t] = t;
+    }
+    // every level down doubles the tasks; a few of them a thread when all
+    // the threads are used, so those that finish early can steal
+    int tasks = threads <= 0 ? 4 * thread_pool().Threads() : threads;
+    state.parallel_depth = 0;
+    while ((1 << state.parallel_depth) < tasks) state.parallel_depth++;
+
+    _nodes.reserve(2 * triangle_count);
+    Flatten(BuildRange(state, 0, triangle_count, 0));
+
+    // the triangles in leaf order, padded for reading four at a time
+    for (int k = 0; k < 3; k++) {
+        _v0[k].resize(triangle_count + 3, 0.0f);
+        _e1[k].resize(triangle_count + 3, 0.0f);
+        _e2[k].resize(triangle_count + 3, 0.0f);
+    }
+    for (unsigned int i = 0; i < triangle_count; i++) {
+        unsigned int t = _triangles[i];
+        const glm::vec3 &a = vertices[3 * t], &b = vertices[3 * t + 1], &c = vertices[3 * t + 2];
+        for (int k = 0; k < 3; k++) {
+            _v0[k][i] = a[k];
+            _e1[k][i] = b[k] - a[k];
+            _e2[k][i] = c[k] - a[k];
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 Traversal                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+// masks of the first 0, 1, 2, 3 and 4 lanes
+static const unsigned int LANES[5][4] = {
+    { 0, 0, 0, 0 }, { ~0u, 0, 0, 0 }, { ~0u, ~0u, 0, 0 }, { ~0u, ~0u, ~0u, 0 }, { ~0u, ~0u, ~0u, ~0u },
+};
+
+static inline __m128 lane_mask(unsigned int lanes) {
+    return _mm_loadu_ps((const float *)LANES[std::min(lanes, 4u)]);
+}
+
+// Entry distance of a ray into the box of |node|, FLT_MAX if it misses or
+// only enters beyond |t_max|. The fourth lane of the loads holds the other
+// node fields and is ignored.
+static inline float ray_box(const glm::vec3 &min, const glm::vec3 &max, __m128 origin, __m128 inv_direction,
+                            float t_max) {
+    __m128 lo = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&min.x), origin), inv_direction);
+    __m128 hi = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&max.x), origin), inv_direction);
+    __m128 t_min = _mm_min_ps(lo, hi);
+    __m128 t_max4 = _mm_max_ps(lo, hi);
+    __m128 t_in = _mm_max_ss(_mm_max_ss(t_min, _mm_shuffle_ps(t_min, t_min, _MM_SHUFFLE(1, 1, 1, 1))),
+                             _mm_shuffle_ps(t_min, t_min, _MM_SHUFFLE(2, 2, 2, 2)));
+    __m128 t_out = _mm_min_ss(_mm_min_ss(t_max4, _mm_shuffle_ps(t_max4, t_max4, _MM_SHUFFLE(1, 1, 1, 1))),
+                            _mm_shuffle_ps(t_max4, t_max4, _MM_SHUFFLE(2, 2, 2, 2)));
+    float t_near = _mm_cvtss_f32(t_in), t_far = _mm_cvtss_f32(t_out);
+    if (t_near > t_far || t_far < 0.0f || t_near > t_max) return FLT_MAX;
+    return t_near;
+}
+
+bool Bvh::Intersect(const Ray &ray, RayHit &hit) const {
+    hit.triangle = -1;
+    hit.t = ray.t_max;
+    if (_nodes.empty()) return false;
+
+    const glm::vec3 &o = ray.origin, &d = ray.direction;
+    __m128 origin = _mm_setr_ps(o.x, o.y, o.z, 0.0f);
+    __m128 inv_direction = _mm_setr_ps(1.0f / d.x, 1.0f / d.y, 1.0f / d.z, 0.0f);
+    __m128 ox = _mm_set1_ps(o.x), oy = _mm_set1_ps(o.y), oz = _mm_set1_ps(o.z);
+    __m128 dx = _mm_set1_ps(d.x), dy = _mm_set1_ps(d.y), dz = _mm_set1_ps(d.z);
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    __m128 sign = _mm_set1_ps(-0.0f), epsilon = _mm_set1_ps(1e-20f);
+
+    // nodes still to visit, with their entry distance
+    unsigned int stack[STACK_SIZE];
+    float stack_t[STACK_SIZE];
+    int size = 0;
+    unsigned int index = 0;
+    if (ray_box(_nodes[0].min, _nodes[0].max, origin, inv_direction, hit.t) == FLT_MAX) return false;
+    while (true) {
+        const Node &node = _nodes[index];
+        if (node.count > 0) {
+            // one ray against four triangles at a time (Moller-Trumbore)
+            for (unsigned int i = node.offset; i < node.offset + node.count; i += 4) {
+                __m128 e1x = _mm_loadu_ps(&_e1[0][i]), e1y = _mm_loadu_ps(&_e1[1][i]), e1z = _mm_loadu_ps(&_e1[2][i]);
+                __m128 e2x = _mm_loadu_ps(&_e2[0][i]), e2y = _mm_loadu_ps(&_e2[1][i]), e2z = _mm_loadu_ps(&_e2[2][i]);
+                __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+                __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+                __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+                __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+                __m128 inv_det = _mm_div_ps(one, det);
+                __m128 sx = _mm_sub_ps(ox, _mm_loadu_ps(&_v0[0][i]));
+                __m128 sy = _mm_sub_ps(oy, _mm_loadu_ps(&_v0[1][i]));
+                __m128 sz = _mm_sub_ps(oz, _mm_loadu_ps(&_v0[2][i]));
+                __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv_det);
+                __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+                __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+                __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+                __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+                __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+                __m128 mask = _mm_and_ps(lane_mask(node.offset + node.count - i), _mm_cmpgt_ps(_mm_andnot_ps(sign, det), epsilon));
+                mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+                mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+                mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, _mm_set1_ps(hit.t))));
+                int hits = _mm_movemask_ps(mask);
+                if (!hits) continue;
+                float ts[4], us[4], vs[4];
+                _mm_storeu_ps(ts, t);
+                _mm_storeu_ps(us, u);
+                _mm_storeu_ps(vs, v);
+                for (int lane = 0; lane < 4; lane++) {
+                    if ((hits & (1 << lane)) && ts[lane] < hit.t) {
+                        hit.t = ts[lane];
+                        hit.u = us[lane];
+                        hit.v = vs[lane];
+                        hit.triangle = _triangles[i + lane];
+                    }
+                }
+            }
+        } else {
+            // visit the nearer child first
+            unsigned int left = index + 1, right = node.offset;
+            float t_left = ray_box(_nodes[left].min, _nodes[left].max, origin, inv_direction, hit.t);
+            float t_right = ray_box(_nodes[right].min, _nodes[right].max, origin, inv_direction, hit.t);
+            if (t_left != FLT_MAX && t_right != FLT_MAX) {
+                if (t_right < t_left) {
+                    std::swap(left, right);
+                    std::swap(t_left, t_right);
+                }
+                stack[size] = right;
+                stack_t[size++] = t_right;
+                index = left;
+                continue;
+            }
+            if (t_left != FLT_MAX) { index = left; continue; }
+            if (t_right != FLT_MAX) { index = right; continue; }
+        }
+        // skip the nodes that start beyond the closest hit so far
+        while (size > 0 && stack_t[size - 1] > hit.t) size--;
+        if (size == 0) break;
+        index = stack[--size];
+    }
+    return hit.triangle >= 0;
+}
+
+void Bvh::Intersect4(const Ray rays[4], RayHit hits[4]) const {
+    for (int r = 0; r < 4; r++) {
+        hits[r].triangle = -1;
+        hits[r].t = rays[r].t_max;
+    }
+    if (_nodes.empty()) return;
+
+    __m128 ox = _mm_setr_ps(rays[0].origin.x, rays[1].origin.x, rays[2].origin.x, rays[3].origin.x);
+    __m128 oy = _mm_setr_ps(rays[0].origin.y, rays[1].origin.y, rays[2].origin.y, rays[3].origin.y);
+    __m128 oz = _mm_setr_ps(rays[0].origin.z, rays[1].origin.z, rays[2].origin.z, rays[3].origin.z);
+    __m128 dx = _mm_setr_ps(rays[0].direction.x, rays[1].direction.x, rays[2].direction.x, rays[3].direction.x);
+    __m128 dy = _mm_setr_ps(rays[0].direction.y, rays[1].direction.y, rays[2].direction.y, rays[3].direction.y);
+    __m128 dz = _mm_setr_ps(rays[0].direction.z, rays[1].direction.z, rays[2].direction.z, rays[3].direction.z);
+    __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    __m128 sign = _mm_set1_ps(-0.0f), epsilon = _mm_set1_ps(1e-20f);
+    __m128 ix = _mm_div_ps(one, dx), iy = _mm_div_ps(one, dy), iz = _mm_div_ps(one, dz);
+    __m128 best_t = _mm_setr_ps(hits[0].t, hits[1].t, hits[2].t, hits[3].t);
+    __m128 best_u = zero, best_v = zero;
+    __m128i best_triangle = _mm_set1_epi32(-1);
+
+    unsigned int stack[STACK_SIZE];
+    int size = 0;
+    unsigned int index = 0;
+    while (true) {
+        const Node &node = _nodes[index];
+        // the four rays against the box of the node
+        __m128 lx = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.x), ox), ix);
+        __m128 hx = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.x), ox), ix);
+        __m128 ly = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.y), oy), iy);
+        __m128 hy = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.y), oy), iy);
+        __m128 lz = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.z), oz), iz);
+        __m128 hz = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.z), oz), iz);
+        __m128 t_in = _mm_max_ps(_mm_max_ps(_mm_min_ps(lx, hx), _mm_min_ps(ly, hy)), _mm_min_ps(lz, hz));
+        __m128 t_out = _mm_min_ps(_mm_min_ps(_mm_max_ps(lx, hx), _mm_max_ps(ly, hy)), _mm_max_ps(lz, hz));
+        __m128 inside = _mm_and_ps(_mm_cmple_ps(t_in, t_out), _mm_cmpge_ps(t_out, zero));
+        inside = _mm_and_ps(inside, _mm_cmple_ps(t_in, best_t));
+
+        if (_mm_movemask_ps(inside)) {
+            if (node.count == 0) {
+                stack[size++] = node.offset;
+                index = index + 1;
+                continue;
+            }
+            for (unsigned int i = node.offset; i < node.offset + node.count; i++) {
+                // the four rays against one triangle (Moller-Trumbore)
+                __m128 e1x = _mm_set1_ps(_e1[0][i]), e1y = _mm_set1_ps(_e1[1][i]), e1z = _mm_set1_ps(_e1[2][i]);
+                __m128 e2x = _mm_set1_ps(_e2[0][i]), e2y = _mm_set1_ps(_e2[1][i]), e2z = _mm_set1_ps(_e2[2][i]);
+                __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+                __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+                __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+                __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+                __m128 inv_det = _mm_div_ps(one, det);
+                __m128 sx = _mm_sub_ps(ox, _mm_set1_ps(_v0[0][i]));
+                __m128 sy = _mm_sub_ps(oy, _mm_set1_ps(_v0[1][i]));
+                __m128 sz = _mm_sub_ps(oz, _mm_set1_ps(_v0[2][i]));
+                __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv_det);
+                __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+                __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+                __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+                __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+                __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+                __m128 mask = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_andnot_ps(sign, det), epsilon));
+                mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+                mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+                mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, best_t)));
+                if (!_mm_movemask_ps(mask)) continue;
+                best_t = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, best_t));
+                best_u = _mm_or_ps(_mm_and_ps(mask, u), _mm_andnot_ps(mask, best_u));
+                best_v = _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, best_v));
+                __m128i imask = _mm_castps_si128(mask);
+                best_triangle = _mm_or_si128(_mm_and_si128(imask, _mm_set1_epi32(_triangles[i])),
+                                             _mm_andnot_si128(imask, best_triangle));
+            }
+        }
+        if (size == 0) break;
+        index = stack[--size];
+    }
+
+    float ts[4], us[4], vs[4];
+    int triangles[4];
+    _mm_storeu_ps(ts, best_t);
+    _mm_storeu_ps(us, best_u);
+    _mm_storeu_ps(vs, best_v);
+    _mm_storeu_si128((__m128i *)triangles, best_triangle);
+    for (int r = 0; r < 4; r++) {
+        hits[r].triangle = triangles[r];
+        hits[r].t = ts[r];
+        hits[r].u = us[r];
+        hits[r].v = vs[r];
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef _bvh_H
+#define _bvh_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/** A ray from |origin| along |direction|, hitting things up to |t_max| **/
+struct Ray {
+    glm::vec3 origin, direction;
+    float t_max;
+};
+
+/**
+ * The closest hit of a ray: |triangle| is the index of the triangle in the
+ * mesh, -1 for a miss, and the hit point is origin + t * direction, or
+ * (1 - u - v) * a + u * b + v * c on the triangle a b c
+ */
+struct RayHit {
+    int triangle;
+    float t, u, v;
+};
+
+/**
+ * Bounding volume hierarchy over the triangles of a mesh for ray queries
+ *
+ * Built top down with the surface area heuristic evaluated over bins of
+ * triangle centroids; the upper levels are built as tasks of the shared
+ * ThreadPool. The
+ * nodes are stored depth first - a node's left child follows it - and the
+ * triangles of every leaf are copied next to each other in a
+ * structure-of-arrays layout, so a ray is tested against four of them at a
+ * time with SSE. Packets of four rays share the traversal and are tested
+ * four at a time against each box and triangle.
+ */
+class Bvh {
+    struct Node {
+        glm::vec3 min;
+        unsigned int offset;  // right child of an inner node, first triangle of a leaf
+        glm::vec3 max;
+        unsigned int count;   // triangles of a leaf, 0 for an inner node
+    };
+    struct BuildNode;
+    struct BuildState;
+
+    std::vector<Node> _nodes;
+    std::vector<unsigned int> _triangles;
+    // first vertex and the two edges from it of every triangle, in leaf order
+    std::vector<float> _v0[3], _e1[3], _e2[3];
+
+    BuildNode *BuildRange(BuildState &state, unsigned int first, unsigned int count, int depth);
+    unsigned int Flatten(BuildNode *node);
+
+    public:
+        /**
+         * Build the hierarchy over |vertices| in triangle order (see
+         * TriangleMesh::Vertices), using up to |threads| threads - all the
+         * hardware has if 0
+         */
+        void Build(const std::vector<glm::vec3> &vertices, int threads = 0);
+
+        /** Find the closest hit of |ray|, returns false if it misses **/
+        bool Intersect(const Ray &ray, RayHit &hit) const;
+
+        /** Find the closest hits of four rays at once **/
+        void Intersect4(const Ray rays[4], RayHit hits[4]) const;
+
+        int NodeCount() const { return _nodes.size(); }
+        int TriangleCount() const { return _triangles.size(); }
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "FrameCapture.h"
+
+// store a little endian integer of |bytes| bytes at |out|
+static void put_le(unsigned char *out, unsigned int value, int bytes) {
+    for (int i = 0; i < bytes; i++) out[i] = (value >> (8 * i)) & 0xFF;
+}
+
+FrameCapture::FrameCapture():
+_next(0), _oldest(0), _frame(0), _width(0), _height(0), _row_size(0),
+_recording(false), _use_fences(false), _quit(false)
+{
+}
+
+FrameCapture::~FrameCapture() {
+    Stop();
+}
+
+void FrameCapture::Start(const char *directory, int width, int height, int ring_size) {
+    if (_recording) return;
+    if (ring_size < 2) ring_size = 2;
+    _directory = directory;
+#ifdef _WIN32
+    _mkdir(directory);
+#else
+    mkdir(directory, 0755);
+#endif
+    _width = width;
+    _height = height;
+    // bmp rows are padded to 4 bytes, pack the pixels the same way so the
+    // mapped buffer can be written out as is
+    _row_size = (width * 3 + 3) & ~3;
+    _use_fences = GLEW_ARB_sync != 0;
+    _next = _oldest = _frame = 0;
+
+    _slots.resize(ring_size);
+    for (int i = 0; i < ring_size; i++) {
+        Slot &slot = _slots[i];
+        glGenBuffers(1, &slot.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, _row_size * height, NULL, GL_STREAM_READ);
+        slot.fence = 0;
+        slot.pending = false;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    _quit = false;
+    _worker = std::thread(&FrameCapture::Work, this);
+    _recording = true;
+}
+
+void FrameCapture::Stop() {
+    if (!_recording) return;
+    // retire the readbacks still in flight, oldest first
+    for (size_t i = 0; i < _slots.size(); i++) {
+        Slot &slot = _slots[(_oldest + i) % _slots.size()];
+        if (slot.pending) Retire(slot);
+    }
+    for (size_t i = 0; i < _slots.size(); i++) glDeleteBuffers(1, &_slots[i].pbo);
+    _slots.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wake.notify_one();
+    _worker.join();
+    _free_buffers.clear();
+    _recording = false;
+    std::cout << "captured " << _frame << " frames to " << _directory << std::endl;
+}
+
+void FrameCapture::Capture() {
+    if (!_recording) return;
+
+    // hand over every readback that has already landed without waiting
+    while (_slots[_oldest].pending) {
+        Slot &slot = _slots[_oldest];
+        if (_use_fences) {
+            GLenum state = glClientWaitSync(slot.fence, 0, 0);
+            if (state == GL_TIMEOUT_EXPIRED) break;
+        } else if (slot.frame > _frame - (int)_slots.size() + 1) {
+            // without fences assume the transfer is done after a full ring
+            break;
+        }
+        Retire(slot);
+        _oldest = (_oldest + 1) % _slots.size();
+    }
+
+    // the ring is full - the oldest readback has to complete before reuse
+    Slot &slot = _slots[_next];
+    if (slot.pending) {
+        Retire(slot);
+        _oldest = (_oldest + 1) % _slots.size();
+    }
+
+    // issue the asynchronous readback
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    glReadPixels(0, 0, _width, _height, GL_BGR, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (_use_fences) slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = _frame++;
+    slot.pending = true;
+    _next = (_next + 1) % _slots.size();
+}
+
+void FrameCapture::Retire(Slot &slot) {
+    if (_use_fences) {
+        glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+    }
+    slot.pending = false;
+
+    Frame frame;
+    frame.number = slot.frame;
+    {
+        // reuse a buffer the worker is done with if there is one
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_free_buffers.empty()) {
+            frame.pixels.swap(_free_buffers.back());
+            _free_buffers.pop_back();
+        }
+    }
+    frame.pixels.resize(_row_size * _height);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    void *data = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (data != NULL) {
+        memcpy(&frame.pixels[0], data, frame.pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (data == NULL) return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(Frame());
+        _queue.back().number = frame.number;
+        _queue.back().pixels.swap(frame.pixels);
+    }
+    _wake.notify_one();
+}
+
+void FrameCapture::Work() {
+    while (1) {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (_queue.empty() && !_quit) _wake.wait(lock);
+            if (_queue.empty()) return;
+            frame.number = _queue.front().number;
+            frame.pixels.swap(_queue.front().pixels);
+            _queue.pop_front();
+        }
+        WriteBMP(frame);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _free_buffers.push_back(std::vector<unsigned char>());
+        _free_buffers.back().swap(frame.pixels);
+    }
+}
+
+void FrameCapture::WriteBMP(const Frame &frame) {
+    char path[512];
+    sprintf(path, "%s/frame_%05d.bmp", _directory.c_str(), frame.number);
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        std::cerr << "couldn't write " << path << std::endl;
+        return;
+    }
+    // 24 bit bottom-up bitmap - the same row order glReadPixels returns
+    unsigned char header[54];
+    memset(header, 0, sizeof(header));
+    unsigned int image_size = _row_size * _height;
+    header[0] = 'B';
+    header[1] = 'M';
+    put_le(&header[0x02], 54 + image_size, 4);
+    put_le(&header[0x0A], 54, 4);
+    put_le(&header[0x0E], 40, 4);
+    put_le(&header[0x12], _width, 4);
+    put_le(&header[0x16], _height, 4);
+    put_le(&header[0x1A], 1, 2);
+    put_le(&header[0x1C], 24, 2);
+    put_le(&header[0x22], image_size, 4);
+    fwrite(header, 1, sizeof(header), file);
+    fwrite(&frame.pixels[0], 1, image_size, file);
+    fclose(file);
+}
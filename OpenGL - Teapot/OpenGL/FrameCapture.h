@@ -0,0 +1,75 @@
+#ifndef _capture_H
+#define _capture_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <GL/glew.h>
+
+/**
+ * Records the rendered frames to a directory of numbered ``bmp`` files
+ *
+ * Readbacks are issued with ``glReadPixels`` into a ring of pixel pack buffers
+ * and fenced, so the call returns immediately. A buffer is only mapped once
+ * its fence has signalled, one or two frames later, and the pixels are handed
+ * to a worker thread that encodes and writes them to disk.
+ */
+class FrameCapture {
+    // one pixel pack buffer of the ring
+    struct Slot {
+        GLuint pbo;
+        GLsync fence;
+        int frame;
+        bool pending;
+    };
+    // a mapped frame waiting to be written by the worker
+    struct Frame {
+        std::vector<unsigned char> pixels;
+        int number;
+    };
+
+    std::vector<Slot> _slots;
+    int _next, _oldest, _frame, _width, _height, _row_size;
+    bool _recording, _use_fences;
+    std::string _directory;
+
+    std::thread _worker;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::deque<Frame> _queue;
+    std::vector< std::vector<unsigned char> > _free_buffers;
+    bool _quit;
+
+    void Retire(Slot &slot);
+    void Work();
+    void WriteBMP(const Frame &frame);
+
+    public:
+        FrameCapture();
+        ~FrameCapture();
+
+        /**
+         * Start recording frames of |width| x |height| pixels to |directory|
+         * using |ring_size| pixel pack buffers
+         */
+        void Start(const char *directory, int width, int height, int ring_size = 3);
+
+        /**
+         * Retire all outstanding readbacks, write them out and stop the worker
+         */
+        void Stop();
+
+        /**
+         * Queue a readback of the current framebuffer
+         * Call after the scene is drawn and before the buffers are flushed
+         */
+        void Capture();
+
+        bool Recording() { return _recording; }
+        int FrameCount() { return _frame; }
+};
+
+#endif
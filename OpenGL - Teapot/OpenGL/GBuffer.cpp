@@ -0,0 +1,90 @@
+#include <iostream>
+
+#include "GBuffer.h"
+
+GBuffer::GBuffer():
+_framebuffer(0), _albedo(0), _normal(0), _depth(0), _quad(0), _width(0), _height(0), _supported(false)
+{
+}
+
+GBuffer::~GBuffer() {
+    if (_framebuffer != 0) glDeleteFramebuffers(1, &_framebuffer);
+    if (_albedo != 0) {
+        GLuint textures[3] = { _albedo, _normal, _depth };
+        glDeleteTextures(3, textures);
+    }
+    if (_quad != 0) glDeleteBuffers(1, &_quad);
+}
+
+// a texture of |width| x |height| texels without mipmaps
+static void allocate_texture(GLuint texture, GLint internal_format, GLenum format, GLenum type, int width, int height) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+bool GBuffer::Init(void) {
+    _supported = GLEW_VERSION_3_0 != 0;
+    if (!_supported) {
+        std::cerr << "Framebuffer objects aren't supported, no deferred shading" << std::endl;
+        return false;
+    }
+    GLuint textures[3];
+    glGenTextures(3, textures);
+    _albedo = textures[0];
+    _normal = textures[1];
+    _depth = textures[2];
+    glGenFramebuffers(1, &_framebuffer);
+
+    // two triangles over the screen
+    const float corners[8] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+    glGenBuffers(1, &_quad);
+    glBindBuffer(GL_ARRAY_BUFFER, _quad);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+void GBuffer::Begin(int width, int height) {
+    glGetIntegerv(GL_VIEWPORT, _viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    if (width != _width || height != _height) {
+        _width = width;
+        _height = height;
+        allocate_texture(_albedo, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+        allocate_texture(_normal, GL_RG16, GL_RG, GL_UNSIGNED_SHORT, width, height);
+        allocate_texture(_depth, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _albedo, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, _normal, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _depth, 0);
+        const GLenum draw_buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, draw_buffers);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "G-buffer framebuffer incomplete (" << status << ")" << std::endl;
+        }
+    }
+    glViewport(0, 0, width, height);
+    // an albedo alpha of 0 marks the pixels nothing was drawn on
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void GBuffer::End(void) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(_viewport[0], _viewport[1], _viewport[2], _viewport[3]);
+}
+
+void GBuffer::DrawQuad(GLint position_location) {
+    if (position_location == -1) return;
+    glEnableVertexAttribArray(position_location);
+    glBindBuffer(GL_ARRAY_BUFFER, _quad);
+    glVertexAttribPointer(position_location, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glDisableVertexAttribArray(position_location);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,57 @@
+#ifndef _gbuffer_H
+#define _gbuffer_H
+
+#include <GL/glew.h>
+
+/**
+ * The geometry buffer of deferred shading: what the lighting needs to know
+ * about the surface seen at every pixel
+ *
+ * Twelve bytes a pixel:
+ * - albedo (``GL_RGBA8``), the surface color and its specular intensity
+ * - normal (``GL_RG16``), in view coordinates, octahedron encoded
+ * - depth (``GL_DEPTH_COMPONENT24``), the view position is reconstructed
+ *   from it with the inverse projection
+ *
+ * The buffers follow the size of the window. A screen filling quad is kept
+ * for the lighting pass.
+ */
+class GBuffer {
+    GLuint _framebuffer, _albedo, _normal, _depth, _quad;
+    int _width, _height;
+    bool _supported;
+    GLint _viewport[4];
+
+    public:
+        GBuffer();
+        ~GBuffer();
+
+        /**
+         * Create the framebuffer and the screen quad
+         * Returns false where framebuffer objects or two channel textures
+         * (OpenGL 3.0) aren't supported
+         */
+        bool Init(void);
+
+        /**
+         * Render the geometry pass into the buffers: binds the framebuffer,
+         * reallocating the textures if the window changed size, and clears it
+         */
+        void Begin(int width, int height);
+
+        /** Go back to drawing into the window **/
+        void End(void);
+
+        /**
+         * Draw a quad over the whole screen with its corners at -1 and 1 in
+         * the 2 component attribute |position_location|
+         */
+        void DrawQuad(GLint position_location);
+
+        bool Supported() { return _supported; }
+        GLuint Albedo() { return _albedo; }
+        GLuint Normal() { return _normal; }
+        GLuint Depth() { return _depth; }
+};
+
+#endif
@@ -0,0 +1,251 @@
+#include <cstring>
+#include <algorithm>
+
+#include "GeometryPool.h"
+#include "buffer_upload.h"
+
+typedef std::map<unsigned int, unsigned int> FreeRanges;
+
+// The first of |count| elements taken from the first free range big enough,
+// -1 if there is none
+static long take_range(FreeRanges &free, unsigned int count) {
+    for (FreeRanges::iterator it = free.begin(); it != free.end(); ++it) {
+        if (it->second < count) continue;
+        unsigned int start = it->first, left = it->second - count;
+        free.erase(it);
+        if (left > 0) free[start + count] = left;
+        return start;
+    }
+    return -1;
+}
+
+// Free |count| elements from |start|, merged with the free ranges around them
+static void give_range(FreeRanges &free, unsigned int start, unsigned int count) {
+    if (count == 0) return;
+    FreeRanges::iterator next = free.lower_bound(start);
+    if (next != free.begin()) {
+        FreeRanges::iterator previous = next;
+        --previous;
+        if (previous->first + previous->second == start) {
+            start = previous->first;
+            count += previous->second;
+            free.erase(previous);
+        }
+    }
+    if (next != free.end() && start + count == next->first) {
+        count += next->second;
+        free.erase(next);
+    }
+    free[start] = count;
+}
+
+// A buffer of |size| bytes starting with the first |old_size| of |old|,
+// which is deleted
+static GLuint grow_buffer(GLuint old, size_t old_size, size_t size) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+    if (old != 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, old);
+        if (old_size > 0) glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &old);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return buffer;
+}
+
+GeometryPool::GeometryPool():
+_positions(0), _normals(0), _uvs(0), _indices(0), _vertex_capacity(0), _index_capacity(0), _supported(false)
+{
+}
+
+GeometryPool::~GeometryPool() {
+    if (_positions != 0) {
+        GLuint buffers[4] = { _positions, _normals, _uvs, _indices };
+        glDeleteBuffers(4, buffers);
+    }
+}
+
+bool GeometryPool::Init(void) {
+    _supported = GLEW_VERSION_3_2 != 0;
+    if (!_supported) return false;
+    if (Batches()) {
+        _command_stream.Init(GL_DRAW_INDIRECT_BUFFER, 256 * sizeof(DrawElementsIndirectCommand));
+        _matrix_stream.Init(GL_ARRAY_BUFFER, 256 * sizeof(glm::mat4));
+    }
+    return true;
+}
+
+bool GeometryPool::Batches() {
+    return _supported && GLEW_ARB_multi_draw_indirect && (GLEW_VERSION_4_2 || GLEW_ARB_base_instance) &&
+           GLEW_VERSION_3_3;
+}
+
+void GeometryPool::Grow(unsigned int vertices, unsigned int indices) {
+    if (vertices > 0) {
+        unsigned int capacity = std::max(2 * _vertex_capacity, _vertex_capacity + vertices);
+        _positions = grow_buffer(_positions, sizeof(glm::vec3) * _vertex_capacity, sizeof(glm::vec3) * capacity);
+        _normals = grow_buffer(_normals, sizeof(glm::vec3) * _vertex_capacity, sizeof(glm::vec3) * capacity);
+        _uvs = grow_buffer(_uvs, sizeof(glm::vec2) * _vertex_capacity, sizeof(glm::vec2) * capacity);
+        give_range(_free_vertices, _vertex_capacity, capacity - _vertex_capacity);
+        _vertex_capacity = capacity;
+    }
+    if (indices > 0) {
+        unsigned int capacity = std::max(2 * _index_capacity, _index_capacity + indices);
+        _indices = grow_buffer(_indices, sizeof(unsigned int) * _index_capacity, sizeof(unsigned int) * capacity);
+        give_range(_free_indices, _index_capacity, capacity - _index_capacity);
+        _index_capacity = capacity;
+    }
+}
+
+// Write |count| entries of the triangle order array |corners| of |mesh|,
+// gathered if |indexed|, to |buffer| from entry |first|. The range may have
+// been freed by a mesh that frames in flight still draw, so it's written
+// through glBufferSubData, which the driver orders after them
+template <typename T>
+static void upload_vertices(GLuint buffer, unsigned int first, unsigned int count, TriangleMesh &mesh,
+                            Span<const T> corners, bool indexed) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    write_buffer(GL_COPY_WRITE_BUFFER, sizeof(T) * first, sizeof(T) * count, [&](void *target) {
+        if (indexed) mesh.GatherIndexed(corners, (T *)target);
+        else memcpy(target, corners.Data(), sizeof(T) * count);
+    }, false);
+}
+
+int GeometryPool::Add(TriangleMesh &mesh) {
+    if (!_supported || mesh.VertexCount() == 0) return -1;
+    bool indexed = mesh.IndexCount() > 0;
+    if (mesh.Normals().Size() != (size_t)mesh.VertexCount()) mesh.ComputeNormals(true);
+    PooledMesh pooled;
+    pooled.vertex_count = indexed ? mesh.IndexedVertexCount() : mesh.VertexCount();
+    pooled.index_count = indexed ? mesh.Lods()[0].count : mesh.VertexCount();
+
+    long base, first;
+    while ((base = take_range(_free_vertices, pooled.vertex_count)) < 0) Grow(pooled.vertex_count, 0);
+    while ((first = take_range(_free_indices, pooled.index_count)) < 0) Grow(0, pooled.index_count);
+    pooled.base_vertex = base;
+    pooled.first_index = first;
+
+    upload_vertices<glm::vec3>(_positions, base, pooled.vertex_count, mesh, mesh.Vertices(), indexed);
+    upload_vertices<glm::vec3>(_normals, base, pooled.vertex_count, mesh, mesh.Normals(), indexed);
+    upload_vertices<glm::vec2>(_uvs, base, pooled.vertex_count, mesh, mesh.UVs(), indexed);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _indices);
+    write_buffer(GL_COPY_WRITE_BUFFER, sizeof(unsigned int) * first, sizeof(unsigned int) * pooled.index_count,
+                 [&](void *target) {
+        unsigned int *indices = (unsigned int *)target;
+        if (indexed) {
+            memcpy(indices, &mesh.Indices()[mesh.Lods()[0].first], sizeof(unsigned int) * pooled.index_count);
+        } else {
+            for (unsigned int i = 0; i < pooled.index_count; i++) indices[i] = i;
+        }
+    }, false);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // the box around the mesh, and the sphere around the box
+    std::vector<glm::vec3> &vertices = mesh.Vertices();
+    glm::vec3 min(vertices[0]), max(vertices[0]);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        min = glm::min(min, vertices[i]);
+        max = glm::max(max, vertices[i]);
+    }
+    pooled.center = (min + max) * 0.5f;
+    pooled.radius = glm::length(max - pooled.center);
+
+    // the slot of a mesh removed before, if there is one
+    int id = std::find(_used.begin(), _used.end(), false) - _used.begin();
+    if (id == (int)_meshes.size()) {
+        _meshes.push_back(pooled);
+        _used.push_back(true);
+    } else {
+        _meshes[id] = pooled;
+        _used[id] = true;
+    }
+    return id;
+}
+
+void GeometryPool::Remove(int id) {
+    if (id < 0 || id >= (int)_meshes.size() || !_used[id]) return;
+    give_range(_free_vertices, _meshes[id].base_vertex, _meshes[id].vertex_count);
+    give_range(_free_indices, _meshes[id].first_index, _meshes[id].index_count);
+    _used[id] = false;
+}
+
+void GeometryPool::BindAttributes(const GLint locations[3]) {
+    const GLuint buffers[3] = { _positions, _normals, _uvs };
+    const int sizes[3] = { 3, 3, 2 };
+    for (int i = 0; i < 3; i++) {
+        if (locations[i] == -1) continue;
+        glEnableVertexAttribArray(locations[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+        glVertexAttribPointer(locations[i], sizes[i], GL_FLOAT, GL_FALSE, 0, 0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indices);
+}
+
+void GeometryPool::BeginFrame() {
+    _command_stream.BeginFrame();
+    _matrix_stream.BeginFrame();
+}
+
+void GeometryPool::EndFrame() {
+    _command_stream.EndFrame();
+    _matrix_stream.EndFrame();
+}
+
+void GeometryPool::Draw(int id, const glm::mat4 &model) {
+    const PooledMesh &mesh = _meshes[id];
+    // the base instance is where the matrix is among this Submit's
+    DrawElementsIndirectCommand command = { mesh.index_count, 1, mesh.first_index, mesh.base_vertex,
+                                            (unsigned int)_draws.size() };
+    _draws.push_back(command);
+    _matrices.push_back(model);
+}
+
+int GeometryPool::Submit(GLint matrix_location, bool batched) {
+    int calls = 0;
+    if (!_draws.empty() && batched && Batches() && matrix_location != -1) {
+        // the matrices as an attribute that steps once per instance, of
+        // which each command draws one starting at its base instance
+        size_t bytes = sizeof(glm::mat4) * _matrices.size();
+        memcpy(_matrix_stream.Map(bytes), &_matrices[0], bytes);
+        _matrix_stream.Unmap();
+        for (int column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(matrix_location + column);
+            glVertexAttribPointer(matrix_location + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  (const void *)(_matrix_stream.Offset() + sizeof(glm::vec4) * column));
+            glVertexAttribDivisor(matrix_location + column, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        bytes = sizeof(DrawElementsIndirectCommand) * _draws.size();
+        memcpy(_command_stream.Map(bytes, sizeof(GLuint)), &_draws[0], bytes);
+        _command_stream.Unmap();
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)_command_stream.Offset(),
+                                    _draws.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        calls = 1;
+
+        for (int column = 0; column < 4; column++) {
+            glVertexAttribDivisor(matrix_location + column, 0);
+            glDisableVertexAttribArray(matrix_location + column);
+        }
+    } else {
+        for (size_t i = 0; i < _draws.size(); i++) {
+            const DrawElementsIndirectCommand &draw = _draws[i];
+            if (matrix_location != -1) {
+                for (int column = 0; column < 4; column++) {
+                    glVertexAttrib4fv(matrix_location + column, &_matrices[i][column][0]);
+                }
+            }
+            glDrawElementsBaseVertex(GL_TRIANGLES, draw.count, GL_UNSIGNED_INT,
+                                     (void *)(sizeof(unsigned int) * draw.firstIndex), draw.baseVertex);
+            calls++;
+        }
+    }
+    _draws.clear();
+    _matrices.clear();
+    return calls;
+}
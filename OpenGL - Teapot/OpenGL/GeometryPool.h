@@ -0,0 +1,109 @@
+#ifndef _geometry_pool_H
+#define _geometry_pool_H
+
+#include <map>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "TriangleMesh.h"
+#include "StreamBuffer.h"
+#include "meshlets.h"
+
+/** Where a mesh lives in a GeometryPool **/
+struct PooledMesh {
+    unsigned int base_vertex, vertex_count;  // in the vertex buffers
+    unsigned int first_index, index_count;   // in the index buffer
+    glm::vec3 center;                        // and radius of a sphere around it
+    float radius;
+};
+
+/**
+ * Many meshes in one set of buffers, drawn together with few calls
+ *
+ * The positions, normals and uvs of every mesh added share three vertex
+ * buffers and their triangles one index buffer, each mesh in ranges of its
+ * own taken from free lists - the buffers grow when no free range is big
+ * enough, and removing a mesh frees its ranges for the next ones. Its
+ * indices count from its first vertex, so they don't change with where it
+ * lands.
+ *
+ * A frame queues the meshes it shows with Draw, each with its model matrix,
+ * and Submit draws all of them with one ``glMultiDrawElementsIndirect``:
+ * the commands and the matrices go into StreamBuffer rings, and each
+ * command's base instance picks its matrix out of a per-instance attribute.
+ * Without indirect draws, base instances or instanced attributes it falls
+ * back to one ``glDrawElementsBaseVertex`` per mesh with the matrix set as a
+ * constant attribute.
+ */
+class GeometryPool {
+    GLuint _positions, _normals, _uvs, _indices;
+    unsigned int _vertex_capacity, _index_capacity;
+    // the unused ranges, first element to count
+    std::map<unsigned int, unsigned int> _free_vertices, _free_indices;
+    std::vector<PooledMesh> _meshes;
+    std::vector<bool> _used;
+    std::vector<DrawElementsIndirectCommand> _draws;
+    std::vector<glm::mat4> _matrices;
+    StreamBuffer _command_stream, _matrix_stream;
+    bool _supported;
+
+    void Grow(unsigned int vertices, unsigned int indices);
+
+    // owns its buffers, so it can't be copied
+    GeometryPool(const GeometryPool &);
+    GeometryPool &operator=(const GeometryPool &);
+
+    public:
+        GeometryPool();
+        ~GeometryPool();
+
+        /**
+         * Create the buffers; returns false if base vertex draws aren't
+         * supported (OpenGL 3.2), and nothing can be added
+         */
+        bool Init(void);
+        bool Supported() { return _supported; }
+
+        /**
+         * Copy the triangles of |mesh| into the pool - the finest level of
+         * detail once it's optimized (see TriangleMesh::Optimize) - with the
+         * normals last computed for it, or smoothed ones if there are none.
+         * Returns its id for Draw, or -1 if it's empty or the pool isn't
+         * supported
+         */
+        int Add(TriangleMesh &mesh);
+
+        /** Free the ranges of mesh |id|; its id may be given out again **/
+        void Remove(int id);
+
+        const PooledMesh &Mesh(int id) { return _meshes[id]; }
+        int MeshCount() { return _meshes.size(); }
+
+        /**
+         * Point the attributes at |locations| - position, normal and uv, -1
+         * for those not used - at the pool's vertex buffers and bind its
+         * index buffer
+         */
+        void BindAttributes(const GLint locations[3]);
+
+        /** Move the rings on to this frame's regions (see StreamBuffer) **/
+        void BeginFrame();
+        void EndFrame();
+
+        /** Queue mesh |id| to be drawn by the next Submit, placed by |model| **/
+        void Draw(int id, const glm::mat4 &model);
+
+        /**
+         * Draw everything queued since the last Submit, with the model
+         * matrix of each in the ``mat4`` attribute at |matrix_location|: all
+         * in one call if |batched| and supported, else one call each.
+         * Returns the number of draw calls made
+         */
+        int Submit(GLint matrix_location, bool batched = true);
+
+        /** Whether Submit can draw everything in one call **/
+        bool Batches();
+};
+
+#endif
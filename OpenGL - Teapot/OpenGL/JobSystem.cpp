@@ -0,0 +1,124 @@
+#include <chrono>
+#include <algorithm>
+
+#include "JobSystem.h"
+
+JobSystem::JobSystem():
+_quit(false), _head(&_stub), _tail(&_stub), _pending(0)
+{
+    _stub.next.store(NULL);
+}
+
+JobSystem::~JobSystem() {
+    Stop();
+}
+
+void JobSystem::Start(int threads) {
+    Stop();
+    if (threads <= 0) threads = 2;
+    _quit = false;
+    for (int t = 0; t < threads; t++) _workers.push_back(std::thread(&JobSystem::Work, this));
+}
+
+void JobSystem::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _quit = true;
+    }
+    _wake.notify_all();
+    for (size_t t = 0; t < _workers.size(); t++) _workers[t].join();
+    _workers.clear();
+    for (size_t i = 0; i < _queue.size(); i++) delete _queue[i];
+    _queue.clear();
+    while (Job *job = PopDone()) delete job;
+    _pending = 0;
+}
+
+void JobSystem::Work() {
+    while (true) {
+        Job *job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (_queue.empty() && !_quit) _wake.wait(lock);
+            if (_quit) return;
+            job = _queue.front();
+            _queue.pop_front();
+        }
+        job->work();
+        PushDone(job);
+    }
+}
+
+// The done queue is a linked list the workers append to by swapping
+// themselves in as |_head| and then linking the previous head to them; only
+// the GL thread follows the links from |_tail|. Between the swap and the link
+// the list is briefly cut, and PopDone sees an empty queue until it's joined.
+void JobSystem::PushDone(Job *job) {
+    job->next.store(NULL, std::memory_order_relaxed);
+    Job *previous = _head.exchange(job, std::memory_order_acq_rel);
+    previous->next.store(job, std::memory_order_release);
+}
+
+JobSystem::Job *JobSystem::PopDone() {
+    Job *tail = _tail;
+    Job *next = tail->next.load(std::memory_order_acquire);
+    if (tail == &_stub) {
+        if (next == NULL) return NULL;
+        // step over the stub
+        _tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != NULL) {
+        _tail = next;
+        return tail;
+    }
+    // |tail| is the last job, or a worker is appending after it
+    if (tail != _head.load(std::memory_order_acquire)) return NULL;
+    // put the stub back behind it so it can be taken
+    PushDone(&_stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != NULL) {
+        _tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+void JobSystem::Submit(const std::function<void(void)> &work, const std::function<void(void)> &finish) {
+    Job *job = new Job;
+    job->work = work;
+    job->finish = finish;
+    _pending++;
+    if (_workers.empty()) {
+        job->work();
+        PushDone(job);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(job);
+    }
+    _wake.notify_one();
+}
+
+int JobSystem::RunCompletions(double budget_ms) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int count = 0;
+    do {
+        Job *job = PopDone();
+        if (job == NULL) break;
+        _pending--;
+        count++;
+        // |finish| may submit more jobs
+        job->finish();
+        delete job;
+    } while (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < budget_ms);
+    return count;
+}
+
+void JobSystem::Drain() {
+    while (_pending > 0) {
+        if (RunCompletions(1e9) == 0) std::this_thread::yield();
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef _job_system_H
+#define _job_system_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+/**
+ * Runs jobs on worker threads and hands their results back to the GL thread
+ *
+ * A job is two functions: |work|, run on one of the workers - reading and
+ * decoding files, building acceleration structures, nothing that touches
+ * OpenGL - and |finish|, run once |work| has returned by whichever thread
+ * calls RunCompletions, to upload what it made. The workers are few: a job
+ * mostly waits on files and hands its heavy computation to thread_pool(),
+ * whose workers already take every hardware thread, so more of them would
+ * only compete with the pool for the same cores. Workers take jobs from a
+ * queue under a lock; finished jobs come back through a lock-free queue, so
+ * a worker never waits for a frame and a frame never waits for a worker.
+ *
+ * RunCompletions stops once its time budget is spent and leaves the rest to
+ * the next frame, so a burst of finished loads is spread over several
+ * frames instead of stalling one.
+ */
+class JobSystem {
+    struct Job {
+        std::function<void(void)> work, finish;
+        std::atomic<Job *> next;
+    };
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::deque<Job *> _queue;
+    bool _quit;
+    // the finished jobs, pushed by the workers at |_head| and popped by the
+    // GL thread at |_tail|, with |_stub| there whenever it runs empty
+    std::atomic<Job *> _head;
+    Job *_tail;
+    Job _stub;
+    int _pending;
+
+    void Work();
+    void PushDone(Job *job);
+    Job *PopDone();
+
+    public:
+        JobSystem();
+        ~JobSystem();
+
+        /** Start |threads| workers, two if 0 - one can read while the other decodes **/
+        void Start(int threads = 0);
+
+        /**
+         * Stop the workers once the jobs they are running are done; the
+         * jobs still queued and the finished ones not yet run are dropped
+         */
+        void Stop();
+
+        /**
+         * Queue |work| for the workers and |finish| to run after it on the
+         * GL thread. Without workers |work| runs right away on this thread
+         */
+        void Submit(const std::function<void(void)> &work, const std::function<void(void)> &finish);
+
+        /**
+         * Run the |finish| of the jobs that are done, in the order they were
+         * done, until |budget_ms| milliseconds have passed - at least one,
+         * whatever the budget. Returns how many ran
+         */
+        int RunCompletions(double budget_ms);
+
+        /** Wait for every job submitted so far and run all their |finish| **/
+        void Drain();
+
+        /** Jobs submitted whose |finish| hasn't run yet **/
+        int Pending() { return _pending; }
+        int ThreadCount() { return _workers.size(); }
+};
+
+#endif
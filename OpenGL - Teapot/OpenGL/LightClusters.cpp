@@ -0,0 +1,199 @@
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include "LightClusters.h"
+#include "ThreadPool.h"
+
+// the texture buffers, in the order of _buffers and _textures
+static const char *BUFFER_NAMES[3] = { "lightData", "clusterRanges", "lightIndices" };
+static const GLenum BUFFER_FORMATS[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+
+LightClusters::LightClusters():
+_x(0), _y(0), _z(0), _max_lights_per_cluster(0), _near(1.0f), _far(2.0f), _log_ratio(1.0f), _supported(false)
+{
+    for (int k = 0; k < 3; k++) _buffers[k] = _textures[k] = 0;
+}
+
+LightClusters::~LightClusters() {
+    if (_buffers[0] != 0) glDeleteBuffers(3, _buffers);
+    if (_textures[0] != 0) glDeleteTextures(3, _textures);
+}
+
+bool LightClusters::Init(int x, int y, int z, int max_lights_per_cluster) {
+    _supported = GLEW_VERSION_3_1 != 0;
+    if (!_supported) {
+        std::cerr << "Texture buffers aren't supported, no clustered lighting" << std::endl;
+        return false;
+    }
+    _x = x;
+    _y = y;
+    _z = z;
+    _max_lights_per_cluster = max_lights_per_cluster;
+    _lists.resize(x * y * z);
+
+    glGenBuffers(3, _buffers);
+    glGenTextures(3, _textures);
+    for (int k = 0; k < 3; k++) {
+        glBindBuffer(GL_TEXTURE_BUFFER, _buffers[k]);
+        glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, _textures[k]);
+        glTexBuffer(GL_TEXTURE_BUFFER, BUFFER_FORMATS[k], _buffers[k]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    return true;
+}
+
+int LightClusters::Slice(float depth) {
+    if (depth <= _near) return 0;
+    int slice = (int)(log(depth / _near) / _log_ratio * _z);
+    return std::min(slice, _z - 1);
+}
+
+// the tile of |n| tiles at the normalized device coordinate |ndc|
+static int tile(float ndc, int n) {
+    return std::max(0, std::min(n - 1, (int)((ndc * 0.5f + 0.5f) * n)));
+}
+
+void LightClusters::Assign(const std::vector<PointLight> &lights, const glm::mat4 &view, const glm::mat4 &projection,
+                           float z_near, float z_far, int threads) {
+    if (!_supported) return;
+    // slices closer than a hundredth of the range would be too thin to hold
+    // anything
+    _far = std::max(z_far, 1e-3f);
+    _near = std::max(z_near, _far * 0.01f);
+    _log_ratio = log(_far / _near);
+    int light_count = lights.size();
+    _light_data.resize(2 * light_count);
+    _ranges.resize(light_count);
+    // zooming scales the view matrix
+    float scale = glm::length(glm::vec3(view[0]));
+
+    // the lights in view coordinates and the cells they reach
+    parallel_for(light_count, threads, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            glm::vec3 p = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            float r = lights[i].radius * scale;
+            _light_data[2 * i] = glm::vec4(p, r);
+            _light_data[2 * i + 1] = glm::vec4(lights[i].color, 0.0f);
+
+            Range &range = _ranges[i];
+            range.z0 = 1;
+            range.z1 = 0;
+            // (pixels outside the depth range are counted to the first or
+            // last slice, so lights out there are too)
+            float d0 = -p.z - r, d1 = -p.z + r;
+            if (d1 < 0.0f) continue;
+            // the screen rectangle of the box around the light, all of the
+            // screen if part of it is behind the viewer
+            glm::vec2 lo(1.0f), hi(-1.0f);
+            bool behind = false;
+            for (int c = 0; c < 8 && !behind; c++) {
+                glm::vec3 corner = p + glm::vec3(c & 1 ? r : -r, c & 2 ? r : -r, c & 4 ? r : -r);
+                glm::vec4 clip = projection * glm::vec4(corner, 1.0f);
+                if (clip.w <= 0.0f) {
+                    behind = true;
+                } else {
+                    glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+                    lo = c == 0 ? ndc : glm::min(lo, ndc);
+                    hi = c == 0 ? ndc : glm::max(hi, ndc);
+                }
+            }
+            if (behind) {
+                lo = glm::vec2(-1.0f);
+                hi = glm::vec2(1.0f);
+            }
+            if (hi.x < -1.0f || lo.x > 1.0f || hi.y < -1.0f || lo.y > 1.0f) continue;
+            range.x0 = tile(lo.x, _x);
+            range.x1 = tile(hi.x, _x);
+            range.y0 = tile(lo.y, _y);
+            range.y1 = tile(hi.y, _y);
+            range.z0 = Slice(d0);
+            range.z1 = Slice(d1);
+        }
+    });
+
+    // every task fills the cells of its own slices
+    parallel_for(_z, threads, [&](int z_begin, int z_end) {
+        for (int cell = z_begin * _x * _y; cell < z_end * _x * _y; cell++) _lists[cell].clear();
+        for (int i = 0; i < light_count; i++) {
+            const Range &range = _ranges[i];
+            int z0 = std::max(range.z0, z_begin), z1 = std::min(range.z1, z_end - 1);
+            for (int z = z0; z <= z1; z++) {
+                for (int y = range.y0; y <= range.y1; y++) {
+                    for (int x = range.x0; x <= range.x1; x++) {
+                        std::vector<unsigned int> &list = _lists[(z * _y + y) * _x + x];
+                        if ((int)list.size() < _max_lights_per_cluster) list.push_back(i);
+                    }
+                }
+            }
+        }
+    });
+
+    _cluster_ranges.resize(2 * _lists.size());
+    _indices.clear();
+    for (size_t cell = 0; cell < _lists.size(); cell++) {
+        _cluster_ranges[2 * cell] = _indices.size();
+        _cluster_ranges[2 * cell + 1] = _lists[cell].size();
+        _indices.insert(_indices.end(), _lists[cell].begin(), _lists[cell].end());
+    }
+    Upload();
+}
+
+// replace the contents of the texture buffer |buffer| with |size| bytes
+static void upload_buffer(GLuint buffer, const void *data, size_t size) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    // a new store each time, so the draw of the last frame needn't finish
+    glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), NULL, GL_STREAM_DRAW);
+    if (size > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+}
+
+void LightClusters::Upload(void) {
+    upload_buffer(_buffers[0], _light_data.empty() ? NULL : &_light_data[0], sizeof(glm::vec4) * _light_data.size());
+    upload_buffer(_buffers[1], &_cluster_ranges[0], sizeof(unsigned int) * _cluster_ranges.size());
+    upload_buffer(_buffers[2], _indices.empty() ? NULL : &_indices[0], sizeof(unsigned int) * _indices.size());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::Bind(GLuint program, int first_unit) {
+    if (!_supported) return;
+    for (int k = 0; k < 3; k++) {
+        glActiveTexture(GL_TEXTURE0 + first_unit + k);
+        glBindTexture(GL_TEXTURE_BUFFER, _textures[k]);
+        glUniform1i(glGetUniformLocation(program, BUFFER_NAMES[k]), first_unit + k);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glUniform3i(glGetUniformLocation(program, "clusterGrid"), _x, _y, _z);
+    glUniform2f(glGetUniformLocation(program, "clusterDepth"), _near, _log_ratio);
+    glUniform4f(glGetUniformLocation(program, "viewport"), (float)viewport[0], (float)viewport[1],
+                (float)viewport[2], (float)viewport[3]);
+}
+
+void generate_lights(int count, const glm::vec3 &center, float radius, std::vector<PointLight> &lights) {
+    unsigned int seed = 2017;
+    lights.resize(count);
+    // the more lights the shorter their reach, so about eight of them
+    // overlap at any spot; dim them as more overlap
+    float spread = radius * 1.2f;
+    float reach = std::min(radius * 0.35f, spread * (float)pow(8.0f / std::max(count, 1), 1.0f / 3.0f));
+    float overlapping = count * (float)pow(reach / spread, 3.0f);
+    float intensity = std::min(1.0f, 2.0f / std::max(overlapping, 1e-6f));
+    for (int i = 0; i < count; i++) {
+        float v[6];
+        for (int k = 0; k < 6; k++) {
+            seed = seed * 1664525u + 1013904223u;
+            v[k] = (seed >> 8) / 16777216.0f;
+        }
+        // a random direction and distance from the center
+        glm::vec3 direction = glm::vec3(v[0], v[1], v[2]) * 2.0f - glm::vec3(1.0f);
+        float length = glm::length(direction);
+        if (length > 0.0f) direction /= length;
+        lights[i].position = center + direction * spread * (float)pow(v[3], 1.0f / 3.0f);
+        lights[i].radius = reach;
+        glm::vec3 color(v[4], v[5], 1.0f - 0.5f * (v[4] + v[5]));
+        lights[i].color = color / std::max(color.x, std::max(color.y, color.z)) * intensity;
+    }
+}
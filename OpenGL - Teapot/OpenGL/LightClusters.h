@@ -0,0 +1,89 @@
+#ifndef _light_clusters_H
+#define _light_clusters_H
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/** A point light that reaches as far as |radius|, in world coordinates **/
+struct PointLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+};
+
+/**
+ * Assigns point lights to the cells ("froxels") of a grid over the view
+ * frustum for clustered forward shading
+ *
+ * The grid splits the screen into tiles and the view depth into slices that
+ * grow exponentially with the distance. Every frame the lights are assigned
+ * to the cells their bounding boxes overlap, on the shared ThreadPool - one
+ * range of slices a task, so no cell is written by two of them. The result is
+ * uploaded to three texture buffers:
+ * - ``lightData``, two texels per light: position in view coordinates and
+ *   radius, then color
+ * - ``clusterRanges``, per cell the first entry in ``lightIndices`` and how
+ *   many there are
+ * - ``lightIndices``, the lights of every cell one after the other
+ *
+ * A fragment shader then only visits the lights of its own cell, at most
+ * |max_lights_per_cluster| of them, however many lights there are.
+ */
+class LightClusters {
+    // the cells a light overlaps, empty if z0 > z1
+    struct Range {
+        int x0, x1, y0, y1, z0, z1;
+    };
+
+    int _x, _y, _z, _max_lights_per_cluster;
+    float _near, _far, _log_ratio;
+    bool _supported;
+    std::vector<Range> _ranges;
+    std::vector< std::vector<unsigned int> > _lists;
+    std::vector<glm::vec4> _light_data;
+    std::vector<unsigned int> _cluster_ranges, _indices;
+    GLuint _buffers[3], _textures[3];
+
+    int Slice(float depth);
+    void Upload(void);
+
+    public:
+        LightClusters();
+        ~LightClusters();
+
+        /**
+         * Create the texture buffers for a grid of |x| by |y| tiles and |z|
+         * slices. Returns false where texture buffers (OpenGL 3.1) aren't
+         * supported
+         */
+        bool Init(int x = 16, int y = 9, int z = 24, int max_lights_per_cluster = 256);
+
+        /**
+         * Assign |lights| to the cells of the frustum of |view| and
+         * |projection|, slicing the view depths between |z_near| and |z_far|,
+         * on up to |threads| threads - all the hardware has if 0 - and upload
+         * the result
+         */
+        void Assign(const std::vector<PointLight> &lights, const glm::mat4 &view, const glm::mat4 &projection,
+                    float z_near, float z_far, int threads = 0);
+
+        /**
+         * Bind the texture buffers to the texture units from |first_unit| on
+         * and set the uniforms of |program| that locate a fragment's cell
+         */
+        void Bind(GLuint program, int first_unit);
+
+        bool Supported() { return _supported; }
+        int ClusterCount() { return _x * _y * _z; }
+        /** Total light references over all cells after the last Assign **/
+        int IndexCount() { return _indices.size(); }
+};
+
+/**
+ * Fill |lights| with |count| lights of random colors spread through the
+ * sphere |center|, |radius|; the same ones every time for the same count
+ */
+void generate_lights(int count, const glm::vec3 &center, float radius, std::vector<PointLight> &lights);
+
+#endif
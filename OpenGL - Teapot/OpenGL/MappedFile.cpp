@@ -0,0 +1,93 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+
+MappedFile::MappedFile():
+_data(NULL), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(NULL)
+{
+}
+
+bool MappedFile::Open(const char *path) {
+    Close();
+    _file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (_file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+        Close();
+        return false;
+    }
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (_mapping == NULL) {
+        Close();
+        return false;
+    }
+    _data = (const unsigned char *)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (_data == NULL) {
+        Close();
+        return false;
+    }
+    _size = (size_t)size.QuadPart;
+    return true;
+}
+
+void MappedFile::Close(void) {
+    if (_data != NULL) UnmapViewOfFile(_data);
+    if (_mapping != NULL) CloseHandle(_mapping);
+    if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+    _data = NULL;
+    _size = 0;
+    _mapping = NULL;
+    _file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile():
+_data(NULL), _size(0), _file(-1)
+{
+}
+
+bool MappedFile::Open(const char *path) {
+    Close();
+    _file = open(path, O_RDONLY);
+    if (_file == -1) return false;
+    struct stat info;
+    if (fstat(_file, &info) != 0 || info.st_size == 0) {
+        Close();
+        return false;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, _file, 0);
+    if (data == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    // read ahead, the whole file is about to be copied once
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    _data = (const unsigned char *)data;
+    _size = info.st_size;
+    return true;
+}
+
+void MappedFile::Close(void) {
+    if (_data != NULL) munmap((void *)_data, _size);
+    if (_file != -1) close(_file);
+    _data = NULL;
+    _size = 0;
+    _file = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
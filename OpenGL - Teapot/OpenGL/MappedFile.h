@@ -0,0 +1,43 @@
+#ifndef _mapped_file_H
+#define _mapped_file_H
+
+#include <cstddef>
+
+/**
+ * A file mapped read-only into memory
+ *
+ * The pages are read in by the operating system as they are touched, straight
+ * from the file cache, with no buffer of our own and no copy through
+ * ``fread``. The mapping lasts until Close or the destructor.
+ */
+class MappedFile {
+    const unsigned char *_data;
+    size_t _size;
+#ifdef _WIN32
+    void *_file, *_mapping;
+#else
+    int _file;
+#endif
+
+    // owns the mapping, so it can't be copied
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        /**
+         * Map all of |path|, closing what was mapped before
+         * Returns false if it can't be opened or mapped, or is empty
+         */
+        bool Open(const char *path);
+
+        /** Unmap the file **/
+        void Close(void);
+
+        const unsigned char *Data() { return _data; }
+        size_t Size() { return _size; }
+};
+
+#endif
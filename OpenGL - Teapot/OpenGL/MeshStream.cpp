@@ -0,0 +1,85 @@
+#include <utility>
+
+#include "MeshStream.h"
+
+MeshStream::MeshStream() : _chunk_triangles(0), _running(false), _finished(false), _failed(false) {}
+
+MeshStream::~MeshStream() {
+    Stop();
+}
+
+bool MeshStream::Start(const char *filename, int chunk_triangles) {
+    Stop();
+    if (!_reader.Open(filename)) return false;
+    _chunk_triangles = chunk_triangles;
+    _running = true;
+    _finished = false;
+    _failed = false;
+    _thread = std::thread(&MeshStream::Run, this);
+    return true;
+}
+
+void MeshStream::Stop() {
+    if (_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running = false;
+        }
+        _thread.join();
+    }
+    _running = false;
+    _chunks.clear();
+}
+
+void MeshStream::Run() {
+    while (true) {
+        MeshChunk chunk;
+        int triangles = _reader.Read(_chunk_triangles, chunk.vertices, chunk.uvs, chunk.file_normals);
+        if (_reader.HasNormals()) {
+            chunk.normals = chunk.file_normals;
+        } else {
+            chunk.file_normals.clear();
+        }
+        // otherwise flat normals, computed the same way as TriangleMesh::ComputeNormals
+        for (size_t i = chunk.normals.size(); i < chunk.vertices.size(); i += 3) {
+            glm::vec3 v1 = chunk.vertices[i];
+            glm::vec3 v2 = chunk.vertices[i + 1];
+            glm::vec3 v3 = chunk.vertices[i + 2];
+            glm::vec3 face_normal = glm::normalize(glm::cross(v3 - v2, v1 - v2));
+            chunk.normals.push_back(face_normal);
+            chunk.normals.push_back(face_normal);
+            chunk.normals.push_back(face_normal);
+        }
+        chunk.sum = _reader.Sum();
+        chunk.min = _reader.Min();
+        chunk.max = _reader.Max();
+
+        // the last chunk is queued even when empty, its totals are final
+        bool finished = triangles < _chunk_triangles;
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running) return;
+        if (triangles > 0 || finished) _chunks.push_back(std::move(chunk));
+        if (finished) {
+            _finished = true;
+            _failed = _reader.Failed();
+            return;
+        }
+    }
+}
+
+bool MeshStream::Poll(MeshChunk &chunk) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_chunks.empty()) {
+        // nothing left to hand out once the parser is done
+        if (_finished) _running = false;
+        return false;
+    }
+    chunk = std::move(_chunks.front());
+    _chunks.pop_front();
+    return true;
+}
+
+bool MeshStream::Failed() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _failed;
+}
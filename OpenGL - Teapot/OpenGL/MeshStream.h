@@ -0,0 +1,68 @@
+#ifndef _mesh_stream_H
+#define _mesh_stream_H
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ObjReader.h"
+
+/**
+ * A block of triangles parsed by a MeshStream
+ *
+ * |vertices|, |uvs| and |normals| are in triangle order and in file
+ * coordinates. The normals are the ones from the file if it has supplied
+ * them so far, in which case they are also in |file_normals|, and flat
+ * otherwise. |sum|, |min| and |max| describe every
+ * position parsed up to the end of this chunk, so the chunks that have
+ * arrived can be placed with TriangleMesh::NormalizationMatrix. The last
+ * chunk of a stream may hold no triangles.
+ */
+struct MeshChunk {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec3> file_normals;
+    glm::vec3 sum, min, max;
+};
+
+/**
+ * Parses an ``obj`` file on a background thread
+ *
+ * The file is handed out in chunks of a fixed number of triangles, so the
+ * first of them can be drawn while the rest of a large file is still being
+ * read. Chunks are taken off the queue on the GL thread with Poll.
+ */
+class MeshStream {
+    std::thread _thread;
+    std::mutex _mutex;
+    std::deque<MeshChunk> _chunks;
+    ObjReader _reader;
+    int _chunk_triangles;
+    bool _running, _finished, _failed;
+
+    void Run();
+
+    public:
+        MeshStream();
+        ~MeshStream();
+
+        /** Start parsing |filename| in chunks of |chunk_triangles| triangles **/
+        bool Start(const char *filename, int chunk_triangles = 65536);
+
+        /** Stop parsing, the chunks not yet polled are dropped **/
+        void Stop();
+
+        /** Move the oldest parsed chunk into |chunk|, false if none is ready **/
+        bool Poll(MeshChunk &chunk);
+
+        /** Whether the stream was started and has chunks left to poll **/
+        bool Running() { return _running; }
+
+        /** Whether the file couldn't be parsed completely **/
+        bool Failed();
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "ObjReader.h"
+
+// An obj file takes about this many bytes per position: the line of the
+// position, its uv and normal and the two triangles that share each vertex
+static const long bytes_per_position = 128;
+
+ObjReader::ObjReader() : _file(NULL), _file_size(0), _line(256),
+                         _positions(ArenaAllocator<glm::vec3>(_arena)), _uvs(ArenaAllocator<glm::vec2>(_arena)),
+                         _normals(ArenaAllocator<glm::vec3>(_arena)), _min(10000.0f), _max(-10000.0f),
+                         _sum(0.0f), _failed(false), _has_normals(true), _skipped(0) {}
+
+ObjReader::~ObjReader() {
+    if (_file) fclose(_file);
+}
+
+bool ObjReader::Open(const char *filename) {
+    if (_file) fclose(_file);
+    _file = fopen(filename, "r");
+    if (_file == NULL) {
+        std::cerr << "Can't open file " << filename << std::endl;
+        return false;
+    }
+    fseek(_file, 0, SEEK_END);
+    _file_size = ftell(_file);
+    fseek(_file, 0, SEEK_SET);
+
+    // room for the guessed number of elements of each kind in one block,
+    // the arrays grow into more blocks if the guess is short
+    ReleaseScratch();
+    size_t positions = _file_size / bytes_per_position + 16;
+    _arena.Reserve(positions * (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) + 256);
+    _positions.reserve(positions);
+    _uvs.reserve(positions);
+    _normals.reserve(positions);
+    _min = glm::vec3(10000.0f);
+    _max = glm::vec3(-10000.0f);
+    _sum = glm::vec3(0.0f);
+    _failed = false;
+    _has_normals = true;
+    _skipped = 0;
+    return true;
+}
+
+void ObjReader::Close() {
+    if (ferror(_file)) {
+        std::cerr << "Error reading obj file" << std::endl;
+        _failed = true;
+    }
+    if (_skipped > 0) {
+        std::cerr << "Skipped " << _skipped << " faces with missing or invalid indices" << std::endl;
+    }
+    fclose(_file);
+    _file = NULL;
+    ReleaseScratch();
+}
+
+void ObjReader::ReleaseScratch() {
+    // the arrays must let go of their memory before the arena frees it
+    Vec3s(ArenaAllocator<glm::vec3>(_arena)).swap(_positions);
+    Vec2s(ArenaAllocator<glm::vec2>(_arena)).swap(_uvs);
+    Vec3s(ArenaAllocator<glm::vec3>(_arena)).swap(_normals);
+    _arena.Release();
+}
+
+int ObjReader::EstimatedTriangles() {
+    return _file_size / bytes_per_position * 2;
+}
+
+// Reads the next line into _line without its line break, however long it is
+bool ObjReader::ReadLine() {
+    size_t length = 0;
+    while (fgets(&_line[length], _line.size() - length, _file)) {
+        length += strlen(&_line[length]);
+        if (length > 0 && _line[length - 1] == '\n') break;
+        if (length + 1 < _line.size()) break;  // last line without a line break
+        _line.resize(_line.size() * 2);
+    }
+    if (length == 0 && (feof(_file) || ferror(_file))) return false;
+    while (length > 0 && (_line[length - 1] == '\n' || _line[length - 1] == '\r')) length--;
+    _line[length] = '\0';
+    return true;
+}
+
+// Turns an obj index into an index into an array of |count| elements, -1 if
+// it is out of range. Positive indices count from 1, negative ones from the end
+static int resolve_index(long index, size_t count) {
+    long resolved = index > 0 ? index - 1 : (long)count + index;
+    if (index == 0 || resolved < 0 || resolved >= (long)count) return -1;
+    return (int)resolved;
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// Parses the corners of a face and appends its triangles
+int ObjReader::ReadFace(const char *s, std::vector<glm::vec3> &vertices, std::vector<glm::vec2> &uvs,
+                        std::vector<glm::vec3> &normals) {
+    _face_positions.clear();
+    _face_uvs.clear();
+    _face_normals.clear();
+    bool valid = true;
+    while (true) {
+        while (is_space(*s)) s++;
+        if (*s == '\0' || *s == '#') break;
+        // each corner is v, v/vt, v//vn or v/vt/vn
+        char *end;
+        long position = strtol(s, &end, 10), uv = 0, normal = 0;
+        if (end == s) { valid = false; break; }
+        s = end;
+        if (*s == '/') {
+            s++;
+            if (*s != '/') { uv = strtol(s, &end, 10); s = end; }
+            if (*s == '/') { s++; normal = strtol(s, &end, 10); s = end; }
+        }
+        _face_positions.push_back(resolve_index(position, _positions.size()));
+        _face_uvs.push_back(uv ? resolve_index(uv, _uvs.size()) : -1);
+        _face_normals.push_back(normal ? resolve_index(normal, _normals.size()) : -1);
+        if (_face_positions.back() < 0 || (uv && _face_uvs.back() < 0) || (normal && _face_normals.back() < 0)) {
+            valid = false;
+        }
+        while (*s && !is_space(*s)) s++;
+    }
+    if (!valid || _face_positions.size() < 3) {
+        _skipped++;
+        return 0;
+    }
+
+    _face_triangles.clear();
+    if (_face_positions.size() == 3) {
+        for (int i = 0; i < 3; i++) _face_triangles.push_back(i);
+    } else {
+        _polygon.clear();
+        for (size_t i = 0; i < _face_positions.size(); i++) _polygon.push_back(_positions[_face_positions[i]]);
+        triangulate_polygon(_polygon, _face_triangles);
+    }
+
+    for (size_t i = 0; i < _face_triangles.size(); i++) {
+        int corner = _face_triangles[i];
+        vertices.push_back(_positions[_face_positions[corner]]);
+        uvs.push_back(_face_uvs[corner] >= 0 ? _uvs[_face_uvs[corner]] : glm::vec2(0.0f));
+        if (_face_normals[corner] >= 0) {
+            normals.push_back(_normals[_face_normals[corner]]);
+        } else {
+            normals.push_back(glm::vec3(0.0f));
+            _has_normals = false;
+        }
+    }
+    return _face_triangles.size() / 3;
+}
+
+int ObjReader::Read(int max_triangles, std::vector<glm::vec3> &vertices, std::vector<glm::vec2> &uvs,
+                    std::vector<glm::vec3> &normals) {
+    int triangles = 0;
+    while (_file && triangles < max_triangles) {
+        if (!ReadLine()) {
+            Close();
+            break;
+        }
+        const char *s = &_line[0];
+        while (is_space(*s)) s++;
+        char *end;
+        if (s[0] == 'v' && is_space(s[1])) {
+            glm::vec3 vertex;
+            vertex.x = strtof(s + 2, &end);
+            vertex.y = strtof(end, &end);
+            vertex.z = strtof(end, &end);
+            _positions.push_back(vertex);
+            _sum += vertex;
+            _min = glm::min(_min, vertex);
+            _max = glm::max(_max, vertex);
+        }
+        else if (s[0] == 'v' && s[1] == 't' && is_space(s[2])) {
+            glm::vec2 uv;
+            uv.x = strtof(s + 3, &end);
+            uv.y = strtof(end, &end);
+            _uvs.push_back(uv);
+        }
+        else if (s[0] == 'v' && s[1] == 'n' && is_space(s[2])) {
+            glm::vec3 normal;
+            normal.x = strtof(s + 3, &end);
+            normal.y = strtof(end, &end);
+            normal.z = strtof(end, &end);
+            _normals.push_back(normal);
+        }
+        else if (s[0] == 'f' && is_space(s[1])) {
+            triangles += ReadFace(s + 2, vertices, uvs, normals);
+        }
+    }
+    return triangles;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                               Triangulation                               //
+///////////////////////////////////////////////////////////////////////////////
+
+static float cross2(const glm::vec2 &a, const glm::vec2 &b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+// whether |p| lies inside or on the counter clockwise triangle |a| |b| |c|
+static bool in_triangle(const glm::vec2 &p, const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &c) {
+    return cross2(b - a, p - a) >= 0 && cross2(c - b, p - b) >= 0 && cross2(a - c, p - c) >= 0;
+}
+
+void triangulate_polygon(const std::vector<glm::vec3> &polygon, std::vector<int> &triangles) {
+    int n = polygon.size();
+    // Newell's method gives the plane of the polygon even when it is concave
+    glm::vec3 normal(0.0f);
+    for (int i = 0; i < n; i++) {
+        const glm::vec3 &a = polygon[i];
+        const glm::vec3 &b = polygon[(i + 1) % n];
+        normal.x += (a.y - b.y) * (a.z + b.z);
+        normal.y += (a.z - b.z) * (a.x + b.x);
+        normal.z += (a.x - b.x) * (a.y + b.y);
+    }
+    // project onto the plane of the two other axes, flipped so that the
+    // polygon is counter clockwise
+    int axis = fabs(normal.x) > fabs(normal.y) ? (fabs(normal.x) > fabs(normal.z) ? 0 : 2)
+                                               : (fabs(normal.y) > fabs(normal.z) ? 1 : 2);
+    int u = (axis + 1) % 3, v = (axis + 2) % 3;
+    float flip = normal[axis] < 0 ? -1.0f : 1.0f;
+    std::vector<glm::vec2> points(n);
+    for (int i = 0; i < n; i++) points[i] = glm::vec2(polygon[i][u], polygon[i][v] * flip);
+
+    std::vector<int> remaining;
+    for (int i = 0; i < n; i++) remaining.push_back(i);
+    while (remaining.size() > 3) {
+        int m = remaining.size();
+        bool clipped = false;
+        for (int i = 0; i < m && !clipped; i++) {
+            int a = remaining[(i + m - 1) % m], b = remaining[i], c = remaining[(i + 1) % m];
+            // an ear is convex and has no other corner inside it
+            if (cross2(points[b] - points[a], points[c] - points[b]) <= 0) continue;
+            bool ear = true;
+            for (int j = 0; j < m && ear; j++) {
+                int k = remaining[j];
+                if (k != a && k != b && k != c && in_triangle(points[k], points[a], points[b], points[c])) ear = false;
+            }
+            if (!ear) continue;
+            triangles.push_back(a);
+            triangles.push_back(b);
+            triangles.push_back(c);
+            remaining.erase(remaining.begin() + i);
+            clipped = true;
+        }
+        if (!clipped) break;
+    }
+    // what is left is a triangle, or a polygon without ears that is fanned
+    for (size_t i = 1; i + 1 < remaining.size(); i++) {
+        triangles.push_back(remaining[0]);
+        triangles.push_back(remaining[i]);
+        triangles.push_back(remaining[i + 1]);
+    }
+}
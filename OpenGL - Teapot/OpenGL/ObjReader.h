@@ -0,0 +1,99 @@
+#ifndef _obj_reader_H
+#define _obj_reader_H
+
+#include <cstdio>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Arena.h"
+
+/**
+ * Incremental reader for ``obj`` files
+ *
+ * Faces are returned in triangle order: every three entries of the output
+ * arrays form one triangle, ready for ``glDrawArrays``. The file can be read
+ * in one go or a bounded number of triangles at a time, which lets a loader
+ * hand out parts of a large file before the rest has been parsed.
+ *
+ * All face forms are accepted: ``v``, ``v/vt``, ``v//vn`` and ``v/vt/vn``,
+ * with indices counted from the start of the file or, when negative, back
+ * from the last element read. Polygons are triangulated by ear clipping in
+ * their own plane. Faces with indices out of range are skipped.
+ *
+ * The positions, uvs and normals faces refer to are kept in an Arena sized
+ * from the length of the file, and released in one go once the file is done.
+ */
+class ObjReader {
+    typedef std::vector< glm::vec3, ArenaAllocator<glm::vec3> > Vec3s;
+    typedef std::vector< glm::vec2, ArenaAllocator<glm::vec2> > Vec2s;
+
+    FILE *_file;
+    long _file_size;
+    std::vector<char> _line;
+    // declared first, so it outlives the arrays it holds
+    Arena _arena;
+    Vec3s _positions;
+    Vec2s _uvs;
+    Vec3s _normals;
+    glm::vec3 _min, _max, _sum;
+    bool _failed, _has_normals;
+    int _skipped;
+
+    // scratch space for the face being triangulated
+    std::vector<int> _face_positions, _face_uvs, _face_normals, _face_triangles;
+    std::vector<glm::vec3> _polygon;
+
+    // owns the file and the arena, so it can't be copied
+    ObjReader(const ObjReader &);
+    ObjReader &operator=(const ObjReader &);
+
+    bool ReadLine();
+    int ReadFace(const char *line, std::vector<glm::vec3> &vertices, std::vector<glm::vec2> &uvs,
+                 std::vector<glm::vec3> &normals);
+    void Close();
+    void ReleaseScratch();
+
+    public:
+        ObjReader();
+        ~ObjReader();
+
+        /** Open |filename| for reading, returns false if it can't be opened **/
+        bool Open(const char *filename);
+
+        /**
+         * Append about |max_triangles| triangles to |vertices|, |uvs| and
+         * |normals| - a polygon is never split, so a few more may be returned
+         * Vertices without a uv get (0, 0), those without a normal get a zero
+         * normal (see HasNormals)
+         * Returns the number of triangles appended, 0 once the file is done
+         */
+        int Read(int max_triangles, std::vector<glm::vec3> &vertices, std::vector<glm::vec2> &uvs,
+                 std::vector<glm::vec3> &normals);
+
+        /**
+         * About how many triangles the file holds, guessed from its length,
+         * for reserving room for them
+         */
+        int EstimatedTriangles();
+
+        /** Whether reading stopped because of an error in the file **/
+        bool Failed() { return _failed; }
+
+        /** Whether every vertex read so far came with a normal from the file **/
+        bool HasNormals() { return _has_normals; }
+
+        /** Bounds and sum of all positions read so far **/
+        glm::vec3 Min() { return _min; }
+        glm::vec3 Max() { return _max; }
+        glm::vec3 Sum() { return _sum; }
+};
+
+/**
+ * Triangulate the simple polygon |polygon| by ear clipping
+ * Appends triples of indices into |polygon| to |triangles|, wound like the
+ * polygon. Falls back to a fan when no ear can be found (e.g. for
+ * degenerate or self-intersecting polygons)
+ */
+void triangulate_polygon(const std::vector<glm::vec3> &polygon, std::vector<int> &triangles);
+
+#endif
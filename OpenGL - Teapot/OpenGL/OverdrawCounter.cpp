@@ -0,0 +1,83 @@
+#include <cstdio>
+
+#include "OverdrawCounter.h"
+
+OverdrawCounter::OverdrawCounter():
+_frame(0), _shaded(0), _covered(0)
+{
+    for (int i = 0; i < 2; i++) {
+        _queries[i][0] = _queries[i][1] = 0;
+        _issued[i] = false;
+    }
+}
+
+OverdrawCounter::~OverdrawCounter() {
+    if (_queries[0][0] != 0) glDeleteQueries(4, &_queries[0][0]);
+}
+
+void OverdrawCounter::Init(void) {
+    if (_queries[0][0] == 0) glGenQueries(4, &_queries[0][0]);
+}
+
+void OverdrawCounter::BeginShading(void) {
+    if (_queries[0][0] == 0) return;
+    // collect what this frame's queries counted two frames ago before
+    // they are reused
+    int slot = _frame % 2;
+    if (_issued[slot]) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(_queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            glGetQueryObjectuiv(_queries[slot][0], GL_QUERY_RESULT, &_shaded);
+            glGetQueryObjectuiv(_queries[slot][1], GL_QUERY_RESULT, &_covered);
+        }
+        _issued[slot] = false;
+    }
+    glBeginQuery(GL_SAMPLES_PASSED, _queries[slot][0]);
+}
+
+void OverdrawCounter::EndShading(void) {
+    if (_queries[0][0] == 0) return;
+    glEndQuery(GL_SAMPLES_PASSED);
+}
+
+void OverdrawCounter::CountCovered(void) {
+    if (_queries[0][0] == 0) return;
+    int slot = _frame % 2;
+    glUseProgram(0);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    // the cleared depth is the far plane itself, which doesn't pass
+    glDepthFunc(GL_GREATER);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glBeginQuery(GL_SAMPLES_PASSED, _queries[slot][1]);
+    glBegin(GL_TRIANGLE_STRIP);
+    glVertex3f(-1.0f, -1.0f, 1.0f);
+    glVertex3f( 1.0f, -1.0f, 1.0f);
+    glVertex3f(-1.0f,  1.0f, 1.0f);
+    glVertex3f( 1.0f,  1.0f, 1.0f);
+    glEnd();
+    glEndQuery(GL_SAMPLES_PASSED);
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    _issued[slot] = true;
+    _frame++;
+}
+
+std::string OverdrawCounter::Summary(void) {
+    char line[128];
+    sprintf(line, "overdraw %.2fx (%u fragments shaded, %u pixels covered)", Overdraw(), _shaded, _covered);
+    return line;
+}
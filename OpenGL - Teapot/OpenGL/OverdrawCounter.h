@@ -0,0 +1,51 @@
+#ifndef _overdraw_counter_H
+#define _overdraw_counter_H
+
+#include <string>
+#include <GL/glew.h>
+
+/**
+ * Measures the overdraw of a frame: how many fragments were shaded for every
+ * pixel the scene covers
+ *
+ * Both numbers come from ``GL_SAMPLES_PASSED`` queries - the fragments that
+ * pass the depth test while shading, and the pixels left with a depth nearer
+ * than the far plane afterwards. As with Profiler, the queries of alternate
+ * frames are kept apart and read back two frames later, so counting never
+ * stalls the pipeline; results not available by then are dropped.
+ */
+class OverdrawCounter {
+    // [frame parity][shaded, covered]
+    GLuint _queries[2][2];
+    bool _issued[2];
+    int _frame;
+    GLuint _shaded, _covered;
+
+    public:
+        OverdrawCounter();
+        ~OverdrawCounter();
+
+        /** Create the queries **/
+        void Init(void);
+
+        /** Count the fragments drawn until EndShading **/
+        void BeginShading(void);
+        void EndShading(void);
+
+        /**
+         * Count the pixels the frame covers with a screen quad on the far
+         * plane that passes the depth test wherever something was drawn -
+         * color and depth are left as they are. Ends the frame
+         */
+        void CountCovered(void);
+
+        /** Fragments shaded per covered pixel, as of two frames ago **/
+        double Overdraw(void) { return _covered > 0 ? (double)_shaded / _covered : 0.0; }
+        GLuint Shaded(void) { return _shaded; }
+        GLuint Covered(void) { return _covered; }
+
+        /** One line with the overdraw and both counts, for the overlay **/
+        std::string Summary(void);
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include <cstdio>
+#include <sstream>
+#include <algorithm>
+#include <GL/glew.h>
+#include <GL/glut.h>
+
+#include "Profiler.h"
+
+static double elapsed_ms(std::chrono::steady_clock::time_point from,
+                         std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+void Profiler::Series::Add(double value, size_t capacity) {
+    if (samples.size() < capacity) {
+        samples.push_back(value);
+    } else {
+        samples[next] = value;
+    }
+    next = (next + 1) % capacity;
+}
+
+double Profiler::Series::Percentile(double p) const {
+    if (samples.empty()) return 0.0;
+    std::vector<double> sorted(samples);
+    size_t k = (size_t)(p * (sorted.size() - 1) + 0.5);
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k];
+}
+
+double Profiler::Series::Last(size_t capacity) const {
+    if (samples.empty()) return 0.0;
+    return samples[(next + capacity - 1) % capacity];
+}
+
+Profiler::Profiler(size_t capacity):
+_capacity(capacity), _frame(0), _gpu_timers(false), _in_frame(false)
+{
+}
+
+Profiler::~Profiler() {
+    for (std::map<std::string, Section>::iterator it = _sections.begin(); it != _sections.end(); ++it) {
+        if (it->second.query[0] != 0) glDeleteQueries(2, it->second.query);
+    }
+}
+
+Profiler::Section &Profiler::Lookup(const char *name) {
+    std::map<std::string, Section>::iterator it = _sections.find(name);
+    if (it != _sections.end()) return it->second;
+    _order.push_back(name);
+    Section &section = _sections[name];
+    if (_gpu_timers) glGenQueries(2, section.query);
+    return section;
+}
+
+void Profiler::BeginFrame(void) {
+    if (_frame == 0) _gpu_timers = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+    _last_frame_start = _frame_start;
+    _frame_start = Clock::now();
+    if (_frame > 0) _frame_interval.Add(elapsed_ms(_last_frame_start, _frame_start), _capacity);
+    _in_frame = true;
+
+    // the queries about to be reused were issued two frames ago
+    int set = _frame % 2;
+    for (std::map<std::string, Section>::iterator it = _sections.begin(); it != _sections.end(); ++it) {
+        Section &section = it->second;
+        if (!section.issued[set]) continue;
+        GLint available = 0;
+        glGetQueryObjectiv(section.query[set], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(section.query[set], GL_QUERY_RESULT, &ns);
+            section.gpu.Add(ns / 1.0e6, _capacity);
+        }
+        section.issued[set] = false;
+    }
+}
+
+void Profiler::EndFrame(void) {
+    if (!_in_frame) return;
+    while (!_open.empty()) End();
+    _frame_cpu.Add(elapsed_ms(_frame_start, Clock::now()), _capacity);
+    _in_frame = false;
+    _frame++;
+}
+
+void Profiler::Begin(const char *name) {
+    Section &section = Lookup(name);
+    // GL_TIME_ELAPSED queries can't nest - only time the outermost level
+    section.timed_on_gpu = _gpu_timers && _in_frame && _open.empty();
+    if (section.timed_on_gpu) {
+        int set = _frame % 2;
+        glBeginQuery(GL_TIME_ELAPSED, section.query[set]);
+        section.issued[set] = true;
+    }
+    _open.push_back(&section);
+    section.start = Clock::now();
+}
+
+void Profiler::End(void) {
+    if (_open.empty()) return;
+    Section &section = *_open.back();
+    _open.pop_back();
+    section.cpu.Add(elapsed_ms(section.start, Clock::now()), _capacity);
+    if (section.timed_on_gpu) glEndQuery(GL_TIME_ELAPSED);
+}
+
+std::string Profiler::Summary(void) {
+    char line[256];
+    sprintf(line, "frame %.2f ms (p50 %.2f  p95 %.2f  p99 %.2f)",
+            _frame_cpu.Last(_capacity),
+            _frame_cpu.Percentile(0.50),
+            _frame_cpu.Percentile(0.95),
+            _frame_cpu.Percentile(0.99));
+    return line;
+}
+
+std::string Profiler::Report(void) {
+    std::ostringstream out;
+    char line[256];
+    out << Summary() << "\n";
+    for (size_t i = 0; i < _order.size(); i++) {
+        Section &section = _sections[_order[i]];
+        sprintf(line, "%-12s cpu %6.3f/%6.3f/%6.3f", _order[i].c_str(),
+                section.cpu.Percentile(0.50),
+                section.cpu.Percentile(0.95),
+                section.cpu.Percentile(0.99));
+        out << line;
+        if (!section.gpu.samples.empty()) {
+            sprintf(line, "  gpu %6.3f/%6.3f/%6.3f",
+                    section.gpu.Percentile(0.50),
+                    section.gpu.Percentile(0.95),
+                    section.gpu.Percentile(0.99));
+            out << line;
+        }
+        out << "\n";
+    }
+    return out.str();
+}
+
+void Profiler::DrawOverlay(const std::string &extra) {
+    std::string text = Report() + extra;
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glUseProgram(0);
+    glDisable(GL_DEPTH_TEST);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    int x = 8, y = viewport[3] - 16;
+    glWindowPos2i(x, y);
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '\n') {
+            y -= 14;
+            glWindowPos2i(x, y);
+        } else {
+            glutBitmapCharacter(GLUT_BITMAP_8_BY_13, text[i]);
+        }
+    }
+    glEnable(GL_DEPTH_TEST);
+}
+
+bool Profiler::WriteCSV(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) return false;
+    fprintf(file, "section,clock,samples,p50_ms,p95_ms,p99_ms\n");
+    fprintf(file, "frame,cpu,%d,%f,%f,%f\n", (int)_frame_cpu.samples.size(),
+            _frame_cpu.Percentile(0.50), _frame_cpu.Percentile(0.95), _frame_cpu.Percentile(0.99));
+    fprintf(file, "frame_interval,cpu,%d,%f,%f,%f\n", (int)_frame_interval.samples.size(),
+            _frame_interval.Percentile(0.50), _frame_interval.Percentile(0.95), _frame_interval.Percentile(0.99));
+    for (size_t i = 0; i < _order.size(); i++) {
+        Section &section = _sections[_order[i]];
+        const Series *series[2] = { &section.cpu, &section.gpu };
+        const char *clock[2] = { "cpu", "gpu" };
+        for (int j = 0; j < 2; j++) {
+            if (series[j]->samples.empty()) continue;
+            fprintf(file, "%s,%s,%d,%f,%f,%f\n", _order[i].c_str(), clock[j],
+                    (int)series[j]->samples.size(), series[j]->Percentile(0.50),
+                    series[j]->Percentile(0.95), series[j]->Percentile(0.99));
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+bool Profiler::WriteJSON(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) return false;
+    fprintf(file, "{\n  \"frames\": %d,\n", _frame);
+    fprintf(file, "  \"frame\": {\"samples\": %d, \"p50_ms\": %f, \"p95_ms\": %f, \"p99_ms\": %f},\n",
+            (int)_frame_cpu.samples.size(), _frame_cpu.Percentile(0.50),
+            _frame_cpu.Percentile(0.95), _frame_cpu.Percentile(0.99));
+    fprintf(file, "  \"frame_interval\": {\"samples\": %d, \"p50_ms\": %f, \"p95_ms\": %f, \"p99_ms\": %f},\n",
+            (int)_frame_interval.samples.size(), _frame_interval.Percentile(0.50),
+            _frame_interval.Percentile(0.95), _frame_interval.Percentile(0.99));
+    fprintf(file, "  \"sections\": [");
+    for (size_t i = 0; i < _order.size(); i++) {
+        Section &section = _sections[_order[i]];
+        fprintf(file, "%s\n    {\"name\": \"%s\"", i == 0 ? "" : ",", _order[i].c_str());
+        const Series *series[2] = { &section.cpu, &section.gpu };
+        const char *clock[2] = { "cpu", "gpu" };
+        for (int j = 0; j < 2; j++) {
+            if (series[j]->samples.empty()) continue;
+            fprintf(file, ", \"%s\": {\"samples\": %d, \"p50_ms\": %f, \"p95_ms\": %f, \"p99_ms\": %f}",
+                    clock[j], (int)series[j]->samples.size(), series[j]->Percentile(0.50),
+                    series[j]->Percentile(0.95), series[j]->Percentile(0.99));
+        }
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    fclose(file);
+    return true;
+}
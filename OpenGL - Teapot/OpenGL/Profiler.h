@@ -0,0 +1,108 @@
+#ifndef _profiler_H
+#define _profiler_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <GL/glew.h>
+
+/**
+ * Collects CPU and GPU timings for named sections of a frame
+ *
+ * CPU time is measured with a steady clock. GPU time is measured with
+ * ``GL_TIME_ELAPSED`` queries; every section owns two queries that are used on
+ * alternate frames, so a result is only read back two frames after it was
+ * issued and reading it never stalls the pipeline. Results that are still not
+ * available by then are dropped instead of waited for.
+ *
+ * Timer queries cannot be nested, so only sections opened at the outermost
+ * level are timed on the GPU. Inner sections are timed on the CPU only.
+ */
+class Profiler {
+    typedef std::chrono::steady_clock Clock;
+
+    // the last |capacity| samples of one measurement, in milliseconds
+    struct Series {
+        std::vector<double> samples;
+        size_t next;
+        Series(): next(0) {}
+        void Add(double value, size_t capacity);
+        double Percentile(double p) const;
+        double Last(size_t capacity) const;
+    };
+    struct Section {
+        Series cpu, gpu;
+        GLuint query[2];
+        bool issued[2];
+        Clock::time_point start;
+        bool timed_on_gpu;
+        Section(): timed_on_gpu(false) { query[0] = query[1] = 0; issued[0] = issued[1] = false; }
+    };
+
+    std::map<std::string, Section> _sections;
+    std::vector<std::string> _order;
+    std::vector<Section*> _open;
+    Series _frame_cpu, _frame_interval;
+    Clock::time_point _frame_start, _last_frame_start;
+    size_t _capacity;
+    int _frame;
+    bool _gpu_timers, _in_frame;
+
+    Section &Lookup(const char *name);
+
+    public:
+        Profiler(size_t capacity = 600);
+        ~Profiler();
+
+        /** Start a frame - collects the GPU results of two frames ago **/
+        void BeginFrame(void);
+
+        /** Finish the frame started by the last BeginFrame **/
+        void EndFrame(void);
+
+        /** Open the section |name|, sections may nest **/
+        void Begin(const char *name);
+
+        /** Close the most recently opened section **/
+        void End(void);
+
+        /** Number of frames profiled so far **/
+        int FrameCount(void) { return _frame; }
+
+        /** One line summary of the frame time percentiles, for window titles **/
+        std::string Summary(void);
+
+        /** Multi line report with p50/p95/p99 for every section **/
+        std::string Report(void);
+
+        /**
+         * Draw Report() on top of the frame with bitmap fonts, followed by the
+         * lines of |extra|
+         * Needs the fixed function raster position - compatibility profile only
+         */
+        void DrawOverlay(const std::string &extra = std::string());
+
+        /** Write one row per section and measurement with its percentiles **/
+        bool WriteCSV(const char *path);
+
+        /** Write the same statistics as WriteCSV as a JSON document **/
+        bool WriteJSON(const char *path);
+};
+
+/**
+ * Times the enclosing block as a section of |profiler|
+ */
+class ProfileScope {
+    Profiler &_profiler;
+
+    public:
+        ProfileScope(Profiler &profiler, const char *name): _profiler(profiler) { _profiler.Begin(name); }
+        ~ProfileScope() { _profiler.End(); }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(profiler, name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(profiler, name)
+
+#endif
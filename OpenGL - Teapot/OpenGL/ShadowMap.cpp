@@ -0,0 +1,115 @@
+#include <cmath>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "ShadowMap.h"
+
+ShadowMap::ShadowMap():
+_framebuffer(0), _texture(0), _size(0), _supported(false), _dirty(true)
+{
+}
+
+ShadowMap::~ShadowMap() {
+    if (_framebuffer != 0) glDeleteFramebuffers(1, &_framebuffer);
+    if (_texture != 0) glDeleteTextures(1, &_texture);
+}
+
+bool ShadowMap::Init(int size) {
+    _supported = GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+    if (!_supported) {
+        std::cerr << "Framebuffer objects aren't supported, shadows are off" << std::endl;
+        return false;
+    }
+    _size = size;
+    _dirty = true;
+
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_2D, _texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // everything outside the map is lit
+    const float border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Shadow map framebuffer incomplete (" << status << "), shadows are off" << std::endl;
+        glDeleteFramebuffers(1, &_framebuffer);
+        glDeleteTextures(1, &_texture);
+        _framebuffer = _texture = 0;
+        _supported = false;
+    }
+    return _supported;
+}
+
+static bool same_matrix(const glm::mat4 &a, const glm::mat4 &b) {
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (a[i][j] != b[i][j]) return false;
+        }
+    }
+    return true;
+}
+
+bool ShadowMap::Update(const glm::vec3 &light_position, const glm::vec3 &center, float radius,
+                       const glm::mat4 &modelview) {
+    if (!_supported) return false;
+    glm::vec3 to_center = center - light_position;
+    float distance = glm::length(to_center);
+    // a light inside the sphere can't see all of the mesh through one
+    // frustum; there are no shadows until it moves out
+    if (distance <= radius * 1.01f) {
+        _dirty = true;
+        return false;
+    }
+
+    glm::vec3 up = fabs(to_center.y) > 0.99f * distance ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 view = glm::lookAt(light_position, center, up);
+    // the frustum touching the sphere on all four sides
+    float z_near = distance - radius, z_far = distance + radius;
+    float extent = z_near * radius / sqrt(distance * distance - radius * radius);
+    glm::mat4 projection = glm::frustum(-extent, extent, -extent, extent, z_near, z_far);
+
+    glm::mat4 drawn = projection * view * modelview;
+    if (!_dirty && same_matrix(drawn, _drawn)) return false;
+    _projection = projection;
+    _view = view;
+    _drawn = drawn;
+    _dirty = false;
+    return true;
+}
+
+void ShadowMap::Begin(void) {
+    glGetIntegerv(GL_VIEWPORT, _viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glViewport(0, 0, _size, _size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    // push the depths back a little so lit surfaces don't shadow themselves
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+}
+
+void ShadowMap::End(void) {
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(_viewport[0], _viewport[1], _viewport[2], _viewport[3]);
+}
+
+glm::mat4 ShadowMap::ShadowMatrix() {
+    // from clip coordinates in [-1, 1] to texture coordinates in [0, 1]
+    glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f));
+    bias = glm::scale(bias, glm::vec3(0.5f));
+    return bias * _projection * _view;
+}
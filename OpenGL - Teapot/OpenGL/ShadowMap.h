@@ -0,0 +1,69 @@
+#ifndef _shadow_map_H
+#define _shadow_map_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/**
+ * A depth texture of the scene as seen from a point light, for shadows
+ *
+ * The light looks at the bounding sphere of the mesh through a frustum that
+ * just contains it. The map is only redrawn when it has been invalidated or
+ * the mesh moved relative to the light, so a static scene draws it once.
+ * The texture compares depths itself (``GL_TEXTURE_COMPARE_MODE``) with
+ * linear filtering, so every lookup from a ``sampler2DShadow`` is already a
+ * 2x2 percentage closer filter.
+ */
+class ShadowMap {
+    GLuint _framebuffer, _texture;
+    int _size;
+    bool _supported, _dirty;
+    glm::mat4 _projection, _view;
+    glm::mat4 _drawn;   // light space transform of the mesh when last drawn
+    GLint _viewport[4];
+
+    public:
+        ShadowMap();
+        ~ShadowMap();
+
+        /**
+         * Create a |size| x |size| depth texture and its framebuffer
+         * Returns false, and leaves shadows off, where framebuffer objects
+         * aren't supported
+         */
+        bool Init(int size = 2048);
+
+        /** Redraw the map the next time Update is called, e.g. when the mesh changed **/
+        void Invalidate() { _dirty = true; }
+
+        /**
+         * Aim the light at |light_position| on the bounding sphere |center|,
+         * |radius| - all in view coordinates - for a mesh drawn with
+         * |modelview|
+         * Returns true if the map has to be redrawn, which the caller does
+         * between Begin and End
+         */
+        bool Update(const glm::vec3 &light_position, const glm::vec3 &center, float radius,
+                    const glm::mat4 &modelview);
+
+        /** Render into the map: binds its framebuffer and clears it **/
+        void Begin(void);
+
+        /** Go back to drawing into the window **/
+        void End(void);
+
+        /** Whether there is a map to sample from **/
+        bool Ready() { return _supported && !_dirty; }
+
+        /** The light's projection and view (from view coordinates) matrices **/
+        glm::mat4 Projection() { return _projection; }
+        glm::mat4 View() { return _view; }
+
+        /** Maps view coordinates to texture coordinates and depth in the map **/
+        glm::mat4 ShadowMatrix();
+
+        GLuint Texture() { return _texture; }
+        int Size() { return _size; }
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef _span_H
+#define _span_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * A view of |Size()| elements stored one after the other somewhere else -
+ * a vector, a mapped buffer - that lets them be passed around without
+ * copying them. The storage must outlive the view and not be reallocated
+ * while it is used
+ */
+template <typename T>
+class Span {
+    T *_data;
+    size_t _size;
+
+    public:
+        Span(): _data(NULL), _size(0) {}
+        Span(T *data, size_t size): _data(data), _size(size) {}
+        template <typename U, typename Allocator>
+        Span(std::vector<U, Allocator> &vector): _data(vector.data()), _size(vector.size()) {}
+        template <typename U, typename Allocator>
+        Span(const std::vector<U, Allocator> &vector): _data(vector.data()), _size(vector.size()) {}
+        /** A view of another view, e.g. of const elements **/
+        template <typename U>
+        Span(const Span<U> &other): _data(other.Data()), _size(other.Size()) {}
+
+        T *Data() const { return _data; }
+        size_t Size() const { return _size; }
+        bool Empty() const { return _size == 0; }
+        T &operator[](size_t i) const { return _data[i]; }
+        T *begin() const { return _data; }
+        T *end() const { return _data + _size; }
+};
+
+#endif
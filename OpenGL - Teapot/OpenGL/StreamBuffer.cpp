@@ -0,0 +1,121 @@
+#include <cstring>
+#include <algorithm>
+
+#include "StreamBuffer.h"
+
+StreamBuffer::StreamBuffer():
+_target(GL_ARRAY_BUFFER), _buffer(0), _region_size(0), _used(0), _offset(0), _region(0),
+_persistent(NULL), _mapped(false), _use_fences(false), _waits(0)
+{
+}
+
+StreamBuffer::~StreamBuffer() {
+    if (_buffer != 0) Free();
+}
+
+void StreamBuffer::Init(GLenum target, size_t region_size, int regions) {
+    Release();
+    _target = target;
+    _use_fences = GLEW_ARB_sync != 0;
+    _fences.assign(std::max(regions, 1), (GLsync)0);
+    _waits = 0;
+    Allocate(region_size);
+}
+
+void StreamBuffer::Release() {
+    if (_buffer != 0) Free();
+    _fences.clear();
+}
+
+void StreamBuffer::Free() {
+    for (size_t i = 0; i < _fences.size(); i++) {
+        if (_fences[i] != 0) glDeleteSync(_fences[i]);
+        _fences[i] = 0;
+    }
+    // a buffer deleted while draws still read it lives on until they are
+    // done, and stops being mapped
+    glDeleteBuffers(1, &_buffer);
+    _buffer = 0;
+    _persistent = NULL;
+    _mapped = false;
+}
+
+void StreamBuffer::Allocate(size_t region_size) {
+    if (_buffer != 0) Free();
+    _region_size = std::max(region_size, (size_t)256);
+    _region = 0;
+    _used = 0;
+    size_t size = _region_size * _fences.size();
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(_target, _buffer);
+    // written while the GPU may read other regions, which takes fences
+    if (_use_fences && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(_target, size, NULL, flags);
+        _persistent = (unsigned char *)glMapBufferRange(_target, 0, size, flags);
+    } else {
+        glBufferData(_target, size, NULL, GL_STREAM_DRAW);
+    }
+}
+
+void StreamBuffer::BeginFrame() {
+    if (_buffer == 0) return;
+    _region = (_region + 1) % _fences.size();
+    _used = 0;
+    GLsync &fence = _fences[_region];
+    if (fence != 0) {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            _waits++;
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    } else if (!_use_fences && _region == 0 && _persistent == NULL) {
+        // nothing tells when the GPU is done with the buffer, so each time
+        // round the ring it gets new storage and the old goes to the driver
+        glBindBuffer(_target, _buffer);
+        glBufferData(_target, _region_size * _fences.size(), NULL, GL_STREAM_DRAW);
+    }
+}
+
+void *StreamBuffer::Map(size_t bytes, size_t alignment) {
+    size_t start = (_used + alignment - 1) / alignment * alignment;
+    if (start + bytes > _region_size) {
+        // a new buffer, regions big enough for twice as much
+        Allocate(std::max(2 * _region_size, bytes + alignment));
+        start = 0;
+    }
+    _used = start + bytes;
+    _offset = _region * _region_size + start;
+    glBindBuffer(_target, _buffer);
+    if (_persistent != NULL) return _persistent + _offset;
+    _mapped = false;
+    if (GLEW_VERSION_3_0 || GLEW_ARB_map_buffer_range) {
+        void *memory = glMapBufferRange(_target, _offset, bytes,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (memory != NULL) {
+            _mapped = true;
+            return memory;
+        }
+    }
+    _copy.resize(bytes);
+    return &_copy[0];
+}
+
+void StreamBuffer::Unmap() {
+    if (_persistent != NULL) return;
+    if (_mapped) {
+        // the contents are lost if this fails, which only happens on events
+        // like a mode switch; the frame draws garbage once
+        glUnmapBuffer(_target);
+        _mapped = false;
+    } else if (!_copy.empty()) {
+        glBufferSubData(_target, _offset, _copy.size(), &_copy[0]);
+        _copy.clear();
+    }
+}
+
+void StreamBuffer::EndFrame() {
+    if (_buffer == 0 || !_use_fences) return;
+    _fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,82 @@
+#ifndef _stream_buffer_H
+#define _stream_buffer_H
+
+#include <vector>
+#include <GL/glew.h>
+
+/**
+ * A ring buffer for data that changes every frame - vertices transformed on
+ * the CPU, draw commands, uniforms
+ *
+ * The buffer is split into regions, one per frame, three by default: while
+ * the CPU writes the current frame's region the GPU may still be reading
+ * the two before it. Each region is fenced once its frame is submitted and
+ * only written again once that fence has signalled, so neither side waits
+ * for the other as long as the GPU is at most two frames behind.
+ *
+ * Where ``GL_ARB_buffer_storage`` is supported the whole buffer stays mapped
+ * persistent and coherent, and Map hands out pointers straight into it: the
+ * data is written once, where the GPU reads it. Otherwise each Map maps its
+ * range unsynchronized - the fences keep that safe - or, without
+ * ``glMapBufferRange``, writes to a copy that Unmap uploads.
+ */
+class StreamBuffer {
+    GLenum _target;
+    GLuint _buffer;
+    size_t _region_size, _used, _offset;
+    int _region;
+    std::vector<GLsync> _fences;  // of every region, 0 once reusable
+    unsigned char *_persistent;   // all of the buffer, if mapped for good
+    std::vector<unsigned char> _copy;
+    bool _mapped, _use_fences;
+    int _waits;
+
+    void Allocate(size_t region_size);
+    void Free();
+
+    // owns the buffer and fences, so it can't be copied
+    StreamBuffer(const StreamBuffer &);
+    StreamBuffer &operator=(const StreamBuffer &);
+
+    public:
+        StreamBuffer();
+        ~StreamBuffer();
+
+        /**
+         * Create the buffer, to be bound to |target|, with |regions| of
+         * |region_size| bytes - what a frame writes at most, though a region
+         * grows if a frame needs more. Needs a current OpenGL context
+         */
+        void Init(GLenum target, size_t region_size, int regions = 3);
+
+        /** Delete the buffer; Init can make a new one **/
+        void Release();
+
+        /**
+         * Move on to the next region, waiting for the GPU if it still reads
+         * from it (see Waits). Call at the start of a frame
+         */
+        void BeginFrame();
+
+        /**
+         * Where to write |bytes| for this frame, aligned to |alignment|; the
+         * data starts at Offset() in Buffer(), which is left bound to the
+         * target and may be a new buffer if the region had to grow
+         * Call Unmap once written, before drawing from it
+         */
+        void *Map(size_t bytes, size_t alignment = 16);
+        void Unmap();
+
+        /** Fence the region of this frame. Call once its draws are issued **/
+        void EndFrame();
+
+        GLuint Buffer() { return _buffer; }
+        /** Of the data of the last Map in Buffer(), in bytes **/
+        size_t Offset() { return _offset; }
+        /** Whether the buffer is mapped persistently **/
+        bool Persistent() { return _persistent != NULL; }
+        /** How often BeginFrame had to wait for the GPU to release a region **/
+        int Waits() { return _waits; }
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include <cstdio>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "TextureCache.h"
+#include "MappedFile.h"
+
+TextureCache::TextureCache(size_t budget):
+_budget(budget), _clock(0)
+{
+    _stats.hits = _stats.misses = _stats.evictions = _stats.textures = 0;
+    _stats.bytes_resident = 0;
+}
+
+TextureCache::~TextureCache() {
+    for (size_t i = 0; i < _entries.size(); i++) glDeleteTextures(1, &_entries[i].texture);
+}
+
+bool TextureCache::Hash(const char *path, unsigned long long &hash, bool known_only) {
+    struct stat info;
+    if (stat(path, &info) != 0) return false;
+    File &file = _files[path];
+    if (file.hash != 0 && file.modified == (long long)info.st_mtime && file.size == (long long)info.st_size) {
+        hash = file.hash;
+        return true;
+    }
+    if (known_only || !hash_file(path, hash)) {
+        _files.erase(path);
+        return false;
+    }
+    file.modified = info.st_mtime;
+    file.size = info.st_size;
+    file.hash = hash;
+    return true;
+}
+
+TextureCache::Entry *TextureCache::Find(GLuint texture) {
+    for (size_t i = 0; i < _entries.size(); i++) {
+        if (_entries[i].texture == texture) return &_entries[i];
+    }
+    return NULL;
+}
+
+GLuint TextureCache::Hit(unsigned long long hash, const std::string &variant) {
+    for (size_t i = 0; i < _entries.size(); i++) {
+        Entry &entry = _entries[i];
+        if (entry.hash == hash && entry.variant == variant) {
+            entry.references++;
+            entry.last_used = ++_clock;
+            _stats.hits++;
+            return entry.texture;
+        }
+    }
+    return 0;
+}
+
+GLuint TextureCache::Acquire(const char *path, const std::string &variant,
+                             bool (*load)(const char *path, GLuint texture)) {
+    unsigned long long hash;
+    if (!Hash(path, hash, false)) return 0;
+    GLuint texture = Hit(hash, variant);
+    if (texture != 0) return texture;
+
+    glGenTextures(1, &texture);
+    if (!load(path, texture)) {
+        glDeleteTextures(1, &texture);
+        return 0;
+    }
+    return Add(path, variant, hash, texture);
+}
+
+GLuint TextureCache::Lookup(const char *path, const std::string &variant) {
+    unsigned long long hash;
+    if (!Hash(path, hash, true)) return 0;
+    return Hit(hash, variant);
+}
+
+GLuint TextureCache::Insert(const char *path, const std::string &variant, unsigned long long hash, GLuint texture) {
+    struct stat info;
+    if (stat(path, &info) == 0) {
+        File &file = _files[path];
+        file.modified = info.st_mtime;
+        file.size = info.st_size;
+        file.hash = hash;
+    }
+    // the same image may have been loaded meanwhile, by another path too
+    GLuint resident = Hit(hash, variant);
+    if (resident != 0) {
+        glDeleteTextures(1, &texture);
+        return resident;
+    }
+    return Add(path, variant, hash, texture);
+}
+
+GLuint TextureCache::Add(const char *path, const std::string &variant, unsigned long long hash, GLuint texture) {
+    _stats.misses++;
+    Entry entry;
+    entry.texture = texture;
+    entry.hash = hash;
+    entry.variant = variant;
+    entry.path = path;
+    entry.bytes = texture_bytes(entry.texture);
+    entry.references = 1;
+    entry.last_used = ++_clock;
+    _entries.push_back(entry);
+    _stats.textures++;
+    _stats.bytes_resident += entry.bytes;
+    Trim();
+    return entry.texture;
+}
+
+void TextureCache::Release(GLuint texture) {
+    Entry *entry = Find(texture);
+    if (entry == NULL || entry->references == 0) return;
+    entry->references--;
+    entry->last_used = ++_clock;
+    Trim();
+}
+
+void TextureCache::Trim(void) {
+    while (_stats.bytes_resident > _budget) {
+        // the least recently used texture nobody holds
+        int oldest = -1;
+        for (size_t i = 0; i < _entries.size(); i++) {
+            if (_entries[i].references == 0 && (oldest == -1 || _entries[i].last_used < _entries[oldest].last_used)) {
+                oldest = i;
+            }
+        }
+        if (oldest == -1) return;
+        glDeleteTextures(1, &_entries[oldest].texture);
+        _stats.bytes_resident -= _entries[oldest].bytes;
+        _stats.textures--;
+        _stats.evictions++;
+        _entries.erase(_entries.begin() + oldest);
+    }
+}
+
+void TextureCache::SetBudget(size_t budget) {
+    _budget = budget;
+    Trim();
+}
+
+void TextureCache::Clear(void) {
+    size_t budget = _budget;
+    _budget = 0;
+    Trim();
+    _budget = budget;
+}
+
+std::string TextureCache::Summary(void) {
+    char line[160];
+    sprintf(line, "textures %d resident, %.1f of %.1f MB, %d hits, %d misses, %d evicted", _stats.textures,
+            _stats.bytes_resident / 1048576.0, _budget / 1048576.0, _stats.hits, _stats.misses, _stats.evictions);
+    return line;
+}
+
+bool hash_file(const char *path, unsigned long long &hash) {
+    // 64 bit FNV-1a of the whole file
+    MappedFile mapped;
+    if (!mapped.Open(path)) return false;
+    hash = 14695981039346656037ULL;
+    const unsigned char *data = mapped.Data();
+    for (size_t i = 0; i < mapped.Size(); i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return true;
+}
+
+size_t texture_bytes(GLuint texture) {
+    GLint bound = 0, max_level = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &max_level);
+    size_t total = 0;
+    for (int level = 0; level <= max_level; level++) {
+        GLint width = 0, height = 0, compressed = 0, size = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        if (width == 0) break;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+        total += compressed ? size : 4 * width * height;
+    }
+    glBindTexture(GL_TEXTURE_2D, bound);
+    return total;
+}
@@ -0,0 +1,113 @@
+#ifndef _texture_cache_H
+#define _texture_cache_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <GL/glew.h>
+
+/** What a TextureCache has done so far **/
+struct TextureCacheStats {
+    int hits, misses, evictions;
+    int textures;          // resident, in use or not
+    size_t bytes_resident; // of all of them (see texture_bytes)
+};
+
+/**
+ * Shares the textures loaded from files among everything that uses them
+ *
+ * Textures are told apart by the contents of their file - hashed, so two
+ * paths to the same image get the same texture - and by a variant naming
+ * how it was loaded (compressed, mipmapped...). A file is only hashed again
+ * when its size or modification time changes; until then asking for it
+ * costs no I/O at all.
+ *
+ * Every Acquire holds a reference until the matching Release. Textures
+ * nobody holds stay resident, for when they are asked for again, until the
+ * resident bytes exceed the budget; then the least recently used of them
+ * are deleted first. Textures in use are never evicted, so the budget may be
+ * overrun while they alone exceed it.
+ */
+class TextureCache {
+    // the last contents seen at a path
+    struct File {
+        long long modified, size;
+        unsigned long long hash;
+    };
+    struct Entry {
+        unsigned long long hash;
+        std::string variant, path;
+        GLuint texture;
+        size_t bytes;
+        int references;
+        unsigned long long last_used;
+    };
+
+    std::map<std::string, File> _files;
+    std::vector<Entry> _entries;
+    size_t _budget;
+    unsigned long long _clock;
+    TextureCacheStats _stats;
+
+    bool Hash(const char *path, unsigned long long &hash, bool known_only);
+    Entry *Find(GLuint texture);
+    GLuint Hit(unsigned long long hash, const std::string &variant);
+    GLuint Add(const char *path, const std::string &variant, unsigned long long hash, GLuint texture);
+    void Trim(void);
+
+    public:
+        TextureCache(size_t budget = 64 << 20);
+        ~TextureCache();
+
+        /**
+         * The texture for the file at |path| loaded as |variant|, loading it
+         * with |load| into a new texture object if it isn't resident
+         * Returns 0 if the file can't be read or |load| fails
+         */
+        GLuint Acquire(const char *path, const std::string &variant, bool (*load)(const char *path, GLuint texture));
+
+        /**
+         * The texture for the file at |path| loaded as |variant| if it is
+         * resident and the file hasn't changed since it was hashed, 0
+         * otherwise; it never reads the file. To load it elsewhere - on
+         * another thread - and hand it over with Insert
+         */
+        GLuint Lookup(const char *path, const std::string &variant);
+
+        /**
+         * Take over |texture|, loaded from the file at |path| with the
+         * contents |hash| (see hash_file) as |variant|, with one reference
+         * held. Returns the texture to use, which is another one - and
+         * |texture| deleted - if the same image was loaded meanwhile
+         */
+        GLuint Insert(const char *path, const std::string &variant, unsigned long long hash, GLuint texture);
+
+        /** Give back a texture returned by Acquire, Lookup or Insert **/
+        void Release(GLuint texture);
+
+        /** Change the budget, evicting what it no longer leaves room for **/
+        void SetBudget(size_t budget);
+
+        /** Delete every texture nobody holds **/
+        void Clear(void);
+
+        const TextureCacheStats &Stats() { return _stats; }
+
+        /** One line with the stats, for the overlay **/
+        std::string Summary(void);
+};
+
+/**
+ * The hash TextureCache tells files apart by, of the file at |path|; false
+ * if it can't be read. Safe to call from any thread
+ */
+bool hash_file(const char *path, unsigned long long &hash);
+
+/**
+ * Bytes the levels of |texture| take: as the driver stores them if they are
+ * compressed, at four bytes a pixel otherwise
+ */
+size_t texture_bytes(GLuint texture);
+
+#endif
@@ -0,0 +1,169 @@
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+// the pool and deque of the current thread, if it is a worker
+static thread_local ThreadPool *current_pool = NULL;
+static thread_local int current_queue = -1;
+
+ThreadPool::ThreadPool():
+_queued(0), _sleeping(0), _executed(0), _stolen(0), _quit(false)
+{
+    _queues.push_back(std::unique_ptr<Queue>(new Queue));
+}
+
+ThreadPool::~ThreadPool() {
+    Stop();
+}
+
+void ThreadPool::Start(int threads) {
+    Stop();
+    if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency()) - 1;
+    _quit = false;
+    // the workers' deques first, the shared one last
+    _queues.clear();
+    for (int t = 0; t <= threads; t++) _queues.push_back(std::unique_ptr<Queue>(new Queue));
+    for (int t = 0; t < threads; t++) _threads.push_back(std::thread(&ThreadPool::Work, this, t));
+}
+
+void ThreadPool::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _quit = true;
+    }
+    _wake.notify_all();
+    for (size_t t = 0; t < _threads.size(); t++) _threads[t].join();
+    _threads.clear();
+    for (size_t q = 0; q < _queues.size(); q++) {
+        std::deque<Task> &tasks = _queues[q]->tasks;
+        for (size_t i = 0; i < tasks.size(); i++) tasks[i].group->_pending--;
+        tasks.clear();
+    }
+    _queued = 0;
+}
+
+int ThreadPool::QueueIndex() {
+    return current_pool == this ? current_queue : _queues.size() - 1;
+}
+
+void ThreadPool::Spawn(Group &group, const std::function<void(void)> &task) {
+    group._pending++;
+    Task queued = { task, &group };
+    Queue &queue = *_queues[QueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(queued);
+    }
+    _queued++;
+    // a worker deciding to sleep has counted itself before checking
+    // |_queued|, so one of the two sees the other
+    if (_sleeping > 0) {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _wake.notify_one();
+    }
+}
+
+// Take the newest task of |queue|, or the oldest if |oldest|, skipping
+// those not in |only| unless it is NULL
+bool ThreadPool::Take(Queue &queue, bool oldest, Group *only, Task &task) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    std::deque<Task> &tasks = queue.tasks;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        size_t at = oldest ? i : tasks.size() - 1 - i;
+        if (only != NULL && tasks[at].group != only) continue;
+        task = tasks[at];
+        tasks.erase(tasks.begin() + at);
+        return true;
+    }
+    return false;
+}
+
+bool ThreadPool::RunOne(int queue, Group *only) {
+    Task task;
+    // our own newest task
+    bool found = Take(*_queues[queue], false, only, task);
+    // or the oldest of someone else's, starting from the next deque so the
+    // thieves spread out
+    for (size_t i = 1; i < _queues.size() && !found; i++) {
+        if (Take(*_queues[(queue + i) % _queues.size()], true, only, task)) {
+            found = true;
+            _stolen++;
+        }
+    }
+    if (!found) return false;
+    _queued--;
+    task.run();
+    _executed++;
+    task.group->_pending--;
+    return true;
+}
+
+void ThreadPool::Work(int queue) {
+    current_pool = this;
+    current_queue = queue;
+    while (true) {
+        if (RunOne(queue, NULL)) continue;
+        std::unique_lock<std::mutex> lock(_sleep_mutex);
+        _sleeping++;
+        // (a thief may count its task off before the spawner counted it on)
+        while (_queued <= 0 && !_quit) _wake.wait(lock);
+        _sleeping--;
+        if (_quit) return;
+    }
+}
+
+void ThreadPool::Wait(Group &group) {
+    int queue = QueueIndex();
+    // the other threads all share one deque, so one of them could take
+    // another's task and keep it waiting for as long as that runs
+    Group *only = current_pool == this ? NULL : &group;
+    while (group._pending > 0) {
+        // the last tasks may be running on other threads
+        if (!RunOne(queue, only)) std::this_thread::yield();
+    }
+}
+
+int TaskGraph::Add(const std::function<void(void)> &task) {
+    Node *node = new Node;
+    node->run = task;
+    node->dependencies = 0;
+    _nodes.push_back(std::unique_ptr<Node>(node));
+    return _nodes.size() - 1;
+}
+
+void TaskGraph::Precede(int before, int after) {
+    _nodes[before]->successors.push_back(after);
+    _nodes[after]->dependencies++;
+}
+
+void TaskGraph::Spawn(ThreadPool &pool, ThreadPool::Group &group, int node) {
+    pool.Spawn(group, [this, &pool, &group, node]() {
+        Node &done = *_nodes[node];
+        done.run();
+        for (size_t i = 0; i < done.successors.size(); i++) {
+            int next = done.successors[i];
+            if (--_nodes[next]->remaining == 0) Spawn(pool, group, next);
+        }
+    });
+}
+
+void TaskGraph::Run(ThreadPool &pool) {
+    for (size_t i = 0; i < _nodes.size(); i++) _nodes[i]->remaining = _nodes[i]->dependencies;
+    ThreadPool::Group group;
+    for (size_t i = 0; i < _nodes.size(); i++) {
+        if (_nodes[i]->dependencies == 0) Spawn(pool, group, i);
+    }
+    pool.Wait(group);
+}
+
+ThreadPool &thread_pool(void) {
+    // started on first use and never destroyed, so jobs still running at
+    // exit can finish with it
+    static ThreadPool *pool = NULL;
+    static std::once_flag started;
+    std::call_once(started, []() {
+        pool = new ThreadPool;
+        pool->Start();
+    });
+    return *pool;
+}
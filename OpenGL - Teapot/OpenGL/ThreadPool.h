@@ -0,0 +1,177 @@
+#ifndef _thread_pool_H
+#define _thread_pool_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+/**
+ * A work-stealing scheduler for the CPU side of the application
+ *
+ * Every worker has a deque of tasks: it pushes the tasks it spawns at the
+ * back and takes its next task from there too, newest first, while idle
+ * workers steal from the front of the others' - the oldest tasks, which for
+ * recursively split work are the biggest. Threads outside the pool spawn
+ * into a deque of their own that every worker steals from.
+ *
+ * Tasks are spawned into a Group and waited for with Wait, which runs tasks
+ * itself instead of blocking, so tasks may spawn and wait for tasks of
+ * their own and the waiting thread adds to the workers. A thread outside
+ * the pool only runs tasks of the group it waits for: the frame loop
+ * waiting on a parallel_for never picks up a long task that a background
+ * job spawned.
+ */
+class ThreadPool {
+    public:
+        /** Tasks that are waited for together **/
+        class Group {
+            friend class ThreadPool;
+            std::atomic<int> _pending;
+
+            public:
+                Group(): _pending(0) {}
+        };
+
+    private:
+        struct Task {
+            std::function<void(void)> run;
+            Group *group;
+        };
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        // the deques of the workers, then the one of the other threads
+        std::vector< std::unique_ptr<Queue> > _queues;
+        std::vector<std::thread> _threads;
+        std::mutex _sleep_mutex;
+        std::condition_variable _wake;
+        std::atomic<int> _queued, _sleeping;
+        std::atomic<long long> _executed, _stolen;
+        bool _quit;
+
+        int QueueIndex();
+        bool Take(Queue &queue, bool oldest, Group *only, Task &task);
+        bool RunOne(int queue, Group *only);
+        void Work(int queue);
+
+    public:
+        ThreadPool();
+        ~ThreadPool();
+
+        /**
+         * Start |threads| workers, one less than the hardware has if 0, as
+         * the thread waiting for them works too
+         */
+        void Start(int threads = 0);
+
+        /** Stop the workers; the tasks still queued are dropped **/
+        void Stop();
+
+        /** Queue |task| in |group| **/
+        void Spawn(Group &group, const std::function<void(void)> &task);
+
+        /**
+         * Run tasks until all of |group|'s are done - only |group|'s, unless
+         * called from a worker
+         */
+        void Wait(Group &group);
+
+        /**
+         * Run |work(begin, end)| over [begin, end) in ranges of at most
+         * |grain| and return once all are done. The range is halved again and
+         * again, one half spawned and the other kept, so a thief takes the
+         * biggest piece left
+         */
+        template <typename Function>
+        void ParallelFor(int begin, int end, int grain, const Function &work);
+
+        /** The workers and the waiting thread **/
+        int Threads() { return _threads.size() + 1; }
+        /** Tasks run, and of those taken from another thread's deque **/
+        long long Executed() { return _executed; }
+        long long Stolen() { return _stolen; }
+
+    private:
+        template <typename Function>
+        void Split(Group &group, int begin, int end, int grain, const Function &work);
+};
+
+template <typename Function>
+void ThreadPool::Split(Group &group, int begin, int end, int grain, const Function &work) {
+    while (end - begin > grain) {
+        int middle = begin + (end - begin) / 2;
+        Spawn(group, [this, &group, middle, end, grain, &work]() { Split(group, middle, end, grain, work); });
+        end = middle;
+    }
+    if (begin < end) work(begin, end);
+}
+
+template <typename Function>
+void ThreadPool::ParallelFor(int begin, int end, int grain, const Function &work) {
+    Group group;
+    Split(group, begin, end, grain < 1 ? 1 : grain, work);
+    Wait(group);
+}
+
+/**
+ * Tasks and the order they have to run in, run together on a ThreadPool
+ *
+ * A task starts as soon as every task added to precede it is done, so
+ * whatever doesn't depend on each other runs at the same time. The graph
+ * must not have cycles; it may be run any number of times.
+ */
+class TaskGraph {
+    struct Node {
+        std::function<void(void)> run;
+        std::vector<int> successors;
+        int dependencies;
+        std::atomic<int> remaining;
+    };
+
+    std::vector< std::unique_ptr<Node> > _nodes;
+
+    void Spawn(ThreadPool &pool, ThreadPool::Group &group, int node);
+
+    public:
+        /** Add |task|, returns its id for Precede **/
+        int Add(const std::function<void(void)> &task);
+
+        /** Make the task |after| wait for the task |before| **/
+        void Precede(int before, int after);
+
+        /** Run every task on |pool| and return once all are done **/
+        void Run(ThreadPool &pool);
+
+        int Size() { return _nodes.size(); }
+};
+
+/** The pool everything shares, started with all the hardware threads **/
+ThreadPool &thread_pool(void);
+
+/**
+ * Run |work(begin, end)| over [0, |count|) on thread_pool(), split in ranges
+ * of at least |grain| for about |threads| threads - all of them if 0, none
+ * but this one if 1
+ */
+template <typename Function>
+void parallel_for(int count, int threads, const Function &work, int grain = 1) {
+    if (threads == 1 || count <= grain) {
+        if (count > 0) work(0, count);
+        return;
+    }
+    ThreadPool &pool = thread_pool();
+    // a few ranges a thread to even out the load when there are threads
+    // enough; as many as |threads| when there are to be no more
+    int ranges = threads <= 0 ? 4 * pool.Threads() : threads;
+    int size = (count + ranges - 1) / ranges;
+    pool.ParallelFor(0, count, size > grain ? size : grain, work);
+}
+
+#endif
@@ -1,83 +1,272 @@
+#include <unordered_map>
+
 #include "TriangleMesh.h"
+#include "ThreadPool.h"
+#include "Arena.h"
 
 // This function loads an obj format file
 void TriangleMesh::LoadFile(char * filename) {
-	FILE *file = fopen(filename, "r");
-	if(file  == NULL){
-        std::cerr << "Can't open file " << filename << std::endl;
+	ObjReader reader;
+	if (!reader.Open(filename)) {
 		return;
 	}
-    std::vector<unsigned int> vertexIndices, uvIndices;
-	std::vector<glm::vec3> tempVertices;
-	std::vector<glm::vec2> tempUVs;
-	_max.x =-10000; _max.y =-10000; _max.z =-10000;
-	_min.x =10000; _min.y =10000; _min.z =10000;
-	glm::vec3 averageVertex(0.0f);
-	//Read in .obj
-	while(1) {
-		char lineHeader[128];
-		//read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if(res == EOF){
-			break;
-		}
-		if(strcmp(lineHeader, "v") == 0){
-			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-			tempVertices.push_back(vertex);
-			averageVertex += vertex;
-			if (vertex.x > _max.x) _max.x = vertex.x;
-			if (vertex.y > _max.y) _max.y = vertex.y;
-			if (vertex.z > _max.z) _max.z = vertex.z;
-			if (vertex.x < _min.x) _min.x = vertex.x;
-			if (vertex.y < _min.y) _min.y = vertex.y;
-			if (vertex.z < _min.z) _min.z = vertex.z;
-		}
-		else if(strcmp(lineHeader, "vt" ) == 0){
-			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y);
-			tempUVs.push_back(uv);
-		}
-		else if(strcmp(lineHeader, "f" ) == 0){
-            std::string vertex1, vertex2, vertex3;
-			unsigned int vertexIndex[3], uvIndex[3];
-			int matches = fscanf(file, "%d/%d %d/%d %d/%d\n",&vertexIndex[0], &uvIndex[0], &vertexIndex[1], &uvIndex[1], &vertexIndex[2], &uvIndex[2] );
-			if(matches != 6){
-                std::cerr << "Can't be read by simple parser!" << std::endl;
-				return;
-			}
-			Triangle trig(vertexIndex[0],vertexIndex[1],vertexIndex[2]);
-			_triangles.push_back(trig);
-			vertexIndices.push_back(vertexIndex[0]);
-			vertexIndices.push_back(vertexIndex[1]);
-			vertexIndices.push_back(vertexIndex[2]);
-			uvIndices.push_back(uvIndex[0]);
-			uvIndices.push_back(uvIndex[1]);
-			uvIndices.push_back(uvIndex[2]);
-		}
-	}
-	//Arrange in triangle order to fit with OpenGL's glDrawArrays(...) function.
+	//Read in .obj, arranged in triangle order to fit with OpenGL's glDrawArrays(...) function.
 	//i.e. _vertices[0],_vertices[1], and _vertices[2] are the first triangle,
 	//_vertices[3],_vertices[4], and _vertices[5] are the second etc.
-	//Note this invalidates the Triangle structures in _triangles.  The Triangle class
-	//is used to help with creating an array of indexes for glDrawElements(...); if you want to use
-	//this instead of reordering the vertices
-	_vertices.resize(vertexIndices.size());
-	_uvs.resize(uvIndices.size());
-	for(unsigned int i = 0; i < vertexIndices.size(); ++i){
-		_vertices[i] = tempVertices[vertexIndices[i]-1];
-		_uvs[i] = tempUVs[uvIndices[i]-1];
+	_vertices.clear();
+	_uvs.clear();
+	_normals.clear();
+	_normals_from_file = false;
+	_file_normals.clear();
+	_indices.clear();
+	_index_corners.clear();
+	_lods.clear();
+	_meshlets.clear();
+	size_t corners = 3 * (size_t)reader.EstimatedTriangles();
+	_vertices.reserve(corners);
+	_uvs.reserve(corners);
+	_file_normals.reserve(corners);
+	while (reader.Read(1 << 30, _vertices, _uvs, _file_normals) > 0);
+	if (reader.Failed()) {
+		_vertices.clear();
+		_uvs.clear();
+		_file_normals.clear();
+		return;
+	}
+	if (!reader.HasNormals()) _file_normals.clear();
+	_min = reader.Min();
+	_max = reader.Max();
+	Transform(NormalizationMatrix(reader.Sum(), _min, _max, _vertices.size()));
+};
+
+void TriangleMesh::Append(const std::vector<glm::vec3> &vertices, const std::vector<glm::vec2> &uvs,
+                          const std::vector<glm::vec3> &normals, const std::vector<glm::vec3> &file_normals) {
+	_vertices.insert(_vertices.end(), vertices.begin(), vertices.end());
+	_uvs.insert(_uvs.end(), uvs.begin(), uvs.end());
+	// the normals so far have to be stored to be appended to
+	if (_normals_from_file) _normals = _file_normals;
+	_normals_from_file = false;
+	_normals.insert(_normals.end(), normals.begin(), normals.end());
+	_file_normals.insert(_file_normals.end(), file_normals.begin(), file_normals.end());
+	_indices.clear();
+	_index_corners.clear();
+	_lods.clear();
+	_meshlets.clear();
+}
+
+// Positions compared by value, with 0 and -0 the same
+struct PositionEqual {
+	bool operator()(const glm::vec3 &a, const glm::vec3 &b) const {
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+};
+
+struct PositionHash {
+	size_t operator()(const glm::vec3 &position) const {
+		// FNV-1a over the bytes, adding 0 turns -0 into 0
+		float values[3] = { position.x + 0.0f, position.y + 0.0f, position.z + 0.0f };
+		const unsigned char *bytes = (const unsigned char *)values;
+		size_t hash = 2166136261u;
+		for (size_t i = 0; i < sizeof(values); i++) hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+};
+
+// Everything that makes two corners the same vertex
+struct CornerKey {
+	float values[8];
+
+	bool operator==(const CornerKey &other) const {
+		return memcmp(values, other.values, sizeof(values)) == 0;
 	}
+};
+
+struct CornerKeyHash {
+	size_t operator()(const CornerKey &key) const {
+		// FNV-1a over the bytes of the key
+		const unsigned char *bytes = (const unsigned char *)key.values;
+		size_t hash = 2166136261u;
+		for (size_t i = 0; i < sizeof(key.values); i++) hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+};
+
+void TriangleMesh::Optimize() {
+	// nothing to weld, and no levels to draw
+	if (_vertices.empty()) return;
+	bool file_normals = HasNormals();
+	std::vector<unsigned int> indices(_vertices.size());
+	std::vector<unsigned int> first_corner;
+	std::unordered_map<CornerKey, unsigned int, CornerKeyHash> vertex_of;
+	vertex_of.reserve(_vertices.size() / 2);
+	for (size_t i = 0; i < _vertices.size(); i++) {
+		CornerKey key;
+		memset(key.values, 0, sizeof(key.values));
+		memcpy(key.values, &_vertices[i], sizeof(glm::vec3));
+		memcpy(key.values + 3, &_uvs[i], sizeof(glm::vec2));
+		if (file_normals) memcpy(key.values + 5, &_file_normals[i], sizeof(glm::vec3));
+		std::pair<CornerKey, unsigned int> entry(key, first_corner.size());
+		std::pair<std::unordered_map<CornerKey, unsigned int, CornerKeyHash>::iterator, bool> inserted = vertex_of.insert(entry);
+		if (inserted.second) first_corner.push_back(i);
+		indices[i] = inserted.first->second;
+	}
+	std::vector<glm::vec3> positions(first_corner.size());
+	for (size_t i = 0; i < first_corner.size(); i++) positions[i] = _vertices[first_corner[i]];
+
+	_stats_before = analyze_vertex_cache(indices, positions.size());
+	optimize_vertex_cache(indices, positions.size());
+	optimize_overdraw(indices, positions);
+	std::vector<unsigned int> remap;
+	optimize_vertex_fetch(indices, positions.size(), remap);
+	_stats_after = analyze_vertex_cache(indices, remap.size());
+
+	// rebuild the triangle order arrays in the new triangle order, each
+	// corner takes the attributes of the vertex it was welded into
+	std::vector<glm::vec3> vertices(indices.size()), corner_normals;
+	std::vector<glm::vec2> uvs(indices.size());
+	if (file_normals) corner_normals.resize(indices.size());
+	_index_corners.assign(remap.size(), 0);
+	std::vector<bool> seen(remap.size(), false);
+	for (size_t i = 0; i < indices.size(); i++) {
+		unsigned int corner = first_corner[remap[indices[i]]];
+		vertices[i] = _vertices[corner];
+		uvs[i] = _uvs[corner];
+		if (file_normals) corner_normals[i] = _file_normals[corner];
+		if (!seen[indices[i]]) {
+			seen[indices[i]] = true;
+			_index_corners[indices[i]] = i;
+		}
+	}
+	_vertices.swap(vertices);
+	_uvs.swap(uvs);
+	_file_normals.swap(corner_normals);
+	_normals.clear();
+	_normals_from_file = false;
+	_indices.swap(indices);
+	MeshLod full = { 0, (unsigned int)_indices.size(), 0.0f, 0, 0 };
+	_lods.assign(1, full);
+	_meshlets.clear();
+}
+
+void TriangleMesh::BuildLods() {
+	if (_lods.empty()) return;
+	std::vector<glm::vec3> positions;
+	GatherIndexed(_vertices, positions);
+	if (positions.empty()) return;
+	glm::vec3 min(positions[0]), max(positions[0]);
+	for (size_t i = 0; i < positions.size(); i++) {
+		min = glm::min(min, positions[i]);
+		max = glm::max(max, positions[i]);
+	}
+	_bounds_center = (min + max) * 0.5f;
+	_bounds_radius = 0.0f;
+	for (size_t i = 0; i < positions.size(); i++) {
+		_bounds_radius = std::max(_bounds_radius, glm::length(positions[i] - _bounds_center));
+	}
+
+	// each level is simplified from the one before, so its error includes theirs
+	_indices.resize(_lods[0].count);
+	_lods.resize(1);
+	std::vector<unsigned int> level(_indices), simplified;
+	float error = 0.0f;
+	while (level.size() / 3 >= 128) {
+		size_t target = level.size() / 6 * 3;
+		error = std::max(error, simplify_mesh(level, positions, target, simplified));
+		// stop once the locked seams and borders are most of what is left
+		if (simplified.size() > level.size() * 9 / 10) break;
+		optimize_vertex_cache(simplified, positions.size());
+		MeshLod lod = { (unsigned int)_indices.size(), (unsigned int)simplified.size(), error, 0, 0 };
+		_lods.push_back(lod);
+		_indices.insert(_indices.end(), simplified.begin(), simplified.end());
+		level.swap(simplified);
+	}
+	_meshlets.clear();
+}
+
+void TriangleMesh::BuildMeshlets() {
+	std::vector<glm::vec3> positions;
+	GatherIndexed(_vertices, positions);
+	_meshlets.clear();
+	for (size_t i = 0; i < _lods.size(); i++) {
+		_lods[i].first_meshlet = _meshlets.size();
+		build_meshlets(_indices, _lods[i].first, _lods[i].count, positions, _meshlets);
+		_lods[i].meshlet_count = _meshlets.size() - _lods[i].first_meshlet;
+	}
+}
+
+glm::mat4 TriangleMesh::NormalizationMatrix(glm::vec3 sum, glm::vec3 min, glm::vec3 max, int vertex_count) {
 	float range;
-	if (_max.x-_min.x > _max.y-_min.y){
-		range = _max.x-_min.x;
+	if (max.x-min.x > max.y-min.y){
+		range = max.x-min.x;
 	}
 	else{
-		range = _max.y-_min.y;
+		range = max.y-min.y;
 	}
-	averageVertex /= _vertices.size();
+	glm::vec3 averageVertex = sum / (float)vertex_count;
+	glm::mat4 scale = glm::scale(glm::mat4(1.0f), glm::vec3(400.0f / range));
+	return glm::translate(scale, -averageVertex);
+}
+
+void TriangleMesh::Transform(const glm::mat4 &matrix) {
 	for (int i = 0; i < _vertices.size(); i++)
 	{
-		_vertices[i] = (_vertices[i]-averageVertex)/range*400.0f;
+		_vertices[i] = glm::vec3(matrix * glm::vec4(_vertices[i], 1.0f));
 	}
-};
+}
+
+// Computes one normal per entry of _vertices
+void TriangleMesh::ComputeNormals(bool smoothed) {
+    std::vector<glm::vec3> &vertices = _vertices;
+    std::vector<glm::vec3> &normals = _normals;
+    // no need to generate, or copy, what the file supplied
+    _normals_from_file = smoothed && HasNormals();
+    normals.clear();
+    if (_normals_from_file) return;
+    if (smoothed) {
+        // the normal of every position, starting at zero, in a hash map whose
+        // nodes all come from one arena freed when done - one block is enough
+        // when about six corners share each position, as on a closed mesh
+        typedef std::pair<const glm::vec3, glm::vec3> Entry;
+        typedef std::unordered_map<glm::vec3, glm::vec3, PositionHash, PositionEqual, ArenaAllocator<Entry> > NormalMap;
+        Arena arena(vertices.size() * 12 + 4096);
+        NormalMap normal_map(vertices.size() / 4, PositionHash(), PositionEqual(), ArenaAllocator<Entry>(arena));
+        for (int i = 0; i < vertices.size(); i += 3) {
+            // get vertices of the current triangle
+            glm::vec3 v1 = vertices[i];
+            glm::vec3 v2 = vertices[i + 1];
+            glm::vec3 v3 = vertices[i + 2];
+            // compute face normal
+            glm::vec3 face_normal = glm::cross(v3 - v2, v1 - v2);
+            // get the old vertex normals, all before any is replaced
+            glm::vec3 &v1_normal = normal_map.insert(Entry(v1, glm::vec3(0.0f))).first->second;
+            glm::vec3 &v2_normal = normal_map.insert(Entry(v2, glm::vec3(0.0f))).first->second;
+            glm::vec3 &v3_normal = normal_map.insert(Entry(v3, glm::vec3(0.0f))).first->second;
+            glm::vec3 v1_old = v1_normal, v2_old = v2_normal, v3_old = v3_normal;
+            // replace the old value with the new value
+            v1_normal = glm::normalize(v1_old + face_normal);
+            v2_normal = glm::normalize(v2_old + face_normal);
+            v3_normal = glm::normalize(v3_old + face_normal);
+        }
+        // convert the map of normals to a vector of normals
+        normals.resize(vertices.size());
+        for (int i = 0; i < vertices.size(); i++) {
+            normals[i] = normal_map.find(vertices[i])->second;
+        }
+    } else {
+        // every triangle on its own, so they are shared out among threads
+        normals.resize(vertices.size());
+        parallel_for(vertices.size() / 3, 0, [&](int begin, int end) {
+            for (int i = 3 * begin; i < 3 * end; i += 3) {
+                // get vertices of this triangle
+                glm::vec3 v1 = vertices[i];
+                glm::vec3 v2 = vertices[i + 1];
+                glm::vec3 v3 = vertices[i + 2];
+                // compute face normal
+                glm::vec3 face_normal = glm::normalize(glm::cross(v3 - v2, v1 - v2));
+                normals[i] = face_normal;
+                normals[i + 1] = face_normal;
+                normals[i + 2] = face_normal;
+            }
+        }, 4096);
+    }
+}
@@ -2,6 +2,7 @@
 #define _triangle_H
 
 #include <vector>
+#include <map>
 #include <cmath>
 #include <fstream>
 #include <cstring>
@@ -9,6 +10,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "utils.h"
+#include "Span.h"
+#include "ObjReader.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlets.h"
 
 class Triangle;
 class TriangleMesh;
@@ -24,17 +30,105 @@ class Triangle {
 class TriangleMesh {
     std::vector <glm::vec3> _vertices;
 	std::vector <glm::vec2> _uvs;
-	std::vector <Triangle> _triangles;
+	std::vector <glm::vec3> _normals;
+	std::vector <glm::vec3> _file_normals;
+	bool _normals_from_file;  // Normals() are _file_normals, not _normals
+	std::vector <unsigned int> _indices, _index_corners;
+	std::vector <MeshLod> _lods;
+	std::vector <Meshlet> _meshlets;
+	glm::vec3 _bounds_center;
+	float _bounds_radius;
+	VertexCacheStats _stats_before, _stats_after;
 	glm::vec3 _min, _max;
 
     public:
-        TriangleMesh(char * filename) { LoadFile(filename) ;};
-        TriangleMesh() {};
+        TriangleMesh(char * filename): _normals_from_file(false), _bounds_radius(0.0f) { LoadFile(filename) ;};
+        TriangleMesh(): _normals_from_file(false), _bounds_radius(0.0f) {};
         void LoadFile(char * filename);
-        int TriangleCount() { return _triangles.size() ;};
+        int TriangleCount() { return _vertices.size() / 3;};
         int VertexCount() { return _vertices.size();};
         std::vector<glm::vec3> &Vertices() { return _vertices; }
         std::vector<glm::vec2> &UVs() { return _uvs; }
+        // The normals to draw with, a view of the ones from the file when
+        // those are used as they are
+        Span<const glm::vec3> Normals() {
+            return _normals_from_file ? Span<const glm::vec3>(_file_normals) : Span<const glm::vec3>(_normals);
+        }
+
+        // Whether the file supplied a normal for every vertex
+        bool HasNormals() { return !_file_normals.empty() && _file_normals.size() == _vertices.size(); }
+
+        // Fill Normals() with one normal per vertex. If |smoothed| is set, the
+        // vertex normals are the ones from the file or, if it has none, the
+        // average of the face normals of the triangles that vertex
+        // participates in. Otherwise every vertex gets the normal of its own
+        // triangle.
+        void ComputeNormals(bool smoothed);
+
+        // Append triangles in triangle order, as emitted by a MeshStream.
+        // |normals| are the ones to draw with, |file_normals| the ones from
+        // the file, or empty if it didn't supply them.
+        void Append(const std::vector<glm::vec3> &vertices, const std::vector<glm::vec2> &uvs,
+                    const std::vector<glm::vec3> &normals, const std::vector<glm::vec3> &file_normals);
+
+        // Weld the corners of the triangles that share a position, uv and
+        // file normal into indexed vertices, then reorder the triangles for
+        // the vertex cache and for overdraw and the vertices for fetching.
+        // The triangle order arrays are rearranged to match Indices().
+        // An empty mesh is left as it is.
+        void Optimize();
+
+        // Build a chain of simplified levels of detail of the optimized mesh,
+        // each with about half the triangles of the one before (see
+        // simplify_mesh), and the bounding sphere used to choose between them
+        void BuildLods();
+
+        // The triangles of every level of detail of the optimized mesh, empty
+        // until Optimize is called
+        std::vector<unsigned int> &Indices() { return _indices; }
+        int IndexCount() { return _indices.size(); }
+
+        // The levels of detail in Indices(), starting with the full mesh
+        std::vector<MeshLod> &Lods() { return _lods; }
+
+        // Split every level of detail into meshlets for culling (see
+        // build_meshlets), recorded in the meshlet range of each level
+        void BuildMeshlets();
+        std::vector<Meshlet> &Meshlets() { return _meshlets; }
+
+        // Bounding sphere of the mesh, valid after BuildLods
+        glm::vec3 BoundsCenter() { return _bounds_center; }
+        float BoundsRadius() { return _bounds_radius; }
+
+        // Vertex cache efficiency before and after Optimize
+        VertexCacheStats StatsBefore() { return _stats_before; }
+        VertexCacheStats StatsAfter() { return _stats_after; }
+
+        // The vertices Indices() refer to
+        int IndexedVertexCount() { return _index_corners.size(); }
+
+        // Write one entry of the triangle order array |corners| per vertex
+        // of Indices() to |indexed|, which has room for IndexedVertexCount()
+        template <typename T>
+        void GatherIndexed(Span<const T> corners, T *indexed) {
+            for (size_t i = 0; i < _index_corners.size(); i++) indexed[i] = corners[_index_corners[i]];
+        }
+
+        // Fill |indexed| as above and return it
+        template <typename T>
+        std::vector<T> &GatherIndexed(const std::vector<T> &corners, std::vector<T> &indexed) {
+            indexed.resize(_index_corners.size());
+            if (!indexed.empty()) GatherIndexed(Span<const T>(corners), &indexed[0]);
+            return indexed;
+        }
+
+        // Apply |matrix| to every vertex
+        void Transform(const glm::mat4 &matrix);
+
+        // The transform that centers a mesh of |vertex_count| vertices on its
+        // average vertex and scales it to 400 units, given the |sum|, |min|
+        // and |max| of the positions in its file
+        static glm::mat4 NormalizationMatrix(glm::vec3 sum, glm::vec3 min, glm::vec3 max, int vertex_count);
 };
 
 #endif
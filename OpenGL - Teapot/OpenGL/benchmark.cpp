@@ -0,0 +1,841 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <GL/glew.h>
+#include <GL/glut.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#include "benchmark.h"
+#include "mesh_generator.h"
+#include "TriangleMesh.h"
+#include "Bvh.h"
+#include "ShadowMap.h"
+#include "LightClusters.h"
+#include "GBuffer.h"
+#include "OverdrawCounter.h"
+#include "bmp_loader.h"
+#include "compressed_texture.h"
+#include "TextureCache.h"
+#include "JobSystem.h"
+#include "ThreadPool.h"
+#include "StreamBuffer.h"
+#include "GeometryPool.h"
+
+// the application state and helpers in main.cpp
+extern TriangleMesh trig;
+extern int forced_lod;
+extern bool use_meshlet_culling;
+extern Bvh mesh_bvh;
+extern ShadowMap shadow_map;
+extern LightClusters light_clusters;
+extern int light_count;
+extern GBuffer gbuffer;
+extern bool use_deferred;
+extern int mesh_layers;
+extern bool use_depth_prepass;
+extern OverdrawCounter overdraw;
+extern bool count_overdraw;
+extern char *decal, *sphere, *bump_map3;
+extern TextureCache texture_cache;
+extern GLuint textureID;
+extern JobSystem jobs;
+extern bool use_async_loading;
+extern double upload_budget_ms;
+extern bool use_buffer_mapping;
+extern bool show_gallery;
+extern bool use_gallery_batching;
+extern int gallery_draw_calls;
+extern std::vector<int> gallery_meshes;
+extern GeometryPool geometry_pool;
+void display_handler(void);
+void setup_gallery(void);
+void setup_vertex_position_buffer_object(void);
+void setup_vertex_uv_buffer_object(void);
+void menu1(int id);
+void menu2(int id);
+void setup_texture(char *texture_path, GLuint *textureID);
+bool pick_triangle(int x, int y, RayHit &hit, glm::vec3 &position);
+void place_lights(void);
+void assign_lights(int threads);
+
+typedef std::chrono::steady_clock Clock;
+
+#ifdef BENCHMARK_ALLOCATIONS
+// Every allocation with new, by any part of the program, is counted here so
+// the benchmark can tell how many a stage makes. Only in builds that define
+// BENCHMARK_ALLOCATIONS, as it makes every allocation of the application
+// pay for the count
+static std::atomic<long long> allocation_count(0);
+
+void *operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void *memory = malloc(size > 0 ? size : 1);
+    if (memory == NULL) throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
+static long long allocations_made(void) {
+    return allocation_count;
+}
+#else
+static long long allocations_made(void) {
+    return -1;
+}
+#endif
+
+// the allocations made since allocations_made() was |start|, -1 if they
+// aren't counted
+static long long allocations_since(long long start) {
+    return start < 0 ? -1 : allocations_made() - start;
+}
+
+// the most memory the process has had resident at once so far
+static size_t peak_resident_bytes(void) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// writes every measurement as a line of JSON to a file and to stdout
+struct Results {
+    FILE *file;
+
+    void Line(const char *line) {
+        if (file) fprintf(file, "%s\n", line);
+        std::cout << line << std::endl;
+    }
+
+    void Record(const char *mesh, int triangles, const char *stage, const char *mode, double ms) {
+        char line[256];
+        sprintf(line, "{\"mesh\": \"%s\", \"triangles\": %d, \"stage\": \"%s\", \"mode\": \"%s\", \"ms\": %.4f}",
+                mesh, triangles, stage, mode, ms);
+        Line(line);
+    }
+
+    void RecordCache(const char *mesh, int triangles, const char *mode, VertexCacheStats stats) {
+        char line[256];
+        sprintf(line, "{\"mesh\": \"%s\", \"triangles\": %d, \"stage\": \"vertex_cache\", \"mode\": \"%s\", \"acmr\": %.4f, \"atvr\": %.4f}",
+                mesh, triangles, mode, stats.acmr, stats.atvr);
+        Line(line);
+    }
+
+    void RecordOverdraw(const char *mesh, int triangles, const char *mode, OverdrawCounter &counter) {
+        char line[256];
+        sprintf(line, "{\"mesh\": \"%s\", \"triangles\": %d, \"stage\": \"overdraw\", \"mode\": \"%s\", \"overdraw\": %.4f, \"shaded\": %u, \"covered\": %u}",
+                mesh, triangles, mode, counter.Overdraw(), counter.Shaded(), counter.Covered());
+        Line(line);
+    }
+
+    void RecordBytes(const char *mesh, const char *stage, const char *mode, size_t bytes) {
+        char line[256];
+        sprintf(line, "{\"mesh\": \"%s\", \"stage\": \"%s\", \"mode\": \"%s\", \"bytes\": %lu}",
+                mesh, stage, mode, (unsigned long)bytes);
+        Line(line);
+    }
+
+    void RecordTextureCache(const char *mode, double ms, const TextureCacheStats &stats) {
+        char line[256];
+        sprintf(line, "{\"stage\": \"texture_switch\", \"mode\": \"%s\", \"ms\": %.4f, \"hits\": %d, \"misses\": %d, \"evictions\": %d, \"bytes_resident\": %lu}",
+                mode, ms, stats.hits, stats.misses, stats.evictions, (unsigned long)stats.bytes_resident);
+        Line(line);
+    }
+
+    void RecordPool(const char *mode, int tasks, double ms, bool correct, long long stolen, int threads) {
+        char line[256];
+        sprintf(line, "{\"stage\": \"thread_pool\", \"mode\": \"%s\", \"tasks\": %d, \"ms\": %.4f, \"correct\": %s, \"stolen\": %lld, \"threads\": %d}",
+                mode, tasks, ms, correct ? "true" : "false", stolen, threads);
+        Line(line);
+    }
+
+    void RecordMemory(const char *mesh, int triangles, const char *stage, long long allocations, size_t peak_bytes) {
+        char line[256], counted[32] = "null";
+        if (allocations >= 0) sprintf(counted, "%lld", allocations);
+        sprintf(line, "{\"mesh\": \"%s\", \"triangles\": %d, \"stage\": \"%s\", \"mode\": \"memory\", \"allocations\": %s, \"peak_resident_bytes\": %lu}",
+                mesh, triangles, stage, counted, (unsigned long)peak_bytes);
+        Line(line);
+    }
+
+    void RecordStream(const char *mode, int vertices, double ms, int waits) {
+        char line[256];
+        sprintf(line, "{\"stage\": \"vertex_streaming\", \"mode\": \"%s\", \"vertices\": %d, \"ms\": %.4f, \"waits\": %d}",
+                mode, vertices, ms, waits);
+        Line(line);
+    }
+
+    void RecordDraws(const char *mode, int meshes, double ms, int draw_calls) {
+        char line[256];
+        sprintf(line, "{\"stage\": \"gallery\", \"mode\": \"%s\", \"meshes\": %d, \"ms\": %.4f, \"draw_calls\": %d}",
+                mode, meshes, ms, draw_calls);
+        Line(line);
+    }
+
+    void RecordRate(const char *mesh, int triangles, const char *stage, const char *mode, double per_second) {
+        char line[256];
+        sprintf(line, "{\"mesh\": \"%s\", \"triangles\": %d, \"stage\": \"%s\", \"mode\": \"%s\", \"per_second\": %.0f}",
+                mesh, triangles, stage, mode, per_second);
+        Line(line);
+    }
+};
+
+// the render modes as selected from the menus, in menu order
+struct RenderMode {
+    const char *name;
+    void (*menu)(int id);
+    int id;
+};
+
+static const RenderMode render_modes[] = {
+    { "flat",      menu1, 1 },
+    { "gouraud",   menu1, 2 },
+    { "phong",     menu1, 3 },
+    { "decal",     menu2, 1 },
+    { "bump",      menu2, 2 },
+    { "spherical", menu2, 3 },
+};
+
+// generators of the benchmark meshes
+struct MeshKind {
+    const char *name;
+    void (*generate)(int triangles, GeneratedMesh &mesh);
+};
+
+static const MeshKind mesh_kinds[] = {
+    { "sphere", generate_sphere },
+    { "torus",  generate_torus },
+    { "teapot", generate_teapot },
+};
+
+// a deterministic random number in [-1, 1)
+static float random_signed(unsigned int &seed) {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) / 16777216.0f * 2.0f - 1.0f;
+}
+
+static glm::vec3 random_vec3(unsigned int &seed) {
+    float x = random_signed(seed), y = random_signed(seed);
+    return glm::vec3(x, y, random_signed(seed));
+}
+
+// Packets of four rays from a sphere around the mesh towards points inside
+// its bounds. The rays of a packet start together and diverge slightly, as
+// neighbouring pixels would; the sequence is the same on every run
+static void make_rays(glm::vec3 center, float radius, int count, std::vector<Ray> &rays) {
+    unsigned int seed = 12345;
+    rays.resize(count);
+    for (int i = 0; i < count; i += 4) {
+        glm::vec3 origin;
+        do {
+            origin = random_vec3(seed);
+        } while (glm::length(origin) > 1.0f || glm::length(origin) < 0.1f);
+        origin = center + glm::normalize(origin) * radius * 2.0f;
+        glm::vec3 target = center + random_vec3(seed) * radius * 0.5f;
+        for (int r = i; r < i + 4 && r < count; r++) {
+            glm::vec3 jitter = random_vec3(seed) * radius * 0.01f;
+            rays[r].origin = origin;
+            rays[r].direction = glm::normalize(target + jitter - origin);
+            rays[r].t_max = radius * 4.0f;
+        }
+    }
+}
+
+static void invalidate_shadow_map(void) {
+    shadow_map.Invalidate();
+}
+
+// median time of |frames| frames, each drawn and waited for, calling
+// |before| ahead of every frame
+static double time_frames(int frames, void (*before)(void) = NULL) {
+    std::vector<double> times;
+    for (int i = 0; i < 3; i++) {
+        display_handler();
+        glFinish();
+    }
+    for (int i = 0; i < frames; i++) {
+        if (before) before();
+        Clock::time_point start = Clock::now();
+        display_handler();
+        glFinish();
+        times.push_back(elapsed_ms(start));
+    }
+    std::nth_element(times.begin(), times.begin() + frames / 2, times.end());
+    return times[frames / 2];
+}
+
+// Median time of drawing |layers| quads over the window with |texture|
+// repeated |repeats| times across, so every pixel samples it minified
+static double time_texture_fill(GLuint texture, int layers, float repeats, int frames) {
+    glUseProgram(0);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    std::vector<double> times;
+    for (int i = 0; i < frames + 3; i++) {
+        Clock::time_point start = Clock::now();
+        glBegin(GL_QUADS);
+        for (int l = 0; l < layers; l++) {
+            // shifted, so the layers don't hit the same texels
+            float s = l * 0.37f, t = s + repeats;
+            glTexCoord2f(s, s); glVertex2f(-1.0f, -1.0f);
+            glTexCoord2f(t, s); glVertex2f( 1.0f, -1.0f);
+            glTexCoord2f(t, t); glVertex2f( 1.0f,  1.0f);
+            glTexCoord2f(s, t); glVertex2f(-1.0f,  1.0f);
+        }
+        glEnd();
+        glFinish();
+        if (i >= 3) times.push_back(elapsed_ms(start));
+    }
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glEnable(GL_DEPTH_TEST);
+    std::nth_element(times.begin(), times.begin() + frames / 2, times.end());
+    return times[frames / 2];
+}
+
+// Milliseconds a frame of drawing |count| points whose positions change
+// every frame, rewriting one buffer with glBufferSubData - which has to wait
+// for, or copy around, the draw still reading it - or, with |stream|,
+// writing them into the frame's region of the ring. The frames aren't
+// waited for one by one, so the stalls add up
+static double time_vertex_streaming(StreamBuffer *stream, int count, int frames) {
+    size_t bytes = sizeof(glm::vec3) * count;
+    std::vector<glm::vec3> points(stream ? 0 : count);
+    GLuint buffer = 0;
+    if (!stream) {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    }
+    glUseProgram(0);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glFinish();
+    Clock::time_point start = Clock::now();
+    for (int f = 0; f < frames; f++) {
+        glm::vec3 *target;
+        if (stream) {
+            stream->BeginFrame();
+            target = (glm::vec3 *)stream->Map(bytes);
+        } else {
+            target = &points[0];
+        }
+        // a spiral that turns a little every frame
+        for (int i = 0; i < count; i++) {
+            float angle = i * 0.001f + f * 0.01f, radius = (float)i / count;
+            target[i] = glm::vec3(radius * cosf(angle), radius * sinf(angle), 0.0f);
+        }
+        if (stream) {
+            stream->Unmap();
+            glVertexPointer(3, GL_FLOAT, 0, (const void *)stream->Offset());
+        } else {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, target);
+            glVertexPointer(3, GL_FLOAT, 0, 0);
+        }
+        glDrawArrays(GL_POINTS, 0, count);
+        if (stream) stream->EndFrame();
+    }
+    glFinish();
+    double ms = elapsed_ms(start) / frames;
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (buffer) glDeleteBuffers(1, &buffer);
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    return ms;
+}
+
+int run_benchmark(int argc, char **argv) {
+    static const int sizes[] = { 1000, 10000, 100000, 1000000, 10000000 };
+    int max_triangles = argc > 0 ? atoi(argv[0]) : 1000000;
+    const char *output = argc > 1 ? argv[1] : "benchmark.jsonl";
+    const char *obj_path = "benchmark_mesh.obj";
+
+    Results results;
+    results.file = fopen(output, "w");
+    if (!results.file) std::cerr << "couldn't open " << output << std::endl;
+    char line[512];
+    sprintf(line, "{\"renderer\": \"%s\", \"version\": \"%s\", \"max_triangles\": %d}",
+            (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION), max_triangles);
+    results.Line(line);
+    // every texture in place before the frames that need it are timed
+    use_async_loading = false;
+
+    // loading the textures read with fread against mapped and uploaded
+    // through a pixel buffer, with the file cache warm, then with mipmaps
+    const char *textures[2] = { decal, sphere };
+    GLuint texture;
+    glGenTextures(1, &texture);
+    for (int t = 0; t < 2; t++) {
+        const char *modes[4] = { "fread", "mapped_pbo", "mapped_pbo_box_mips", "mapped_pbo_gpu_mips" };
+        const Mipmap_Mode mipmaps[4] = { MIPMAPS_NONE, MIPMAPS_NONE, MIPMAPS_CPU, MIPMAPS_GPU };
+        load_bmp_texture(textures[t], texture, false);
+        for (int m = 0; m < 4; m++) {
+            const int loads = 20;
+            glFinish();
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < loads; i++) load_bmp_texture(textures[t], texture, m > 0, mipmaps[m]);
+            glFinish();
+            results.Record(textures[t], 0, "texture_load", modes[m], elapsed_ms(start) / loads);
+        }
+    }
+
+    // texture bound fill rate: the decal minified 16 times over the window,
+    // 32 layers deep, without and with mipmaps
+    {
+        const char *modes[4] = { "no_mips", "box_mips", "gpu_mips", "box_mips_aniso16" };
+        const Mipmap_Mode mipmaps[4] = { MIPMAPS_NONE, MIPMAPS_CPU, MIPMAPS_GPU, MIPMAPS_CPU };
+        const int layers = 32;
+        double pixels = (double)glutGet(GLUT_WINDOW_WIDTH) * glutGet(GLUT_WINDOW_HEIGHT) * layers;
+        for (int m = 0; m < 4; m++) {
+            load_bmp_texture(decal, texture, true, mipmaps[m]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            set_texture_filtering(mipmaps[m] != MIPMAPS_NONE, m == 3 ? 16.0f : 1.0f);
+            double ms = time_texture_fill(texture, layers, 16.0f, 20);
+            results.RecordRate(decal, 0, "texture_fill", modes[m], pixels / (ms / 1000.0));
+        }
+    }
+
+    // block compression: encoding the textures with their mipmaps on one and
+    // on all threads, loading them back from the cache, the memory they take
+    // against uncompressed ones and the fill rate of the compressed decal
+    {
+        const char *images[3] = { decal, sphere, bump_map3 };
+        const Block_Format formats[3] = { BLOCK_BC1, BLOCK_BC1, BLOCK_BC5 };
+        const char *names[3] = { "bc1", "bc1", "bc5" };
+        for (int t = 0; t < 3; t++) {
+            if (!compressed_textures_supported(formats[t])) continue;
+            std::string cache = dds_cache_path(images[t], formats[t]);
+            char mode[48];
+            for (int threads = 1; threads >= 0; threads--) {
+                remove(cache.c_str());
+                glFinish();
+                Clock::time_point start = Clock::now();
+                load_compressed_texture(images[t], texture, formats[t], true, threads);
+                glFinish();
+                sprintf(mode, "%s_encode_%s", names[t], threads == 1 ? "1_thread" : "threaded");
+                results.Record(images[t], 0, "texture_load", mode, elapsed_ms(start));
+            }
+            const int loads = 20;
+            glFinish();
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < loads; i++) load_compressed_texture(images[t], texture, formats[t], true);
+            glFinish();
+            sprintf(mode, "%s_cached", names[t]);
+            results.Record(images[t], 0, "texture_load", mode, elapsed_ms(start) / loads);
+            results.RecordBytes(images[t], "texture_memory", names[t], texture_bytes(texture));
+            load_bmp_texture(images[t], texture, true, MIPMAPS_CPU);
+            results.RecordBytes(images[t], "texture_memory", "uncompressed", texture_bytes(texture));
+        }
+        if (compressed_textures_supported(BLOCK_BC1)) {
+            const int layers = 32;
+            double pixels = (double)glutGet(GLUT_WINDOW_WIDTH) * glutGet(GLUT_WINDOW_HEIGHT) * layers;
+            load_compressed_texture(decal, texture, BLOCK_BC1, true);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            set_texture_filtering(true, 1.0f);
+            double ms = time_texture_fill(texture, layers, 16.0f, 20);
+            results.RecordRate(decal, 0, "texture_fill", "bc1_box_mips", pixels / (ms / 1000.0));
+        }
+    }
+
+    // switching between the decal, bump and spherical textures as the menu
+    // does: from the texture cache, then with no budget so every switch
+    // loads from disk again
+    {
+        char *cycle[3] = { decal, bump_map3, sphere };
+        const char *modes[2] = { "cached", "uncached" };
+        const size_t budgets[2] = { (size_t)1 << 30, 0 };
+        for (int m = 0; m < 2; m++) {
+            const int switches = 30;
+            texture_cache.SetBudget(budgets[m]);
+            TextureCacheStats before = texture_cache.Stats();
+            glFinish();
+            Clock::time_point start = Clock::now();
+            for (int i = 0; i < switches; i++) setup_texture(cycle[i % 3], &textureID);
+            glFinish();
+            double ms = elapsed_ms(start) / switches;
+            TextureCacheStats stats = texture_cache.Stats();
+            stats.hits -= before.hits;
+            stats.misses -= before.misses;
+            stats.evictions -= before.evictions;
+            results.RecordTextureCache(modes[m], ms, stats);
+        }
+        setup_texture(NULL, &textureID);
+        texture_cache.SetBudget(32 << 20);
+    }
+
+    // the longest a frame waits while a texture nobody has loaded yet is
+    // set up: all of it on this thread, against decoded on the workers and
+    // uploaded from the completions of one frame after another
+    {
+        char *cycle[3] = { decal, bump_map3, sphere };
+        for (int t = 0; t < 3; t++) {
+            for (int async = 0; async < 2; async++) {
+                texture_cache.Clear();
+                use_async_loading = async != 0;
+                glFinish();
+                Clock::time_point start = Clock::now();
+                setup_texture(cycle[t], &textureID);
+                glFinish();
+                double worst = elapsed_ms(start);
+                while (jobs.Pending() > 0) {
+                    Clock::time_point frame = Clock::now();
+                    jobs.RunCompletions(upload_budget_ms);
+                    glFinish();
+                    worst = std::max(worst, elapsed_ms(frame));
+                }
+                results.Record(cycle[t], 0, "texture_stall", async ? "jobs" : "blocking", worst);
+                results.Record(cycle[t], 0, "texture_ready", async ? "jobs" : "blocking", elapsed_ms(start));
+                setup_texture(NULL, &textureID);
+            }
+        }
+        use_async_loading = false;
+    }
+    glDeleteTextures(1, &texture);
+
+    // the shared thread pool under contention, checking every result: a
+    // million single element ranges, ranges that split again inside their
+    // tasks, a graph of random dependencies run in an order that respects
+    // them, and tasks spawned from several threads outside the pool at once
+    {
+        ThreadPool &pool = thread_pool();
+        const int count = 1 << 20;
+        std::atomic<long long> sum(0);
+        long long stolen = pool.Stolen();
+        Clock::time_point start = Clock::now();
+        pool.ParallelFor(0, count, 1, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) sum += i;
+        });
+        results.RecordPool("parallel_for_grain_1", count, elapsed_ms(start),
+                           sum == (long long)count * (count - 1) / 2, pool.Stolen() - stolen, pool.Threads());
+
+        sum = 0;
+        stolen = pool.Stolen();
+        start = Clock::now();
+        pool.ParallelFor(0, 1024, 1, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                pool.ParallelFor(0, 1024, 16, [&](int b, int e) { sum += e - b; });
+            }
+        });
+        results.RecordPool("nested_parallel_for", 1024 * 64, elapsed_ms(start), sum == 1024 * 1024,
+                           pool.Stolen() - stolen, pool.Threads());
+
+        const int nodes = 4096;
+        TaskGraph graph;
+        std::vector<int> finished(nodes, 0);
+        std::atomic<int> clock(0);
+        std::vector< std::pair<int, int> > edges;
+        unsigned int seed = 2017;
+        for (int i = 0; i < nodes; i++) graph.Add([&, i]() { finished[i] = ++clock; });
+        for (int i = 1; i < nodes; i++) {
+            for (int k = 0; k < 3; k++) {
+                seed = seed * 1664525u + 1013904223u;
+                int before = (seed >> 8) % i;
+                graph.Precede(before, i);
+                edges.push_back(std::make_pair(before, i));
+            }
+        }
+        stolen = pool.Stolen();
+        start = Clock::now();
+        graph.Run(pool);
+        double ms = elapsed_ms(start);
+        bool ordered = clock == nodes;
+        for (size_t e = 0; e < edges.size(); e++) ordered = ordered && finished[edges[e].first] < finished[edges[e].second];
+        results.RecordPool("task_graph", nodes, ms, ordered, pool.Stolen() - stolen, pool.Threads());
+
+        const int spawners = 4, rounds = 256, tasks = 64;
+        std::atomic<int> ran(0);
+        std::vector<std::thread> threads;
+        stolen = pool.Stolen();
+        start = Clock::now();
+        for (int t = 0; t < spawners; t++) {
+            threads.push_back(std::thread([&]() {
+                for (int r = 0; r < rounds; r++) {
+                    ThreadPool::Group group;
+                    for (int i = 0; i < tasks; i++) pool.Spawn(group, [&]() { ran++; });
+                    pool.Wait(group);
+                }
+            }));
+        }
+        for (int t = 0; t < spawners; t++) threads[t].join();
+        results.RecordPool("outside_spawners", spawners * rounds * tasks, elapsed_ms(start),
+                           ran == spawners * rounds * tasks, pool.Stolen() - stolen, pool.Threads());
+
+        // scaling from one thread to all of them: block compressing a
+        // 1024 x 1024 image and a loop of square roots
+        const int size = 1024;
+        std::vector<unsigned char> pixels(4 * size * size), blocks(compressed_size(BLOCK_BC1, size, size));
+        for (size_t i = 0; i < pixels.size(); i++) pixels[i] = (unsigned char)((i * 2654435761u) >> 13);
+        std::vector<float> roots(1 << 22);
+        for (int threads = 1; ; threads = std::min(2 * threads, pool.Threads())) {
+            char mode[32];
+            sprintf(mode, "%d_threads", threads);
+            start = Clock::now();
+            compress_image(BLOCK_BC1, &pixels[0], size, size, 4 * size, &blocks[0], threads);
+            results.Record("bc1_1024", 0, "pool_scaling", mode, elapsed_ms(start));
+            start = Clock::now();
+            parallel_for(roots.size(), threads, [&](int begin, int end) {
+                for (int i = begin; i < end; i++) roots[i] = sqrtf((float)i) * sinf((float)i);
+            });
+            results.Record("sqrt_4m", 0, "pool_scaling", mode, elapsed_ms(start));
+            if (threads == pool.Threads()) break;
+        }
+    }
+
+    {
+        // per-frame vertices through one buffer and through the ring
+        const int count = 1 << 18;
+        results.RecordStream("buffer_sub_data", count, time_vertex_streaming(NULL, count, 100), 0);
+        StreamBuffer stream;
+        stream.Init(GL_ARRAY_BUFFER, sizeof(glm::vec3) * count);
+        double ms = time_vertex_streaming(&stream, count, 100);
+        results.RecordStream(stream.Persistent() ? "ring_persistent" : "ring_mapped", count, ms, stream.Waits());
+    }
+
+    if (geometry_pool.Supported()) {
+        // the meshes of the gallery in one multi-draw and one draw each
+        show_gallery = true;
+        // every mesh in the pool before the timing starts
+        setup_gallery();
+        jobs.Drain();
+        for (int batched = 1; batched >= 0; batched--) {
+            use_gallery_batching = batched != 0;
+            double ms = time_frames(20);
+            const char *mode = !batched ? "draw_per_mesh" : geometry_pool.Batches() ? "multi_draw_indirect" : "draw_per_mesh_fallback";
+            results.RecordDraws(mode, gallery_meshes.size(), ms, gallery_draw_calls);
+        }
+        show_gallery = false;
+        use_gallery_batching = true;
+    }
+
+    for (size_t k = 0; k < sizeof(mesh_kinds) / sizeof(mesh_kinds[0]); k++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && sizes[s] <= max_triangles; s++) {
+            const char *name = mesh_kinds[k].name;
+            GeneratedMesh generated;
+            mesh_kinds[k].generate(sizes[s], generated);
+            if (!write_obj(obj_path, generated)) {
+                std::cerr << "couldn't write " << obj_path << std::endl;
+                return 1;
+            }
+            int triangles = generated.TriangleCount();
+            generated = GeneratedMesh();
+
+            trig = TriangleMesh();
+            long long allocations = allocations_made();
+            Clock::time_point start = Clock::now();
+            trig.LoadFile((char *)obj_path);
+            results.Record(name, triangles, "load", "", elapsed_ms(start));
+            results.RecordMemory(name, triangles, "load", allocations_since(allocations), peak_resident_bytes());
+
+            start = Clock::now();
+            trig.Optimize();
+            results.Record(name, triangles, "optimize", "", elapsed_ms(start));
+            results.RecordCache(name, triangles, "before", trig.StatsBefore());
+            results.RecordCache(name, triangles, "after", trig.StatsAfter());
+
+            start = Clock::now();
+            trig.BuildLods();
+            results.Record(name, triangles, "lods", "", elapsed_ms(start));
+
+            start = Clock::now();
+            trig.BuildMeshlets();
+            results.Record(name, triangles, "meshlets", "", elapsed_ms(start));
+
+            // the hierarchy the application picks with
+            Bvh &bvh = mesh_bvh;
+            start = Clock::now();
+            bvh.Build(trig.Vertices(), 1);
+            results.Record(name, triangles, "bvh_build", "1_thread", elapsed_ms(start));
+            start = Clock::now();
+            bvh.Build(trig.Vertices());
+            results.Record(name, triangles, "bvh_build", "threaded", elapsed_ms(start));
+
+            std::vector<Ray> rays;
+            make_rays(trig.BoundsCenter(), trig.BoundsRadius(), 1 << 18, rays);
+            RayHit hits[4];
+            int hit_count = 0;
+            start = Clock::now();
+            for (size_t r = 0; r < rays.size(); r++) hit_count += bvh.Intersect(rays[r], hits[0]);
+            results.RecordRate(name, triangles, "rays", "single", rays.size() / elapsed_ms(start) * 1000.0);
+            start = Clock::now();
+            for (size_t r = 0; r + 4 <= rays.size(); r += 4) {
+                bvh.Intersect4(&rays[r], hits);
+                for (int h = 0; h < 4; h++) hit_count -= hits[h].triangle >= 0;
+            }
+            results.RecordRate(name, triangles, "rays", "packet", rays.size() / elapsed_ms(start) * 1000.0);
+            // both ways must find the same hits
+            if (hit_count != 0) std::cerr << "single and packet rays disagree on " << name << std::endl;
+
+            start = Clock::now();
+            trig.ComputeNormals(false);
+            results.Record(name, triangles, "normals", "flat", elapsed_ms(start));
+            allocations = allocations_made();
+            start = Clock::now();
+            trig.ComputeNormals(true);
+            results.Record(name, triangles, "normals", "smoothed", elapsed_ms(start));
+            results.RecordMemory(name, triangles, "normals", allocations_since(allocations), peak_resident_bytes());
+
+            // through a copy handed to glBufferSubData, then straight into
+            // the mapped buffers, which is how the application uploads
+            for (int mapped = 0; mapped < 2; mapped++) {
+                use_buffer_mapping = mapped != 0;
+                start = Clock::now();
+                setup_vertex_position_buffer_object();
+                setup_vertex_uv_buffer_object();
+                glFinish();
+                results.Record(name, triangles, "upload", mapped ? "mapped" : "copied", elapsed_ms(start));
+            }
+
+            int frames = triangles >= 1000000 ? 10 : 50;
+            for (size_t m = 0; m < sizeof(render_modes) / sizeof(render_modes[0]); m++) {
+                render_modes[m].menu(render_modes[m].id);
+                results.Record(name, triangles, "draw", render_modes[m].name, time_frames(frames));
+            }
+
+            // every level of detail, drawn with the last render mode
+            for (size_t l = 0; l < trig.Lods().size(); l++) {
+                char mode[32];
+                sprintf(mode, "lod%d_%d", (int)l, (int)trig.Lods()[l].count / 3);
+                forced_lod = l;
+                results.Record(name, triangles, "draw", mode, time_frames(frames));
+            }
+            forced_lod = -1;
+
+            // the last render mode again, without culling the meshlets
+            use_meshlet_culling = false;
+            results.Record(name, triangles, "draw", "unculled", time_frames(frames));
+            use_meshlet_culling = true;
+
+            // clicks spread over the window as last drawn, one at a time
+            int width = glutGet(GLUT_WINDOW_WIDTH), height = glutGet(GLUT_WINDOW_HEIGHT);
+            glm::vec3 position;
+            start = Clock::now();
+            for (int y = 0; y < 32; y++) {
+                for (int x = 0; x < 32; x++) pick_triangle(x * width / 32, y * height / 32, hits[0], position);
+            }
+            results.Record(name, triangles, "pick", "", elapsed_ms(start) / (32 * 32));
+
+            // phong shading with the shadow map redrawn every frame, as if
+            // the light or the mesh kept moving
+            menu1(3);
+            results.Record(name, triangles, "draw", "phong_shadow_every_frame", time_frames(frames, invalidate_shadow_map));
+
+            // many lights: sorting them into clusters on one and on all
+            // threads, and drawing with them
+            if (light_clusters.Supported()) {
+                static const int light_counts[] = { 64, 1024, 8192 };
+                menu1(4);
+                for (size_t c = 0; c < sizeof(light_counts) / sizeof(light_counts[0]); c++) {
+                    char mode[32];
+                    light_count = light_counts[c];
+                    place_lights();
+                    sprintf(mode, "%d_lights_1_thread", light_count);
+                    start = Clock::now();
+                    assign_lights(1);
+                    results.Record(name, triangles, "light_assign", mode, elapsed_ms(start));
+                    sprintf(mode, "%d_lights_threaded", light_count);
+                    start = Clock::now();
+                    assign_lights(0);
+                    results.Record(name, triangles, "light_assign", mode, elapsed_ms(start));
+                    sprintf(mode, "clustered_%d_lights", light_count);
+                    results.Record(name, triangles, "draw", mode, time_frames(frames));
+                }
+            }
+
+            // forward against deferred phong as copies of the mesh pile up:
+            // forward shades every layer, deferred only the one in front
+            if (gbuffer.Supported()) {
+                static const int layer_counts[] = { 1, 2, 4, 8 };
+                menu1(3);
+                for (size_t c = 0; c < sizeof(layer_counts) / sizeof(layer_counts[0]); c++) {
+                    char mode[32];
+                    mesh_layers = layer_counts[c];
+                    sprintf(mode, "forward_phong_x%d", mesh_layers);
+                    results.Record(name, triangles, "draw", mode, time_frames(frames));
+                    use_deferred = true;
+                    sprintf(mode, "deferred_phong_x%d", mesh_layers);
+                    results.Record(name, triangles, "draw", mode, time_frames(frames));
+                    use_deferred = false;
+                }
+                mesh_layers = 1;
+            }
+
+            // phong and bump mapping with and without the depth pre-pass,
+            // and the fragments they shade per pixel, as layers pile up
+            static const int prepass_layers[] = { 1, 4 };
+            count_overdraw = true;
+            for (int m = 0; m < 2; m++) {
+                if (m == 0) menu1(3); else menu2(2);
+                for (size_t c = 0; c < sizeof(prepass_layers) / sizeof(prepass_layers[0]); c++) {
+                    mesh_layers = prepass_layers[c];
+                    for (int prepass = 0; prepass < 2; prepass++) {
+                        char mode[48];
+                        use_depth_prepass = prepass == 1;
+                        sprintf(mode, "%s%s_x%d", m == 0 ? "phong" : "bump", prepass ? "_prepass" : "", mesh_layers);
+                        results.Record(name, triangles, "draw", mode, time_frames(frames));
+                        results.RecordOverdraw(name, triangles, mode, overdraw);
+                    }
+                }
+            }
+            use_depth_prepass = false;
+            count_overdraw = false;
+            mesh_layers = 1;
+        }
+    }
+
+    remove(obj_path);
+    if (results.file) fclose(results.file);
+    return 0;
+}
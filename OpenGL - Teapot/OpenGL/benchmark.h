@@ -0,0 +1,56 @@
+#ifndef _benchmark_H
+#define _benchmark_H
+
+/**
+ * Run the rendering benchmarks and return the process exit code
+ * Needs a current OpenGL context with GLEW initialised
+ *
+ * First it times loading the ``bmp`` textures read with ``fread`` and
+ * mapped into memory (see load_bmp_texture), with and without mipmaps, and
+ * the pixels per second a minified texture fills without mipmaps, with them
+ * and with anisotropic filtering. The same for block compressed textures
+ * (see load_compressed_texture), with the time to encode them on one and on
+ * all threads and the memory they save, and switching textures with and
+ * without the texture cache (see TextureCache), and the longest a frame waits
+ * for a texture loaded on this thread or on the workers (see JobSystem).
+ * The shared ThreadPool is checked under contention - parallel ranges,
+ * nested ones, a task graph and spawning from several threads, each result
+ * verified - and timed from one to all threads. Vertices that change every
+ * frame are streamed through one buffer and through a StreamBuffer ring,
+ * with how often the ring waited for the GPU. The gallery of generated
+ * meshes in one GeometryPool is drawn in one multi-draw call and in one
+ * call per mesh, with the draw calls each made. Then for every generated mesh
+ * (sphere, torus, teapot) and size from 1k up to |argv[0]| triangles
+ * (default 1M, at most 10M) it times
+ * - loading the mesh from an ``obj`` file, with the heap allocations it
+ *   makes and the peak resident memory of the process after it
+ * - optimizing it for the vertex cache and overdraw, with the ACMR and ATVR
+ *   before and after
+ * - computing flat and smoothed normals, with the heap allocations of the
+ *   smoothed ones
+ * - uploading the vertex buffers through a copy and mapped (see write_buffer)
+ * - building the levels of detail and their meshlets
+ * - building a ray tracing hierarchy (see Bvh) on one and on all threads,
+ *   and the rays per second it intersects one at a time and in packets
+ * - picking the triangle under the cursor (see pick_triangle)
+ * - drawing a frame with each of the render modes of the menus, with each
+ *   level of detail and without meshlet culling, and with phong shading
+ *   redrawing the shadow map every frame
+ * - sorting 64 to 8192 point lights into clusters on one and on all threads,
+ *   and drawing with them (see LightClusters)
+ * - phong shading forward and deferred (see GBuffer) with 1 to 8 copies of
+ *   the mesh stacked in front of each other
+ * - phong shading and bump mapping with and without the depth pre-pass, and
+ *   the overdraw of each (see OverdrawCounter)
+ *
+ * The heap allocations are only counted in builds that define
+ * ``BENCHMARK_ALLOCATIONS`` - the Benchmark configuration of the project -
+ * which replaces the global ``operator new`` of the whole program; the
+ * Debug and Release builds write them as null.
+ *
+ * One JSON object per measurement is written to |argv[1]| (default
+ * ``benchmark.jsonl``) and echoed on standard output
+ */
+int run_benchmark(int argc, char **argv);
+
+#endif
@@ -0,0 +1,265 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <iostream>
+
+#include "bmp_loader.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+// sizes of the file header and of the smallest info header
+static const size_t FILE_HEADER_SIZE = 14;
+static const size_t INFO_HEADER_SIZE = 40;
+
+// compression types
+static const unsigned int BI_RGB = 0;
+static const unsigned int BI_BITFIELDS = 3;
+static const unsigned int BI_ALPHABITFIELDS = 6;
+
+// little endian integers, read a byte at a time so they needn't be aligned
+static unsigned int le16(const unsigned char *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+bool parse_bmp(const unsigned char *data, size_t size, BmpInfo &info, std::string &error) {
+    if (size < FILE_HEADER_SIZE + 12 || data[0] != 'B' || data[1] != 'M') {
+        error = "not a bmp file";
+        return false;
+    }
+    size_t header_size = le32(data + 14);
+    if (FILE_HEADER_SIZE + header_size > size) {
+        error = "truncated header";
+        return false;
+    }
+    const unsigned char *header = data + FILE_HEADER_SIZE;
+    long long width, height;
+    unsigned int planes, compression;
+    if (header_size == 12) {
+        // BITMAPCOREHEADER: 16 bit unsigned sizes, always bottom-up
+        width = le16(header + 4);
+        height = le16(header + 6);
+        planes = le16(header + 8);
+        info.bits_per_pixel = le16(header + 10);
+        compression = BI_RGB;
+    } else if (header_size == 40 || header_size == 52 || header_size == 56 || header_size == 108 || header_size == 124) {
+        // BITMAPINFOHEADER and its extensions, V2 to V5
+        width = (int)le32(header + 4);
+        height = (int)le32(header + 8);
+        planes = le16(header + 12);
+        info.bits_per_pixel = le16(header + 14);
+        compression = le32(header + 16);
+    } else {
+        error = "unknown header version";
+        return false;
+    }
+    if (planes != 1) {
+        error = "invalid plane count";
+        return false;
+    }
+
+    info.has_alpha = false;
+    if (info.bits_per_pixel == 24 && compression == BI_RGB) {
+        // blue, green, red
+    } else if (info.bits_per_pixel == 32 && compression == BI_RGB) {
+        // blue, green, red and a padding byte
+    } else if (info.bits_per_pixel == 32 && (compression == BI_BITFIELDS || compression == BI_ALPHABITFIELDS)) {
+        // the masks end the info header from V2 on, else follow it
+        size_t masks = FILE_HEADER_SIZE + INFO_HEADER_SIZE;
+        size_t mask_count = header_size >= 56 || compression == BI_ALPHABITFIELDS ? 4 : 3;
+        if (masks + 4 * mask_count > size) {
+            error = "truncated bit fields";
+            return false;
+        }
+        unsigned int alpha = mask_count == 4 ? le32(data + masks + 12) : 0;
+        if (le32(data + masks) != 0x00FF0000 || le32(data + masks + 4) != 0x0000FF00 ||
+            le32(data + masks + 8) != 0x000000FF || (alpha != 0 && alpha != 0xFF000000)) {
+            error = "unsupported bit fields, only BGRA is";
+            return false;
+        }
+        info.has_alpha = alpha != 0;
+    } else {
+        error = "unsupported pixel format, only 24 and 32 bit uncompressed are";
+        return false;
+    }
+
+    // a negative height stores the rows from the top
+    info.top_down = height < 0;
+    if (height < 0) height = -height;
+    if (width <= 0 || height == 0 || width > 65536 || height > 65536) {
+        error = "invalid size";
+        return false;
+    }
+    info.width = (int)width;
+    info.height = (int)height;
+    info.row_size = ((size_t)width * info.bits_per_pixel + 31) / 32 * 4;
+
+    // files whose offset points into the headers get their pixels right
+    // after them, as the old loader did for an offset of 0
+    info.data_offset = le32(data + 10);
+    if (info.data_offset < FILE_HEADER_SIZE + header_size) info.data_offset = FILE_HEADER_SIZE + header_size;
+    // divided rather than multiplied, which could wrap around on 32 bits
+    if (info.row_size == 0 || info.data_offset > size ||
+        (size_t)info.height > (size - info.data_offset) / info.row_size) {
+        error = "truncated pixel data";
+        return false;
+    }
+    return true;
+}
+
+// OpenGL formats of |info|'s pixels
+static void texture_formats(const BmpInfo &info, GLint &internal_format, GLenum &format) {
+    internal_format = info.has_alpha ? GL_RGBA8 : GL_RGB8;
+    format = info.bits_per_pixel == 32 ? GL_BGRA : GL_BGR;
+}
+
+// fill the bound texture from |pixels| in client memory, laid out as |info|
+static void upload_from_memory(const BmpInfo &info, const unsigned char *pixels) {
+    GLint internal_format;
+    GLenum format;
+    texture_formats(info, internal_format, format);
+    if (!info.top_down) {
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, info.width, info.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+        return;
+    }
+    // OpenGL starts from the bottom row
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, info.width, info.height, 0, format, GL_UNSIGNED_BYTE, NULL);
+    for (int y = 0; y < info.height; y++) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, info.height - 1 - y, info.width, 1, format, GL_UNSIGNED_BYTE,
+                        pixels + y * info.row_size);
+    }
+}
+
+// fill the bound texture through a pixel buffer object, copying |pixels| into
+// it bottom row first
+static void upload_through_buffer(const BmpInfo &info, const unsigned char *pixels) {
+    size_t image_size = info.row_size * info.height;
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, image_size, NULL, GL_STREAM_DRAW);
+    unsigned char *target = (unsigned char *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    if (target == NULL) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        upload_from_memory(info, pixels);
+        return;
+    }
+    if (info.top_down) {
+        for (int y = 0; y < info.height; y++) {
+            memcpy(target + (info.height - 1 - y) * info.row_size, pixels + y * info.row_size, info.row_size);
+        }
+    } else {
+        memcpy(target, pixels, image_size);
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    GLint internal_format;
+    GLenum format;
+    texture_formats(info, internal_format, format);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, info.width, info.height, 0, format, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    // the driver keeps the buffer alive until the copy is done
+    glDeleteBuffers(1, &buffer);
+}
+
+bool load_bmp_texture(const char *path, GLuint texture, bool mapped, Mipmap_Mode mipmaps) {
+    MappedFile file;
+    std::vector<unsigned char> contents;
+    const unsigned char *data;
+    size_t size;
+    if (mapped) {
+        if (!file.Open(path)) {
+            std::cerr << "couldn't open image " << path << std::endl;
+            return false;
+        }
+        data = file.Data();
+        size = file.Size();
+    } else {
+        FILE *stream = fopen(path, "rb");
+        if (!stream) {
+            std::cerr << "couldn't open image " << path << std::endl;
+            return false;
+        }
+        fseek(stream, 0, SEEK_END);
+        long length = ftell(stream);
+        fseek(stream, 0, SEEK_SET);
+        contents.resize(length > 0 ? length : 0);
+        size = contents.empty() ? 0 : fread(&contents[0], 1, contents.size(), stream);
+        fclose(stream);
+        data = contents.empty() ? NULL : &contents[0];
+    }
+
+    BmpInfo info;
+    std::string error;
+    if (!parse_bmp(data, size, info, error)) {
+        std::cerr << path << ": " << error << std::endl;
+        return false;
+    }
+    // bmp rows are padded to 4 bytes, as OpenGL expects by default
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    const unsigned char *pixels = data + info.data_offset;
+    if (mapped) {
+        upload_through_buffer(info, pixels);
+    } else {
+        upload_from_memory(info, pixels);
+    }
+
+    // the smaller levels, from the bottom row up as level 0 is stored
+    GLint internal_format;
+    GLenum format;
+    texture_formats(info, internal_format, format);
+    ptrdiff_t stride = info.row_size;
+    if (info.top_down) {
+        pixels += (info.height - 1) * info.row_size;
+        stride = -stride;
+    }
+    build_mipmaps(mipmaps, pixels, stride, info.width, info.height, internal_format, format);
+    return true;
+}
+
+bool read_bmp_image(const char *path, BgraImage &image) {
+    MappedFile file;
+    BmpInfo info;
+    std::string error;
+    if (!file.Open(path)) {
+        std::cerr << "couldn't open image " << path << std::endl;
+        return false;
+    }
+    if (!parse_bmp(file.Data(), file.Size(), info, error)) {
+        std::cerr << path << ": " << error << std::endl;
+        return false;
+    }
+    int width = info.width, height = info.height, bytes = info.bits_per_pixel / 8;
+    image.width = width;
+    image.height = height;
+    image.has_alpha = info.has_alpha;
+    image.pixels.resize(4 * width * height);
+    const unsigned char *data = file.Data();
+    parallel_for(height, 0, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            const unsigned char *row = data + info.data_offset + (info.top_down ? height - 1 - y : y) * info.row_size;
+            unsigned char *out = &image.pixels[4 * width * y];
+            for (int x = 0; x < width; x++) {
+                out[4 * x] = row[bytes * x];
+                out[4 * x + 1] = row[bytes * x + 1];
+                out[4 * x + 2] = row[bytes * x + 2];
+                out[4 * x + 3] = info.has_alpha ? row[bytes * x + 3] : 255;
+            }
+        }
+    }, 64);
+    return true;
+}
+
+void upload_bgra_image(const BgraImage &image, GLuint texture, Mipmap_Mode mipmaps) {
+    GLint internal_format = image.has_alpha ? GL_RGBA8 : GL_RGB8;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image.width, image.height, 0, GL_BGRA, GL_UNSIGNED_BYTE,
+                 &image.pixels[0]);
+    build_mipmaps(mipmaps, &image.pixels[0], 4 * image.width, image.width, image.height, internal_format, GL_BGRA);
+}
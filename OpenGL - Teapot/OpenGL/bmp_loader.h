@@ -0,0 +1,65 @@
+#ifndef _bmp_loader_H
+#define _bmp_loader_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <GL/glew.h>
+
+#include "mipmaps.h"
+
+/** Where the pixels of a ``bmp`` file are and how they are laid out **/
+struct BmpInfo {
+    int width, height;
+    int bits_per_pixel;  // 24 (BGR) or 32 (BGRA)
+    bool top_down;       // rows stored from the top instead of the bottom
+    bool has_alpha;      // 32 bits with an alpha channel, not just padding
+    size_t data_offset;  // of the first stored row from the start of the file
+    size_t row_size;     // bytes per stored row, padded to 4
+};
+
+/** An image decoded to BGRA, from the bottom row up as OpenGL counts them **/
+struct BgraImage {
+    int width, height;
+    bool has_alpha;
+    std::vector<unsigned char> pixels;
+};
+
+/**
+ * Read the headers of the ``bmp`` file of |size| bytes at |data| into |info|
+ *
+ * Accepts the core (OS/2) header and the info headers of version 1 to 5, rows
+ * stored bottom-up or top-down, uncompressed 24 bit pixels and 32 bit pixels
+ * either uncompressed or with the standard BGRA bit fields. Returns false
+ * with the reason in |error| for anything else - palettes, 16 bit and RLE
+ * included - and for files too short for the pixels they announce.
+ */
+bool parse_bmp(const unsigned char *data, size_t size, BmpInfo &info, std::string &error);
+
+/**
+ * Load the ``bmp`` file at |path| into level 0 of |texture|, and the levels
+ * below it as |mipmaps| says (see build_mipmaps), leaving it bound to
+ * ``GL_TEXTURE_2D``
+ *
+ * With |mapped| the file is mapped into memory (see MappedFile) and copied
+ * once, into a pixel buffer object the texture is filled from; top-down rows
+ * are put in order during that copy. Otherwise it is read with ``fread`` into
+ * a temporary buffer, for comparison. Either way no memory is kept once it
+ * returns. Errors are reported on standard error and return false.
+ */
+bool load_bmp_texture(const char *path, GLuint texture, bool mapped = true, Mipmap_Mode mipmaps = MIPMAPS_NONE);
+
+/**
+ * Decode the ``bmp`` file at |path| into |image| without touching OpenGL,
+ * so it can be done on any thread. Errors are reported on standard error
+ * and return false
+ */
+bool read_bmp_image(const char *path, BgraImage &image);
+
+/**
+ * Fill |texture| from |image| with the levels |mipmaps| says, leaving it
+ * bound to ``GL_TEXTURE_2D``
+ */
+void upload_bgra_image(const BgraImage &image, GLuint texture, Mipmap_Mode mipmaps);
+
+#endif
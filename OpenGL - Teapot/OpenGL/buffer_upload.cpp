@@ -0,0 +1,25 @@
+#include <vector>
+
+#include "buffer_upload.h"
+
+bool buffer_mapping_supported(void) {
+    return GLEW_VERSION_3_0 || GLEW_ARB_map_buffer_range;
+}
+
+void write_buffer(GLenum target, size_t offset, size_t bytes, const std::function<void(void *)> &fill,
+                  bool map) {
+    if (bytes == 0) return;
+    if (map && buffer_mapping_supported()) {
+        void *memory = glMapBufferRange(target, offset, bytes,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (memory != NULL) {
+            fill(memory);
+            // false if the contents were lost while mapped, e.g. on a mode
+            // switch; then they're written again below
+            if (glUnmapBuffer(target)) return;
+        }
+    }
+    std::vector<unsigned char> copy(bytes);
+    fill(&copy[0]);
+    glBufferSubData(target, offset, bytes, &copy[0]);
+}
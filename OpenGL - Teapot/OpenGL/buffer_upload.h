@@ -0,0 +1,25 @@
+#ifndef _buffer_upload_H
+#define _buffer_upload_H
+
+#include <cstddef>
+#include <functional>
+#include <GL/glew.h>
+
+/** Whether buffers can be mapped in ranges, without waiting for the GPU **/
+bool buffer_mapping_supported(void);
+
+/**
+ * Fill |bytes| of the buffer bound to |target|, from |offset| on, by
+ * calling |fill| with where to write them
+ *
+ * With |map| set, where supported, that is the buffer itself, mapped with
+ * ``glMapBufferRange`` to be written once without the driver keeping the
+ * old contents or synchronizing with the GPU - so the range must not be in
+ * use by draws still in flight: freshly allocated with glBufferData, or
+ * beyond anything drawn so far. Otherwise |fill| writes a temporary copy
+ * that is handed to ``glBufferSubData``.
+ */
+void write_buffer(GLenum target, size_t offset, size_t bytes, const std::function<void(void *)> &fill,
+                  bool map = true);
+
+#endif
@@ -0,0 +1,186 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "compressed_texture.h"
+#include "MappedFile.h"
+#include "bmp_loader.h"
+#include "mipmaps.h"
+
+static const size_t DDS_HEADER_SIZE = 128;
+
+// the FourCC, OpenGL format and file name suffix of every Block_Format
+static const char *FOURCCS[3] = { "DXT1", "DXT5", "ATI2" };
+static const GLenum GL_FORMATS[3] = {
+    GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RG_RGTC2
+};
+static const char *SUFFIXES[3] = { ".bc1.dds", ".bc3.dds", ".bc5.dds" };
+
+static void put_le32(unsigned char *out, unsigned int value) {
+    for (int i = 0; i < 4; i++) out[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static unsigned int le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+bool compressed_textures_supported(Block_Format format) {
+    if (format == BLOCK_BC5) return GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc;
+    return GLEW_EXT_texture_compression_s3tc != 0;
+}
+
+std::string dds_cache_path(const char *path, Block_Format format) {
+    std::string cache = path;
+    size_t dot = cache.find_last_of('.');
+    if (dot != std::string::npos && cache.find_first_of("/\\", dot) == std::string::npos) cache.erase(dot);
+    return cache + SUFFIXES[format];
+}
+
+bool write_dds(const char *path, Block_Format format, int width, int height,
+               const std::vector< std::vector<unsigned char> > &levels) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+    unsigned char header[DDS_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, "DDS ", 4);
+    put_le32(header + 4, 124);
+    // caps, height, width, pixel format, linear size and the mipmap count
+    put_le32(header + 8, 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000 | (levels.size() > 1 ? 0x20000 : 0));
+    put_le32(header + 12, height);
+    put_le32(header + 16, width);
+    put_le32(header + 20, levels[0].size());
+    put_le32(header + 28, levels.size());
+    // the pixel format, by its FourCC
+    put_le32(header + 76, 32);
+    put_le32(header + 80, 0x4);
+    memcpy(header + 84, FOURCCS[format], 4);
+    // a texture, with mipmaps if there are several levels
+    put_le32(header + 108, 0x1000 | (levels.size() > 1 ? 0x8 | 0x400000 : 0));
+    bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    for (size_t level = 0; level < levels.size() && written; level++) {
+        written = fwrite(&levels[level][0], 1, levels[level].size(), file) == levels[level].size();
+    }
+    fclose(file);
+    return written;
+}
+
+// seconds since the epoch the file at |path| was last changed, -1 if none
+static long long modified_time(const char *path) {
+    struct stat info;
+    if (stat(path, &info) != 0) return -1;
+    return (long long)info.st_mtime;
+}
+
+// upload |levels| levels of a |width| x |height| image in |format| into the
+// bound texture, the one at |data| after another or, without |data|, from
+// |separate|
+static void upload_levels(Block_Format format, int width, int height, int levels, const unsigned char *data,
+                          const std::vector< std::vector<unsigned char> > *separate = NULL) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    for (int level = 0; level < levels; level++) {
+        size_t size = compressed_size(format, width, height);
+        if (separate) data = &(*separate)[level][0];
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_FORMATS[format], width, height, 0, size, data);
+        data += size;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+}
+
+// upload the cache at |path| if it holds |levels| levels of |format| (all of
+// them if 0) into the bound texture, or with |image| copy them there instead
+static bool read_dds(const char *path, Block_Format format, int levels, CompressedImage *image = NULL) {
+    MappedFile file;
+    if (!file.Open(path) || file.Size() < DDS_HEADER_SIZE) return false;
+    const unsigned char *header = file.Data();
+    if (memcmp(header, "DDS ", 4) != 0 || le32(header + 4) != 124 || memcmp(header + 84, FOURCCS[format], 4) != 0) {
+        return false;
+    }
+    int height = le32(header + 12), width = le32(header + 16);
+    int count = std::max(1, (int)le32(header + 28));
+    if (width <= 0 || height <= 0 || width > 65536 || height > 65536) return false;
+    if (count != (levels == 1 ? 1 : mip_level_count(width, height))) return false;
+    size_t size = 0;
+    for (int level = 0, w = width, h = height; level < count; level++, w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+        size += compressed_size(format, w, h);
+    }
+    if (file.Size() - DDS_HEADER_SIZE < size) return false;
+    if (image == NULL) {
+        upload_levels(format, width, height, count, file.Data() + DDS_HEADER_SIZE);
+        return true;
+    }
+    image->format = format;
+    image->width = width;
+    image->height = height;
+    image->levels.resize(count);
+    const unsigned char *data = file.Data() + DDS_HEADER_SIZE;
+    for (int level = 0, w = width, h = height; level < count; level++, w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+        image->levels[level].assign(data, data + compressed_size(format, w, h));
+        data += compressed_size(format, w, h);
+    }
+    return true;
+}
+
+// compress the image at |path| into |image| and cache it at |cache|
+static bool compress_bmp(const char *path, const std::string &cache, Block_Format format, bool mipmaps,
+                         CompressedImage &image, int threads) {
+    BgraImage bgra;
+    if (!read_bmp_image(path, bgra)) return false;
+    std::vector<unsigned char> &pixels = bgra.pixels;
+    int width = bgra.width, height = bgra.height;
+
+    // every level halved from the one before, then compressed
+    int levels = mipmaps ? mip_level_count(width, height) : 1;
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    image.levels.assign(levels, std::vector<unsigned char>());
+    std::vector<unsigned char> half;
+    for (int level = 0, w = width, h = height; level < levels; level++) {
+        image.levels[level].resize(compressed_size(format, w, h));
+        compress_image(format, &pixels[0], w, h, 4 * w, &image.levels[level][0], threads);
+        if (level + 1 == levels) break;
+        int half_width = std::max(1, w / 2), half_height = std::max(1, h / 2);
+        half.resize(4 * half_width * half_height);
+        downsample_box(&pixels[0], 4 * w, w, h, 4, &half[0], 4 * half_width);
+        pixels.swap(half);
+        w = half_width;
+        h = half_height;
+    }
+    if (!write_dds(cache.c_str(), format, width, height, image.levels)) {
+        std::cerr << "couldn't write " << cache << std::endl;
+    }
+    return true;
+}
+
+bool load_compressed_texture(const char *path, GLuint texture, Block_Format format, bool mipmaps, int threads) {
+    if (!compressed_textures_supported(format)) return false;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    std::string cache = dds_cache_path(path, format);
+    long long image_time = modified_time(path), cache_time = modified_time(cache.c_str());
+    if (cache_time >= 0 && cache_time >= image_time && read_dds(cache.c_str(), format, mipmaps ? 0 : 1)) return true;
+
+    CompressedImage image;
+    if (!compress_bmp(path, cache, format, mipmaps, image, threads)) return false;
+    upload_compressed_texture(image, texture);
+    return true;
+}
+
+bool decode_compressed_texture(const char *path, Block_Format format, bool mipmaps, CompressedImage &image,
+                               int threads) {
+    std::string cache = dds_cache_path(path, format);
+    long long image_time = modified_time(path), cache_time = modified_time(cache.c_str());
+    if (cache_time >= 0 && cache_time >= image_time && read_dds(cache.c_str(), format, mipmaps ? 0 : 1, &image)) {
+        return true;
+    }
+    return compress_bmp(path, cache, format, mipmaps, image, threads);
+}
+
+void upload_compressed_texture(const CompressedImage &image, GLuint texture) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    upload_levels(image.format, image.width, image.height, image.levels.size(), NULL, &image.levels);
+}
@@ -0,0 +1,60 @@
+#ifndef _compressed_texture_H
+#define _compressed_texture_H
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+#include "texture_compressor.h"
+
+/** The levels of an image compressed in |format|, the largest first **/
+struct CompressedImage {
+    Block_Format format;
+    int width, height;
+    std::vector< std::vector<unsigned char> > levels;
+};
+
+/** Whether the driver can sample textures block compressed in |format| **/
+bool compressed_textures_supported(Block_Format format);
+
+/**
+ * Where the compressed copy of the image at |path| is cached: next to it,
+ * with the format in the name - ``res/texture_map.bc1.dds``
+ */
+std::string dds_cache_path(const char *path, Block_Format format);
+
+/**
+ * Write |levels|, the compressed mipmaps of a |width| x |height| image from
+ * the largest on, as a ``dds`` file with a DXT1, DXT5 or ATI2 (BC5) FourCC
+ * The blocks are in the bottom-up row order of OpenGL textures, not the
+ * top-down order of other ``dds`` files
+ */
+bool write_dds(const char *path, Block_Format format, int width, int height,
+               const std::vector< std::vector<unsigned char> > &levels);
+
+/**
+ * Load the ``bmp`` file at |path| into |texture| compressed in |format|, with
+ * all its mipmaps if |mipmaps|, leaving it bound to ``GL_TEXTURE_2D``
+ *
+ * A cached ``dds`` file (see dds_cache_path) newer than the image with the
+ * same format and levels is uploaded straight from its mapping. Otherwise
+ * the image is mipmapped with a box filter, compressed on up to |threads|
+ * threads (all there are if 0) and cached for the next time. Returns false,
+ * leaving the texture as it was, where the format isn't supported or the
+ * image can't be read
+ */
+bool load_compressed_texture(const char *path, GLuint texture, Block_Format format, bool mipmaps, int threads = 0);
+
+/**
+ * What load_compressed_texture does short of uploading: read the cached
+ * ``dds`` file or compress and cache the image, into |image|. Doesn't touch
+ * OpenGL, so it can run on any thread; the format isn't checked against the
+ * driver
+ */
+bool decode_compressed_texture(const char *path, Block_Format format, bool mipmaps, CompressedImage &image,
+                               int threads = 0);
+
+/** Fill |texture| with |image|, leaving it bound to ``GL_TEXTURE_2D`` **/
+void upload_compressed_texture(const CompressedImage &image, GLuint texture);
+
+#endif
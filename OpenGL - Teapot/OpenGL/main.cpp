@@ -6,6 +6,10 @@
 
 #include <vector>
 #include <map>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
 #include <GL/glew.h>
 #include <GL/glut.h>
 #include <glm/glm.hpp>
@@ -17,6 +21,24 @@
 #include "utils.h"           // generic helper functions
 #include "scene_constants.h" // material and light properties
 #include "path_to_files.h"   // paths to textures and shaders
+#include "FrameCapture.h"    // recording frames to disk
+#include "Profiler.h"        // frame timing
+#include "benchmark.h"       // rendering benchmarks
+#include "MeshStream.h"      // background model loading
+#include "Bvh.h"             // ray casting for picking
+#include "ShadowMap.h"       // shadows of the light
+#include "LightClusters.h"   // many point lights
+#include "GBuffer.h"         // deferred shading
+#include "OverdrawCounter.h" // fragments shaded per pixel
+#include "bmp_loader.h"      // texture loading
+#include "compressed_texture.h" // block compressed textures
+#include "TextureCache.h"    // textures shared between modes
+#include "JobSystem.h"       // background loading
+#include "ThreadPool.h"      // parallel work
+#include "buffer_upload.h"   // writing straight into buffers
+#include "StreamBuffer.h"    // per-frame data
+#include "GeometryPool.h"    // many meshes in few draws
+#include "mesh_generator.h"  // the meshes of the gallery
 
 TriangleMesh trig;
 Shader shader;
@@ -25,6 +47,8 @@ glm::mat4 projectionMatrix, viewMatrix, modelMatrix;
 glm::mat3 normalMatrix;
 
 GLuint vertex_position_buffer, vertex_normal_buffer, vertex_uv_buffer;
+GLuint vertex_index_buffer;
+bool use_buffer_mapping = true;
 GLuint textureID;
 
 int useTexture = 0;
@@ -34,13 +58,480 @@ char *fragmentshader_path = NULL;
 char *texture_path = NULL;
 bool use_smoothed_normals = false;
 
+FrameCapture capture;
+Profiler profiler;
+bool show_profile = false;
+
+int forced_lod = -1;
+float lod_error_pixels = 1.0f;
+
+bool use_meshlet_culling = true;
+StreamBuffer draw_command_stream;
+std::vector<DrawElementsIndirectCommand> draw_commands;
+
+MeshStream mesh_stream;
+int stream_capacity = 0;
+glm::mat4 stream_modelMatrix;
+
+Bvh mesh_bvh;
+
+Shader depth_shader;
+ShadowMap shadow_map;
+
+LightClusters light_clusters;
+std::vector<PointLight> scene_lights;
+int light_count = 1024;
+
+GBuffer gbuffer;
+Shader gbuffer_shader, deferred_shader;
+bool use_deferred = false;
+int mesh_layers = 1;
+
+bool use_depth_prepass = false;
+OverdrawCounter overdraw;
+bool count_overdraw = false;
+
+Mipmap_Mode texture_mipmaps = MIPMAPS_CPU;
+float texture_anisotropy = 8.0f;
+bool use_compressed_textures = true;
+TextureCache texture_cache(32 << 20);
+
+// files are decoded on the workers and what they made is uploaded from
+// idle_handler, at most upload_budget_ms of it a frame
+JobSystem jobs;
+bool use_async_loading = true;
+double upload_budget_ms = 8.0;
+int mesh_generation = 0;
+
+GeometryPool geometry_pool;
+Shader gallery_shader;
+bool show_gallery = false;
+bool use_gallery_batching = true;
+bool gallery_requested = false;
+std::vector<int> gallery_meshes;
+std::vector<glm::mat4> gallery_matrices;
+int gallery_draw_calls = 0;
+
+bool use_indexed_draw(void) {
+	// flat shading needs the corners of every triangle to be separate
+	return use_smoothed_normals && trig.IndexCount() > 0;
+}
+
+int select_lod(void) {
+	std::vector<MeshLod> &lods = trig.Lods();
+	if (forced_lod >= 0) return std::min(forced_lod, (int)lods.size() - 1);
+	if (lods.size() < 2 || trig.BoundsRadius() <= 0.0f) return 0;
+	// how many pixels a unit of simplification error covers where the mesh
+	// comes nearest - the near side of the bounding sphere, clamped to the
+	// near plane. The length of the second row of the matrix is its vertical
+	// scale, of the fourth how w grows with depth (0 for an orthographic
+	// projection, whose w stays 1)
+	glm::mat4 mvp = projectionMatrix * viewMatrix * modelMatrix;
+	glm::vec4 center = mvp * glm::vec4(trig.BoundsCenter(), 1.0f);
+	float scale = glm::length(glm::vec3(mvp[0][1], mvp[1][1], mvp[2][1]));
+	float depth_scale = glm::length(glm::vec3(mvp[0][3], mvp[1][3], mvp[2][3]));
+	float nearest = center.w - trig.BoundsRadius() * depth_scale;
+	if (projectionMatrix[2][3] != 0.0f) {
+		// the near distance of a perspective projection
+		nearest = std::max(nearest, projectionMatrix[3][2] / (projectionMatrix[2][2] - 1.0f));
+	}
+	float pixels_per_unit = scale / std::max(nearest, 1e-6f) * 0.5f * glutGet(GLUT_WINDOW_HEIGHT);
+	// the coarsest level whose error stays invisible
+	int lod = 0;
+	for (size_t i = 1; i < lods.size(); i++) {
+		if (lods[i].error * pixels_per_unit < lod_error_pixels) lod = i;
+	}
+	return lod;
+}
+
+void draw_meshlets(const MeshLod &lod) {
+	profiler.Begin("cull");
+	cull_meshlets(&trig.Meshlets()[lod.first_meshlet], lod.meshlet_count,
+	              projectionMatrix, viewMatrix * modelMatrix, draw_commands);
+	profiler.End();
+	if (draw_commands.empty()) return;
+	if (GLEW_ARB_multi_draw_indirect) {
+		if (!draw_command_stream.Buffer()) draw_command_stream.Init(GL_DRAW_INDIRECT_BUFFER, 64 * 1024);
+		// the culling merges commands by reading back the last one, so they
+		// are built in client memory and copied into the frame's region once
+		size_t bytes = sizeof(DrawElementsIndirectCommand) * draw_commands.size();
+		memcpy(draw_command_stream.Map(bytes, sizeof(GLuint)), &draw_commands[0], bytes);
+		draw_command_stream.Unmap();
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void *)draw_command_stream.Offset(),
+		                            draw_commands.size(), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	} else {
+		// the same draws, with the commands passed from client memory
+		std::vector<GLsizei> counts(draw_commands.size());
+		std::vector<const void *> offsets(draw_commands.size());
+		for (size_t i = 0; i < draw_commands.size(); i++) {
+			counts[i] = draw_commands[i].count;
+			offsets[i] = (const void *)(sizeof(unsigned int) * draw_commands[i].firstIndex);
+		}
+		glMultiDrawElements(GL_TRIANGLES, &counts[0], GL_UNSIGNED_INT, &offsets[0], draw_commands.size());
+	}
+}
+
+void mesh_bounds(glm::vec3 &center, float &radius) {
+	// while the mesh streams in, the box it is being normalized into
+	center = glm::vec3(0.0f);
+	radius = 200.0f * sqrt(3.0f);
+	if (trig.BoundsRadius() > 0.0f) {
+		center = glm::vec3(modelMatrix * glm::vec4(trig.BoundsCenter(), 1.0f));
+		radius = trig.BoundsRadius();
+	}
+	// and on to view coordinates; zooming scales the view matrix
+	center = glm::vec3(viewMatrix * glm::vec4(center, 1.0f));
+	radius *= glm::length(glm::vec3(viewMatrix[0]));
+}
+
+void place_lights(void) {
+	glm::vec3 center(0.0f);
+	float radius = 200.0f * sqrt(3.0f);
+	if (trig.BoundsRadius() > 0.0f) {
+		center = glm::vec3(modelMatrix * glm::vec4(trig.BoundsCenter(), 1.0f));
+		radius = trig.BoundsRadius();
+	}
+	generate_lights(light_count, center, radius, scene_lights);
+}
+
+void assign_lights(int threads = 0) {
+	// slice the depths the mesh covers
+	glm::vec3 center;
+	float radius;
+	mesh_bounds(center, radius);
+	light_clusters.Assign(scene_lights, viewMatrix, projectionMatrix, -center.z - radius, -center.z + radius, threads);
+}
+
+void render_shadow_map(void) {
+	if (trig.VertexCount() == 0) return;
+	glm::vec3 center;
+	float radius;
+	mesh_bounds(center, radius);
+	glm::vec3 light(lightPosition[0], lightPosition[1], lightPosition[2]);
+	if (!shadow_map.Update(light, center, radius, viewMatrix * modelMatrix)) return;
+
+	PROFILE_SCOPE(profiler, "shadow");
+	shadow_map.Begin();
+	depth_shader.Bind();
+	glm::mat4 projection = shadow_map.Projection();
+	glm::mat4 view = shadow_map.View() * viewMatrix;
+	glUniformMatrix4fv(glGetUniformLocation(depth_shader.ID(), "projectionMatrix"), 1, GL_FALSE, &projection[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(depth_shader.ID(), "viewMatrix"),       1, GL_FALSE, &view[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(depth_shader.ID(), "modelMatrix"),      1, GL_FALSE, &modelMatrix[0][0]);
+
+	// the same vertex buffers as the scene, positions only
+	GLint position_location = glGetAttribLocation(depth_shader.ID(), "vertex_position");
+	glEnableVertexAttribArray(position_location);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_position_buffer);
+	glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	if (use_indexed_draw()) {
+		// the finest level, so the shadows don't change with the zoom
+		const MeshLod &lod = trig.Lods()[0];
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertex_index_buffer);
+		glDrawElements(GL_TRIANGLES, lod.count, GL_UNSIGNED_INT, (void *)(sizeof(unsigned int) * lod.first));
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	} else {
+		glDrawArrays(GL_TRIANGLES, 0, trig.VertexCount());
+	}
+	glDisableVertexAttribArray(position_location);
+	depth_shader.Unbind();
+	shadow_map.End();
+}
+
+void bind_shadow_map(GLuint program, int unit) {
+	glm::mat4 shadowMatrix = shadow_map.ShadowMatrix();
+	glUniformMatrix4fv(glGetUniformLocation(program, "shadowMatrix"), 1, GL_FALSE, &shadowMatrix[0][0]);
+	glUniform1i(glGetUniformLocation(program, "useShadow"), shadow_map.Ready());
+	glUniform1f(glGetUniformLocation(program, "shadowTexel"), 1.0f / std::max(shadow_map.Size(), 1));
+	glUniform1i(glGetUniformLocation(program, "shadowMap"), unit);
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, shadow_map.Ready() ? shadow_map.Texture() : 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void enable_vertex_attributes(GLuint program, GLint locations[3]) {
+    // bind vertex uv coordinates to shader
+	locations[0] = glGetAttribLocation(program, "vertex_uv");
+	if (locations[0] != -1) {
+        glEnableVertexAttribArray(locations[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_uv_buffer);
+        glVertexAttribPointer(locations[0], 2, GL_FLOAT, GL_FALSE, 0, 0);
+    }
+
+    // bind vertex positions to shader
+	locations[1] = glGetAttribLocation(program, "vertex_position");
+	if (locations[1] != -1) {
+        glEnableVertexAttribArray(locations[1]);
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_position_buffer);
+        glVertexAttribPointer(locations[1], 3, GL_FLOAT, GL_FALSE, 0, 0);
+    }
+
+    // bind vertex normals to shader
+	locations[2] = glGetAttribLocation(program, "vertex_normal");
+	if (locations[2] != -1) {
+        glEnableVertexAttribArray(locations[2]);
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_normal_buffer);
+        glVertexAttribPointer(locations[2], 3, GL_FLOAT, GL_FALSE, 0, 0);
+    }
+}
+
+void disable_vertex_attributes(GLint locations[3]) {
+	for (int i = 0; i < 3; i++) {
+		if (locations[i] != -1) glDisableVertexAttribArray(locations[i]);
+	}
+}
+
+void draw_mesh(GLint modelMatrix_location) {
+	// the farthest copy first, so each one is drawn over the last
+	glm::mat4 model = modelMatrix;
+	float spacing = 0.02f * std::max(trig.BoundsRadius(), 1.0f);
+	for (int layer = 0; layer < mesh_layers; layer++) {
+		modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, layer * spacing)) * model;
+		glUniformMatrix4fv(modelMatrix_location, 1, GL_FALSE, &modelMatrix[0][0]);
+		if (use_indexed_draw()) {
+			const MeshLod &lod = trig.Lods()[select_lod()];
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertex_index_buffer);
+			if (use_meshlet_culling && lod.meshlet_count > 0) {
+				draw_meshlets(lod);
+			} else {
+				glDrawElements(GL_TRIANGLES, lod.count, GL_UNSIGNED_INT, (void *)(sizeof(unsigned int) * lod.first));
+			}
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		} else {
+			glDrawArrays(GL_TRIANGLES, 0, trig.VertexCount());
+		}
+	}
+	modelMatrix = model;
+}
+
+void display_deferred(void) {
+	render_shadow_map();
+	GLint locations[3];
+
+	// geometry pass: the surfaces into the G-buffer
+	profiler.Begin("gbuffer");
+	gbuffer.Begin(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+	gbuffer_shader.Bind();
+	GLuint program = gbuffer_shader.ID();
+	glUniformMatrix4fv(glGetUniformLocation(program, "projectionMatrix"), 1, GL_FALSE, &projectionMatrix[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"),       1, GL_FALSE, &viewMatrix[0][0]);
+	glUniformMatrix3fv(glGetUniformLocation(program, "normalMatrix"),     1, GL_FALSE, &normalMatrix[0][0]);
+	// only the decal texture colors the surface
+	glUniform1i(glGetUniformLocation(program, "useTexture"), useTexture && texture_path == decal);
+	glUniform1i(glGetUniformLocation(program, "texture0"), 0);
+	enable_vertex_attributes(program, locations);
+	draw_mesh(glGetUniformLocation(program, "modelMatrix"));
+	disable_vertex_attributes(locations);
+	gbuffer_shader.Unbind();
+	gbuffer.End();
+	profiler.End();
+
+	// lighting pass: once for every pixel of the window
+	profiler.Begin("lighting");
+	glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	deferred_shader.Bind();
+	program = deferred_shader.ID();
+	glm::mat4 inverseProjectionMatrix = glm::inverse(projectionMatrix);
+	glUniformMatrix4fv(glGetUniformLocation(program, "inverseProjectionMatrix"), 1, GL_FALSE, &inverseProjectionMatrix[0][0]);
+	glUniform3fv(glGetUniformLocation(program, "materialAmbient"),  1, materialAmbient);
+	glUniform3fv(glGetUniformLocation(program, "materialDiffuse"),  1, materialDiffuse);
+	glUniform3fv(glGetUniformLocation(program, "materialSpecular"), 1, materialSpecular);
+	glUniform3fv(glGetUniformLocation(program, "lightPosition"),    1, lightPosition);
+	glUniform3fv(glGetUniformLocation(program, "lightAmbient"),     1, lightAmbient);
+	glUniform3fv(glGetUniformLocation(program, "lightDiffuse"),     1, lightDiffuse);
+	glUniform3fv(glGetUniformLocation(program, "lightSpecular"),    1, lightSpecular);
+	glUniform3fv(glGetUniformLocation(program, "lightGlobal"),      1, lightGlobal);
+	glUniform1f(glGetUniformLocation(program, "materialShininess"),   materialShininess);
+	glUniform1f(glGetUniformLocation(program, "constantAttenuation"), constantAttenuation);
+	glUniform1f(glGetUniformLocation(program, "linearAttenuation"),   linearAttenuation);
+	const char *names[3] = { "gAlbedo", "gNormal", "gDepth" };
+	GLuint textures[3] = { gbuffer.Albedo(), gbuffer.Normal(), gbuffer.Depth() };
+	for (int i = 0; i < 3; i++) {
+		glUniform1i(glGetUniformLocation(program, names[i]), i);
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+	}
+	bind_shadow_map(program, 3);
+	glDisable(GL_DEPTH_TEST);
+	gbuffer.DrawQuad(glGetAttribLocation(program, "vertex_position"));
+	glEnable(GL_DEPTH_TEST);
+	// give the first unit back to the texture of the model
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	deferred_shader.Unbind();
+	profiler.End();
+}
+
+// The shading pass tests its depths for equality with these, so they must
+// come out bit for bit the same from two different vertex shaders - which
+// is what declaring gl_Position invariant in every one of them guarantees
+void render_depth_prepass(void) {
+	PROFILE_SCOPE(profiler, "prepass");
+	depth_shader.Bind();
+	GLuint program = depth_shader.ID();
+	glUniformMatrix4fv(glGetUniformLocation(program, "projectionMatrix"), 1, GL_FALSE, &projectionMatrix[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"),       1, GL_FALSE, &viewMatrix[0][0]);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	// the position stream only
+	GLint position_location = glGetAttribLocation(program, "vertex_position");
+	glEnableVertexAttribArray(position_location);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_position_buffer);
+	glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	draw_mesh(glGetUniformLocation(program, "modelMatrix"));
+	glDisableVertexAttribArray(position_location);
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	depth_shader.Unbind();
+	// the shading pass only draws where the depths are the nearest
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
+}
+
+// defined with the idle handler below
+void update_idle_func(void);
+
+void setup_gallery(void) {
+	if (gallery_requested || !geometry_pool.Supported()) return;
+	gallery_requested = true;
+	static void (*const generators[3])(int triangles, GeneratedMesh &mesh) = { generate_sphere, generate_torus, generate_teapot };
+	// a grid over the window, centered where the view looks
+	const int columns = 16, rows = 12;
+	const float cell = 36.0f;
+	for (int i = 0; i < columns * rows; i++) {
+		// generated and optimized on the workers, added to the pool on this
+		// thread - the gallery fills in over the next frames
+		std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>();
+		std::function<void(void)> work = [=]() {
+			GeneratedMesh generated;
+			generators[i % 3](200 + 37 * i, generated);
+			std::vector<glm::vec3> positions;
+			std::vector<glm::vec2> uvs;
+			for (size_t c = 0; c < generated.indices.size(); c++) {
+				positions.push_back(generated.positions[generated.indices[c]]);
+				uvs.push_back(generated.uvs[generated.indices[c]]);
+			}
+			mesh->Append(positions, uvs, std::vector<glm::vec3>(), std::vector<glm::vec3>());
+			mesh->Optimize();
+			mesh->ComputeNormals(true);
+		};
+		std::function<void(void)> finish = [=]() {
+			int id = geometry_pool.Add(*mesh);
+			if (id == -1) return;
+
+			// scaled to fit its cell
+			const PooledMesh &pooled = geometry_pool.Mesh(id);
+			glm::vec3 position((i % columns - (columns - 1) * 0.5f) * cell,
+			                   (i / columns - (rows - 1) * 0.5f) * cell + 60.0f, 0.0f);
+			glm::mat4 matrix = glm::translate(glm::mat4(1.0f), position);
+			matrix = glm::scale(matrix, glm::vec3(0.45f * cell / std::max(pooled.radius, 1e-6f)));
+			matrix = glm::translate(matrix, -pooled.center);
+			gallery_meshes.push_back(id);
+			gallery_matrices.push_back(matrix);
+		};
+		if (use_async_loading) {
+			jobs.Submit(work, finish);
+		} else {
+			work();
+			finish();
+		}
+	}
+	update_idle_func();
+}
+
+void display_gallery(void) {
+	setup_gallery();
+	profiler.Begin("clear");
+	glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	profiler.End();
+	if (gallery_meshes.empty()) return;
+	gallery_shader.Bind();
+	GLuint program = gallery_shader.ID();
+	glUniformMatrix4fv(glGetUniformLocation(program, "projectionMatrix"), 1, GL_FALSE, &projectionMatrix[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"),       1, GL_FALSE, &viewMatrix[0][0]);
+	glUniform3fv(glGetUniformLocation(program, "materialAmbient"),  1, materialAmbient);
+	glUniform3fv(glGetUniformLocation(program, "materialDiffuse"),  1, materialDiffuse);
+	glUniform3fv(glGetUniformLocation(program, "materialSpecular"), 1, materialSpecular);
+	glUniform3fv(glGetUniformLocation(program, "lightPosition"),    1, lightPosition);
+	glUniform3fv(glGetUniformLocation(program, "lightAmbient"),     1, lightAmbient);
+	glUniform3fv(glGetUniformLocation(program, "lightDiffuse"),     1, lightDiffuse);
+	glUniform3fv(glGetUniformLocation(program, "lightSpecular"),    1, lightSpecular);
+	glUniform3fv(glGetUniformLocation(program, "lightGlobal"),      1, lightGlobal);
+	glUniform1f(glGetUniformLocation(program, "materialShininess"),   materialShininess);
+	glUniform1f(glGetUniformLocation(program, "constantAttenuation"), constantAttenuation);
+	glUniform1f(glGetUniformLocation(program, "linearAttenuation"),   linearAttenuation);
+	GLint locations[3] = { glGetAttribLocation(program, "vertex_position"),
+	                       glGetAttribLocation(program, "vertex_normal"), -1 };
+	geometry_pool.BindAttributes(locations);
+
+	// every mesh in the same buffers, so all of them in one submit
+	profiler.Begin("draw");
+	for (size_t i = 0; i < gallery_meshes.size(); i++) {
+		geometry_pool.Draw(gallery_meshes[i], modelMatrix * gallery_matrices[i]);
+	}
+	gallery_draw_calls = geometry_pool.Submit(glGetAttribLocation(program, "drawModelMatrix"), use_gallery_batching);
+	profiler.End();
+
+	for (int i = 0; i < 2; i++) glDisableVertexAttribArray(locations[i]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	gallery_shader.Unbind();
+}
+
+void display_forward(void);
+
 void display_handler(void) {
+	profiler.BeginFrame();
+	draw_command_stream.BeginFrame();
+	geometry_pool.BeginFrame();
+	if (show_gallery) {
+		display_gallery();
+	} else if (use_deferred && gbuffer.Supported()) {
+		display_deferred();
+	} else {
+		display_forward();
+	}
+
+	// queue the frame for recording before it is flushed
+	if (capture.Recording()) {
+		PROFILE_SCOPE(profiler, "capture");
+		capture.Capture();
+	}
+	if (show_profile) {
+		std::string summary = show_gallery ? std::to_string(gallery_meshes.size()) + " meshes in " +
+		                                     std::to_string(gallery_draw_calls) + " draw calls"
+		                                   : use_deferred ? "" : overdraw.Summary();
+		profiler.DrawOverlay(summary + "\n" + texture_cache.Summary() + "\n");
+	}
+	draw_command_stream.EndFrame();
+	geometry_pool.EndFrame();
+	profiler.Begin("flush");
+	glFlush();
+	profiler.End();
+	profiler.EndFrame();
+}
+
+void display_forward(void) {
+	// only the shaders that sample the shadow map need it drawn
+	bool use_shadow = glGetUniformLocation(shader.ID(), "shadowMap") != -1;
+	if (use_shadow) render_shadow_map();
+	// and only the clustered shader the lights sorted into clusters
+	bool use_clusters = glGetUniformLocation(shader.ID(), "clusterRanges") != -1;
+	if (use_clusters) {
+		PROFILE_SCOPE(profiler, "lights");
+		assign_lights();
+	}
+	profiler.Begin("clear");
     // clear scene
 	glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	profiler.End();
+	if (use_depth_prepass) render_depth_prepass();
 	shader.Bind();
 
 	// pass uniform variables to shader
+	profiler.Begin("uniforms");
 	GLint projectionMatrix_location    = glGetUniformLocation(shader.ID(), "projectionMatrix");
 	GLint viewMatrix_location          = glGetUniformLocation(shader.ID(), "viewMatrix");
 	GLint modelMatrix_location         = glGetUniformLocation(shader.ID(), "modelMatrix");
@@ -73,7 +564,13 @@ void display_handler(void) {
     glUniform1f(        constantAttenuation_location, constantAttenuation);
     glUniform1f(        linearAttenuation_location,   linearAttenuation);
     glUniform1i(        useTexture_location,          useTexture);
+	// the shadow map lives on the second texture unit
+	if (use_shadow) bind_shadow_map(shader.ID(), 1);
+	// the clusters live on the third to fifth texture units
+	if (use_clusters) light_clusters.Bind(shader.ID(), 2);
+	profiler.End();
 
+	profiler.Begin("attributes");
     // bind texture to shader
     GLint texture0_location = glGetAttribLocation(shader.ID(), "texture0");
     if (texture0_location != -1) {
@@ -82,37 +579,99 @@ void display_handler(void) {
         glUniform1i(texture0_location, 0);
     }
 
-    // bind vertex uv coordinates to shader
-	GLint uv_location = glGetAttribLocation(shader.ID(), "vertex_uv");
-	if (uv_location != -1) {
-        glEnableVertexAttribArray(uv_location);
-        glBindBuffer(GL_ARRAY_BUFFER, vertex_uv_buffer);
-        glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    }
+	GLint locations[3];
+	enable_vertex_attributes(shader.ID(), locations);
+	profiler.End();
 
-    // bind vertex positions to shader
-	GLint position_location = glGetAttribLocation(shader.ID(), "vertex_position");
-	if (position_location != -1) {
-        glEnableVertexAttribArray(position_location);
-        glBindBuffer(GL_ARRAY_BUFFER, vertex_position_buffer);
-        glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    // draw the scene
+	profiler.Begin("draw");
+	bool counting = show_profile || count_overdraw;
+	if (counting) overdraw.BeginShading();
+	draw_mesh(modelMatrix_location);
+	if (counting) overdraw.EndShading();
+	disable_vertex_attributes(locations);
+	shader.Unbind();
+	if (use_depth_prepass) {
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	}
+	if (counting) overdraw.CountCovered();
+	profiler.End();
+}
+
+// defined with the other setup functions below
+void append_mesh_chunk(MeshChunk &chunk);
+void finish_mesh_stream(void);
+void setup_texture(char *texture_path, GLuint *textureID);
+void update_idle_func(void);
+
+void idle_handler(void) {
+    // the streamed chunks and the finished jobs share one budget a frame
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (mesh_stream.Running()) {
+        // hand the parsed chunks to OpenGL, a few milliseconds' worth at a time
+        MeshChunk chunk;
+        while (mesh_stream.Poll(chunk)) {
+            append_mesh_chunk(chunk);
+            if (std::chrono::steady_clock::now() - start > std::chrono::duration<double, std::milli>(upload_budget_ms)) break;
+        }
+        if (!mesh_stream.Running()) finish_mesh_stream();
     }
+    if (jobs.Pending() > 0) {
+        double spent = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        jobs.RunCompletions(upload_budget_ms - spent);
+    }
+    update_idle_func();
+    // keep drawing frames while they are being recorded or loaded
+    glutPostRedisplay();
+}
 
-    // bind vertex normals to shader
-	GLint normal_location = glGetAttribLocation(shader.ID(), "vertex_normal");
-	if (normal_location != -1) {
-        glEnableVertexAttribArray(normal_location);
-        glBindBuffer(GL_ARRAY_BUFFER, vertex_normal_buffer);
-        glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, 0, 0);
+void update_idle_func(void) {
+    if (mesh_stream.Running() || jobs.Pending() > 0 || capture.Recording()) {
+        glutIdleFunc(idle_handler);
+    } else {
+        glutIdleFunc(NULL);
     }
+}
 
-    // draw the scene
-	glDrawArrays(GL_TRIANGLES, 0, trig.VertexCount());
-	glDisableVertexAttribArray(position_location);
-	glDisableVertexAttribArray(uv_location);
-	glDisableVertexAttribArray(normal_location);
-	shader.Unbind();
-	glFlush();
+void cleanup(void) {
+    jobs.Stop();
+    mesh_stream.Stop();
+    capture.Stop();
+}
+
+bool pick_triangle(int x, int y, RayHit &hit, glm::vec3 &position) {
+	// the cursor's line of sight between the near and far planes, in model
+	// coordinates, so the mesh needn't be transformed
+	int width = glutGet(GLUT_WINDOW_WIDTH), height = glutGet(GLUT_WINDOW_HEIGHT);
+	glm::vec2 ndc(2.0f * (x + 0.5f) / width - 1.0f, 1.0f - 2.0f * (y + 0.5f) / height);
+	glm::mat4 inverse = glm::inverse(projectionMatrix * viewMatrix * modelMatrix);
+	glm::vec4 near_point = inverse * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+	glm::vec4 far_point = inverse * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+	Ray ray;
+	ray.origin = glm::vec3(near_point) / near_point.w;
+	ray.direction = glm::vec3(far_point) / far_point.w - ray.origin;
+	ray.t_max = 1.0f;
+	if (!mesh_bvh.Intersect(ray, hit)) return false;
+	position = glm::vec3(modelMatrix * glm::vec4(ray.origin + hit.t * ray.direction, 1.0f));
+	return true;
+}
+
+void mouse_handler(int button, int state, int x, int y) {
+	if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN) return;
+	RayHit hit;
+	glm::vec3 position;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool found = pick_triangle(x, y, hit, position);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (!found) {
+		std::cout << "Nothing under the cursor (" << ms << " ms)" << std::endl;
+		return;
+	}
+	std::cout << "Triangle " << hit.triangle
+	          << ", barycentrics (" << 1.0f - hit.u - hit.v << ", " << hit.u << ", " << hit.v << ")"
+	          << ", world position (" << position.x << ", " << position.y << ", " << position.z << ")"
+	          << " (" << ms << " ms)" << std::endl;
 }
 
 glm::mat4 get_default_projectionMatrix(void) {
@@ -154,6 +713,67 @@ void keyboard_handler(unsigned char key, int x, int y) {
         case 'g': rotation = glm::vec3( 0, 0, 1); break;
         case 'h': rotation = glm::vec3( 0, 0,-1); break;
         case ' ': viewMatrix = get_default_viewMatrix(); break;
+        case '+': viewMatrix = glm::scale(viewMatrix, glm::vec3(1.25f)); break;
+        case '-': viewMatrix = glm::scale(viewMatrix, glm::vec3(0.8f)); break;
+        case 'c':
+            if (capture.Recording()) {
+                capture.Stop();
+            } else {
+                capture.Start(capture_dir, glutGet(GLUT_WINDOW_WIDTH),
+                              glutGet(GLUT_WINDOW_HEIGHT));
+            }
+            update_idle_func();
+            break;
+        case 'm': use_meshlet_culling = !use_meshlet_culling; break;
+        case '[':
+        case ']':
+            light_count = key == '[' ? std::max(1, light_count / 2) : std::min(65536, light_count * 2);
+            place_lights();
+            std::cout << light_count << " lights" << std::endl;
+            break;
+        case 'z':
+            use_depth_prepass = !use_depth_prepass;
+            std::cout << "depth pre-pass " << (use_depth_prepass ? "on" : "off") << std::endl;
+            break;
+        case 'u':
+            texture_mipmaps = (Mipmap_Mode)((texture_mipmaps + 1) % 3);
+            setup_texture(texture_path, &textureID);
+            std::cout << "mipmaps " << (texture_mipmaps == MIPMAPS_NONE ? "off" : texture_mipmaps == MIPMAPS_CPU ? "box filtered" : "generated by the driver") << std::endl;
+            break;
+        case 'i':
+            texture_anisotropy = texture_anisotropy >= 16.0f ? 1.0f : texture_anisotropy * 2.0f;
+            if (textureID != 0) {
+                glBindTexture(GL_TEXTURE_2D, textureID);
+                set_texture_filtering(texture_mipmaps != MIPMAPS_NONE, texture_anisotropy);
+            }
+            std::cout << "anisotropy " << texture_anisotropy << "x" << std::endl;
+            break;
+        case 'k':
+            use_compressed_textures = !use_compressed_textures;
+            setup_texture(texture_path, &textureID);
+            std::cout << "textures " << (use_compressed_textures ? "block compressed" : "uncompressed") << std::endl;
+            break;
+        case 'l':
+            use_async_loading = !use_async_loading;
+            std::cout << "loading " << (use_async_loading ? "in the background" : "while the frame waits") << std::endl;
+            break;
+        case 'o':
+            show_gallery = !show_gallery;
+            if (show_gallery && !geometry_pool.Supported()) {
+                std::cerr << "The gallery needs OpenGL 3.2" << std::endl;
+                show_gallery = false;
+            }
+            break;
+        case 'b':
+            use_gallery_batching = !use_gallery_batching;
+            std::cout << "gallery drawn " << (use_gallery_batching && geometry_pool.Batches() ? "in one multi-draw" : "one draw per mesh") << std::endl;
+            break;
+        case 'p': show_profile = !show_profile; break;
+        case 'P':
+            profiler.WriteCSV(profile_csv);
+            profiler.WriteJSON(profile_json);
+            std::cout << profiler.Report();
+            break;
         case  27: exit(0);
     }
     // perform the translation or rotation
@@ -167,133 +787,298 @@ void keyboard_handler(unsigned char key, int x, int y) {
     display_handler();
 }
 
-void setup_texture(char *texture_path, GLuint *textureID) {
-    if (texture_path == NULL) return;
-    unsigned char header[54];
-    unsigned int data_pos, width, height, texture_size;
-    unsigned char *data;
-    // open file
-    FILE *file = fopen(texture_path, "rb");
-    if (!file) {
-        std::cerr << "couldn't open image" << std::endl;
-        return;
-    }
-    // validate header
-    if ((fread(header, 1, 54, file) != 54) || (header[0] != 'B' || header[1] != 'M')) {
-        std::cerr << "not a valid bmp file" << std::endl;
-        return;
-    }
-    // read integers
-    data_pos     = *(int*)&(header[0x0A]);
-    texture_size = *(int*)&(header[0x22]);
-    width        = *(int*)&(header[0x12]);
-    height       = *(int*)&(header[0x16]);
-    // set defaults if bmp is misformatted
-    if (texture_size == 0) texture_size = width * height * 3;
-    if (data_pos == 0)     data_pos = 54;
-    // read image data
-    data = new unsigned char[texture_size];
-    fread(data, 1, texture_size, file);
-    fclose(file);
-    // convert to OpenGL texture'
-    glGenTextures(1, textureID);
-    glBindTexture(GL_TEXTURE_2D, *textureID);
+// The block format the texture at |path| is compressed to
+Block_Format texture_block_format(const char *path) {
+    // the normal maps keep two channels, x and y
+    bool normals = path == bump_map1 || path == bump_map2 || path == bump_map3;
+    return normals ? BLOCK_BC5 : BLOCK_BC1;
+}
+
+bool load_texture_file(const char *path, GLuint texture) {
+    bool compressed = use_compressed_textures &&
+                      load_compressed_texture(path, texture, texture_block_format(path),
+                                              texture_mipmaps != MIPMAPS_NONE);
+    if (!compressed && !load_bmp_texture(path, texture, true, texture_mipmaps)) return false;
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-    glEnable(GL_TEXTURE_2D);
+    return true;
 }
 
-void setup_vertex_position_buffer_object(void) {
-	glGenBuffers(1, &vertex_position_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_position_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * trig.VertexCount(),
-		         &trig.Vertices()[0], GL_STATIC_DRAW);
+// Make |texture|, already acquired from the cache, the one in |textureID|
+void use_texture(GLuint *textureID, GLuint texture) {
+    // the texture of the last mode goes back to the cache, where it stays
+    // for when that mode is chosen again
+    if (*textureID != 0) texture_cache.Release(*textureID);
+    *textureID = texture;
+    if (texture == 0) return;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    set_texture_filtering(texture_mipmaps != MIPMAPS_NONE, texture_anisotropy);
+    glEnable(GL_TEXTURE_2D);
 }
 
-void setup_vertex_uv_buffer_object(void) {
-	glGenBuffers(1, &vertex_uv_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_uv_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * trig.UVs().size(),
-		         &trig.UVs()[0], GL_STATIC_DRAW);
-}
+// a texture file decoded on a worker, waiting to be uploaded
+struct DecodedTexture {
+    bool decoded;
+    unsigned long long hash;
+    CompressedImage compressed;
+    BgraImage image;
+};
 
-void setup_vertex_normal_buffer_object(bool smoothed) {
-    std::vector<glm::vec3> vertices = trig.Vertices();
-    std::vector<glm::vec3> normals;
-    if (smoothed) {
-        // initialize map of normals to zero
-        // note that we store readily hashable vector<double> types instead of
-        // vec3s and convert between the two as required
-        // ...avoids some of the pain using <map> without much C++ knowledge
-        std::map< std::vector<double>, std::vector<double> > normal_map;
-        for (int i = 0; i < vertices.size(); i++) {
-            std::vector<double> zeros;
-            zeros.push_back(0.0);
-            zeros.push_back(0.0);
-            zeros.push_back(0.0);
-            normal_map[to_vector(vertices[i])] = zeros;
-        }
-        for (int i = 0; i < vertices.size(); i += 3) {
-            // get vertices of the current triangle
-            glm::vec3 v1 = vertices[i];
-            glm::vec3 v2 = vertices[i + 1];
-            glm::vec3 v3 = vertices[i + 2];
-            std::vector<double> v1_key = to_vector(v1);
-            std::vector<double> v2_key = to_vector(v2);
-            std::vector<double> v3_key = to_vector(v3);
-            // compute face normal
-            glm::vec3 face_normal = glm::cross(v3 - v2, v1 - v2);
-            // get the old vertex normal
-            glm::vec3 v1_old = to_vec3(normal_map[v1_key]);
-            glm::vec3 v2_old = to_vec3(normal_map[v2_key]);
-            glm::vec3 v3_old = to_vec3(normal_map[v3_key]);
-            // replace the old value with the new value
-            normal_map.erase(v1_key);
-            normal_map.erase(v2_key);
-            normal_map.erase(v3_key);
-            normal_map[v1_key] = to_vector(glm::normalize(v1_old + face_normal));
-            normal_map[v2_key] = to_vector(glm::normalize(v2_old + face_normal));
-            normal_map[v3_key] = to_vector(glm::normalize(v3_old + face_normal));
+// The texture setup_texture was last asked for, and whether it is still to
+// be put in use. One texture is loaded on the workers at a time; if another
+// one has been asked for by the time it arrives, that one is loaded next.
+char *wanted_texture_path = NULL;
+std::string wanted_texture_variant;
+bool texture_wanted = false, texture_loading = false;
+
+void load_wanted_texture(GLuint *textureID) {
+    char *path = wanted_texture_path;
+    std::string variant = wanted_texture_variant;
+    Block_Format format = texture_block_format(path);
+    bool compressed = use_compressed_textures && compressed_textures_supported(format);
+    Mipmap_Mode mipmaps = texture_mipmaps;
+    std::shared_ptr<DecodedTexture> decoded = std::make_shared<DecodedTexture>();
+    texture_loading = true;
+    jobs.Submit([=]() {
+        decoded->decoded = hash_file(path, decoded->hash) &&
+                           (compressed ? decode_compressed_texture(path, format, mipmaps != MIPMAPS_NONE, decoded->compressed)
+                                       : read_bmp_image(path, decoded->image));
+    }, [=]() {
+        texture_loading = false;
+        GLuint texture = 0;
+        if (decoded->decoded) {
+            glGenTextures(1, &texture);
+            if (compressed) {
+                upload_compressed_texture(decoded->compressed, texture);
+            } else {
+                upload_bgra_image(decoded->image, texture, mipmaps);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            texture = texture_cache.Insert(path, variant, decoded->hash, texture);
         }
-        // convert the map of normals to a vector of normals
-        for (int i = 0; i < vertices.size(); i++) {
-            normals.push_back(to_vec3(normal_map[to_vector(vertices[i])]));
+        if (texture_wanted && path == wanted_texture_path && variant == wanted_texture_variant) {
+            texture_wanted = false;
+            use_texture(textureID, texture);
+        } else {
+            // kept in the cache for when it's asked for again
+            if (texture != 0) texture_cache.Release(texture);
+            if (texture_wanted) load_wanted_texture(textureID);
         }
+    });
+    update_idle_func();
+}
+
+void setup_texture(char *texture_path, GLuint *textureID) {
+    // the same bytes loaded as a normal map and as a color map are two
+    // different textures once compressed
+    const char *encoding = "plain";
+    if (use_compressed_textures && texture_path != NULL) {
+        encoding = texture_block_format(texture_path) == BLOCK_BC5 ? "bc5" : "bc1";
+    }
+    char variant[32];
+    sprintf(variant, "%s mips%d", encoding, (int)texture_mipmaps);
+    wanted_texture_path = texture_path;
+    wanted_texture_variant = variant;
+    texture_wanted = false;
+    if (texture_path == NULL) {
+        use_texture(textureID, 0);
+    } else if (!use_async_loading) {
+        use_texture(textureID, texture_cache.Acquire(texture_path, variant, load_texture_file));
     } else {
-        for (int i = 0; i < vertices.size(); i += 3) {
-            // get vertices of this triangle
-            glm::vec3 v1 = vertices[i];
-            glm::vec3 v2 = vertices[i + 1];
-            glm::vec3 v3 = vertices[i + 2];
-            // compute face normal
-            glm::vec3 face_normal = glm::cross(v3 - v2, v1 - v2);
-            normals.push_back(glm::normalize(face_normal));
-            normals.push_back(glm::normalize(face_normal));
-            normals.push_back(glm::normalize(face_normal));
+        // a resident texture is used at once; until another one arrives the
+        // last one stays in use
+        GLuint texture = texture_cache.Lookup(texture_path, variant);
+        if (texture != 0) {
+            use_texture(textureID, texture);
+        } else {
+            texture_wanted = true;
+            if (!texture_loading) load_wanted_texture(textureID);
         }
     }
-    glGenBuffers(1, &vertex_normal_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_normal_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * normals.size(),
-                 &normals[0], GL_STATIC_DRAW);
+}
+
+// Upload the triangle order array |corners| of trig to |buffer| - as it is,
+// or one entry per indexed vertex when drawing indexed, gathered straight
+// into the buffer's fresh storage without a copy in between
+template <typename T>
+static void upload_corners(GLuint *buffer, Span<const T> corners) {
+	bool indexed = use_indexed_draw();
+	size_t bytes = sizeof(T) * (indexed ? trig.IndexedVertexCount() : corners.Size());
+	if (!*buffer) glGenBuffers(1, buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, *buffer);
+	glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+	write_buffer(GL_ARRAY_BUFFER, 0, bytes, [&](void *target) {
+		if (indexed) trig.GatherIndexed(corners, (T *)target);
+		else memcpy(target, corners.Data(), bytes);
+	}, use_buffer_mapping);
+}
+
+void setup_vertex_position_buffer_object(void) {
+	upload_corners<glm::vec3>(&vertex_position_buffer, trig.Vertices());
+	shadow_map.Invalidate();
+}
+
+void setup_vertex_uv_buffer_object(void) {
+	upload_corners<glm::vec2>(&vertex_uv_buffer, trig.UVs());
+}
+
+void setup_vertex_index_buffer_object(void) {
+	if (!use_indexed_draw()) return;
+	if (!vertex_index_buffer) glGenBuffers(1, &vertex_index_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vertex_index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * trig.IndexCount(),
+		         &trig.Indices()[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void setup_vertex_normal_buffer_object(bool smoothed) {
+    trig.ComputeNormals(smoothed);
+    upload_corners<glm::vec3>(&vertex_normal_buffer, trig.Normals());
 }
 
 void setup_data() {
 	// create shader, prepare data for OpenGL
 	shader.Init(vertexshader_path, fragmentshader_path);
 	setup_texture(texture_path, &textureID);
-	setup_vertex_position_buffer_object();
-	setup_vertex_uv_buffer_object();
-	setup_vertex_normal_buffer_object(use_smoothed_normals);
+	if (trig.VertexCount() > 0) {
+		setup_vertex_position_buffer_object();
+		setup_vertex_uv_buffer_object();
+		setup_vertex_normal_buffer_object(use_smoothed_normals);
+		setup_vertex_index_buffer_object();
+	}
+	// the buffers now hold exactly the triangles streamed so far
+	stream_capacity = trig.VertexCount();
 
 	// set up camera and object transformation matrices
 	projectionMatrix = get_default_projectionMatrix();
 	viewMatrix = get_default_viewMatrix();
+	modelMatrix = mesh_stream.Running() ? stream_modelMatrix : get_default_modelMatrix();
+	normalMatrix = get_default_normalMatrix();
+}
+
+// Write |count| elements of |size| bytes, starting at element |first| of
+// |data|, to the same place in |buffer|. If |capacity| is not 0 the buffer
+// is first reallocated to hold that many elements and refilled from the start.
+// Nothing drawn so far reads past |first|, so the range is written unsynchronized.
+static void stream_into_buffer(GLuint *buffer, const void *data, size_t size,
+                               int first, int count, int capacity) {
+	if (!*buffer) glGenBuffers(1, buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, *buffer);
+	if (capacity) {
+		glBufferData(GL_ARRAY_BUFFER, size * capacity, NULL, GL_STATIC_DRAW);
+		count += first;
+		first = 0;
+	}
+	const char *source = (const char *)data + size * first;
+	write_buffer(GL_ARRAY_BUFFER, size * first, size * count, [&](void *target) {
+		memcpy(target, source, size * count);
+	}, use_buffer_mapping);
+}
+
+void append_mesh_chunk(MeshChunk &chunk) {
+	int first = trig.VertexCount();
+	int count = chunk.vertices.size();
+	if (count > 0) {
+		trig.Append(chunk.vertices, chunk.uvs, chunk.normals, chunk.file_normals);
+		// grow geometrically so the re-uploads stay linear in the mesh size
+		int capacity = 0;
+		if (first + count > stream_capacity) {
+			capacity = std::max(first + count, 2 * stream_capacity);
+			stream_capacity = capacity;
+		}
+		stream_into_buffer(&vertex_position_buffer, &trig.Vertices()[0], sizeof(glm::vec3), first, count, capacity);
+		stream_into_buffer(&vertex_uv_buffer, &trig.UVs()[0], sizeof(glm::vec2), first, count, capacity);
+		stream_into_buffer(&vertex_normal_buffer, &trig.Normals()[0], sizeof(glm::vec3), first, count, capacity);
+	}
+	if (trig.VertexCount() > 0) {
+		// place the part that has arrived the way the whole mesh will be placed
+		stream_modelMatrix = TriangleMesh::NormalizationMatrix(chunk.sum, chunk.min, chunk.max, trig.VertexCount());
+		shadow_map.Invalidate();
+		modelMatrix = stream_modelMatrix;
+		normalMatrix = get_default_normalMatrix();
+	}
+}
+
+void upload_finished_mesh(void);
+
+void finish_mesh_stream(void) {
+	// a file that opened but had no faces leaves nothing to optimize
+	if (!mesh_stream.Failed() && trig.VertexCount() == 0) {
+		std::cerr << "No triangles in the model" << std::endl;
+	}
+	if (mesh_stream.Failed() || trig.VertexCount() == 0) {
+		trig = TriangleMesh();
+		mesh_bvh = Bvh();
+		upload_finished_mesh();
+		return;
+	}
+	// optimizing a large mesh and building its LODs, meshlets and BVH takes
+	// a while; the streamed triangles are drawn in the meantime
+	std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>(trig);
+	std::shared_ptr<Bvh> bvh = std::make_shared<Bvh>();
+	glm::mat4 placement = stream_modelMatrix;
+	int generation = mesh_generation;
+	std::function<void(void)> work = [=]() {
+		// the LODs and the BVH both start from the optimized triangle order
+		TaskGraph graph;
+		int optimize = graph.Add([=]() {
+			mesh->Transform(placement);
+			mesh->Optimize();
+		});
+		int lods = graph.Add([=]() {
+			mesh->BuildLods();
+			mesh->BuildMeshlets();
+		});
+		int hierarchy = graph.Add([=]() { bvh->Build(mesh->Vertices()); });
+		graph.Precede(optimize, lods);
+		graph.Precede(optimize, hierarchy);
+		graph.Run(thread_pool());
+	};
+	std::function<void(void)> finish = [=]() {
+		// a model loaded since replaces this one
+		if (generation != mesh_generation) return;
+		trig = std::move(*mesh);
+		mesh_bvh = std::move(*bvh);
+		VertexCacheStats before = trig.StatsBefore(), after = trig.StatsAfter();
+		std::cout << "ACMR " << before.acmr << " -> " << after.acmr
+		          << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+		for (size_t i = 0; i < trig.Lods().size(); i++) {
+			std::cout << "LOD " << i << ": " << trig.Lods()[i].count / 3 << " triangles, error "
+			          << trig.Lods()[i].error << ", " << trig.Lods()[i].meshlet_count << " meshlets" << std::endl;
+		}
+		std::cout << "BVH: " << mesh_bvh.NodeCount() << " nodes" << std::endl;
+		upload_finished_mesh();
+	};
+	if (use_async_loading) {
+		jobs.Submit(work, finish);
+		update_idle_func();
+	} else {
+		work();
+		finish();
+	}
+}
+
+void upload_finished_mesh(void) {
+	// upload the normalized mesh with the normals of the render mode
+	if (trig.VertexCount() > 0) {
+		setup_vertex_position_buffer_object();
+		setup_vertex_uv_buffer_object();
+		setup_vertex_normal_buffer_object(use_smoothed_normals);
+		setup_vertex_index_buffer_object();
+	}
+	stream_capacity = 0;
 	modelMatrix = get_default_modelMatrix();
 	normalMatrix = get_default_normalMatrix();
+	place_lights();
+	update_idle_func();
+}
+
+void load_model(char *path) {
+	mesh_generation++;
+	trig = TriangleMesh();
+	mesh_bvh = Bvh();
+	if (mesh_stream.Start(path)) update_idle_func();
 }
 
 void menu1(int id) {
@@ -318,6 +1103,17 @@ void menu1(int id) {
 		texture_path = NULL;
 		useTexture = 0;
 	}
+	else if (id == 4) { //Clustered
+		if (!light_clusters.Supported()) {
+			std::cerr << "Clustered lighting needs OpenGL 3.1" << std::endl;
+			return;
+		}
+		vertexshader_path = clustered_shader_v;
+		fragmentshader_path = clustered_shader_f;
+		use_smoothed_normals = true;
+		texture_path = NULL;
+		useTexture = 0;
+	}
 	setup_data();
 	glutPostRedisplay();
 }
@@ -345,24 +1141,38 @@ void menu2(int id) {
 	glutPostRedisplay();
 }
 
+void menu3(int id) {
+	if (id == 2 && !gbuffer.Supported()) {
+		std::cerr << "Deferred shading needs OpenGL 3.0" << std::endl;
+		return;
+	}
+	use_deferred = id == 2; // 1 is Forward, 2 Deferred
+	glutPostRedisplay();
+}
+
 void mainmenu(int id) {
 	//Do nothing, just show the menu
 }
 
 
 void setup_menu() {
-	int submenu1, submenu2;
+	int submenu1, submenu2, submenu3;
 	submenu1 = glutCreateMenu(menu1);
 	glutAddMenuEntry("Flat", 1);
 	glutAddMenuEntry("Gourard", 2);
 	glutAddMenuEntry("Phong", 3);
+	glutAddMenuEntry("Phong (many lights)", 4);
 	submenu2 = glutCreateMenu(menu2);
 	glutAddMenuEntry("Decal", 1);
 	glutAddMenuEntry("Bump", 2);
 	glutAddMenuEntry("Spherical", 3);
+	submenu3 = glutCreateMenu(menu3);
+	glutAddMenuEntry("Forward", 1);
+	glutAddMenuEntry("Deferred", 2);
 	glutCreateMenu(mainmenu);
 	glutAddSubMenu("Shaders", submenu1);
 	glutAddSubMenu("Textures", submenu2);
+	glutAddSubMenu("Pipeline", submenu3);
 	glutAttachMenu(GLUT_RIGHT_BUTTON);
 }
 
@@ -383,7 +1193,9 @@ int main(int argc, char **argv) {
 	// set display and keyboard callbacks and setup menu
 	glutDisplayFunc(display_handler);
 	glutKeyboardFunc(keyboard_handler);
+	glutMouseFunc(mouse_handler);
 	setup_menu();
+	atexit(cleanup);
 
 	// initialise the OpenGL Extension Wrangler library for VBOs
 	glewExperimental = GL_TRUE;
@@ -397,8 +1209,31 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
-	// create shader, prepare data for OpenGL
-	trig.LoadFile(model_path);
+	// the workers loading textures and finishing models
+	jobs.Start();
+
+	// the depth pass of the shadows
+	depth_shader.Init(depth_shader_v, depth_shader_f);
+	shadow_map.Init();
+	overdraw.Init();
+	// the point lights of the clustered shader
+	light_clusters.Init();
+	place_lights();
+	// the two passes of deferred shading
+	if (gbuffer.Init()) {
+		gbuffer_shader.Init(gbuffer_shader_v, gbuffer_shader_f);
+		deferred_shader.Init(deferred_shader_v, deferred_shader_f);
+	}
+	// the meshes of the gallery, drawn together
+	if (geometry_pool.Init()) gallery_shader.Init(gallery_shader_v, gallery_shader_f);
+
+	// run the benchmarks instead of the interactive application
+	if (argc > 1 && strcmp(argv[1], "--benchmark") == 0) {
+		return run_benchmark(argc - 2, argv + 2);
+	}
+
+	// create shader, prepare data for OpenGL - the model is drawn as it loads
+	load_model(model_path);
 	setup_data();
 
 	glutMainLoop();
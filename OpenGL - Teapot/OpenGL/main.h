@@ -14,6 +14,24 @@
 #include "utils.h"           // generic helper functions
 #include "scene_constants.h" // material and light properties
 #include "path_to_files.h"   // paths to textures and shaders
+#include "FrameCapture.h"    // recording frames to disk
+#include "Profiler.h"        // frame timing
+#include "benchmark.h"       // rendering benchmarks
+#include "MeshStream.h"      // background model loading
+#include "Bvh.h"             // ray casting for picking
+#include "ShadowMap.h"       // shadows of the light
+#include "LightClusters.h"   // many point lights
+#include "GBuffer.h"         // deferred shading
+#include "OverdrawCounter.h" // fragments shaded per pixel
+#include "bmp_loader.h"      // texture loading
+#include "compressed_texture.h" // block compressed textures
+#include "TextureCache.h"    // textures shared between modes
+#include "JobSystem.h"       // background loading
+#include "ThreadPool.h"      // parallel work
+#include "buffer_upload.h"   // writing straight into buffers
+#include "StreamBuffer.h"    // per-frame data
+#include "GeometryPool.h"    // many meshes in few draws
+#include "mesh_generator.h"  // the meshes of the gallery
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -21,14 +39,79 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 /**
- * The main function of the application - handles drawing
+ * The main function of the application - handles drawing, with
+ * |display_gallery| while the gallery shows, |display_deferred| when the
+ * deferred pipeline is selected and |display_forward| otherwise, then
+ * records and flushes the frame
+ */
+void display_handler(void);
+
+/**
+ * Draws the scene with the selected shader
  * - clears the screen
  * - binds the shader
+ * - redraws the shadow map if the shader samples it
+ * - sorts the lights into clusters if the shader shades with them
+ * - lays down the depths first if the depth pre-pass is on
  * - activates textures
  * - sends uniform variables, vertex attributes to the shader
- * - draws the scene
+ * - draws the scene, counting its overdraw while the timing overlay shows
  */
-void display_handler(void);
+void display_forward(void);
+
+/**
+ * Draws the gallery - many meshes of different kinds and sizes, all held in
+ * |geometry_pool| - with |gallery_shader|, in one multi-draw call if
+ * |use_gallery_batching| is set and supported, else one call per mesh
+ */
+void display_gallery(void);
+
+/**
+ * Generate the meshes of the gallery the first time it shows, on the
+ * workers of |jobs| like other loads, and add each to |geometry_pool| as
+ * it is done, on a grid over the window and scaled to fit its cell
+ */
+void setup_gallery(void);
+
+/**
+ * Draw the depths of the scene from the vertex positions alone with
+ * |depth_shader|, then leave the depth test at ``GL_EQUAL`` with depth writes
+ * off, so the shading pass runs its shader once per pixel - only on the
+ * fragments that end up visible. Every vertex shader declares
+ * ``gl_Position`` invariant so both passes compute the same depths
+ */
+void render_depth_prepass(void);
+
+/**
+ * Draws the scene with deferred shading, lit as the Phong mode does
+ * - the shadow map
+ * - the geometry pass: albedo, normals and depth into |gbuffer|
+ * - the lighting pass: a quad over the window shading every pixel once,
+ *   however many layers of the mesh were drawn under it
+ */
+void display_deferred(void);
+
+/**
+ * Draw |mesh_layers| copies of the mesh, each a little closer to the viewer
+ * than the last, sending their model matrices to |modelMatrix_location|
+ * One copy is the scene; more of them pile up depth complexity for the
+ * forward/deferred comparison of the benchmark
+ */
+void draw_mesh(GLint modelMatrix_location);
+
+/**
+ * Bind the vertex uv coordinates, positions and normals to the attributes
+ * of |program| that use them, storing their locations in |locations|, and
+ * disable those again
+ */
+void enable_vertex_attributes(GLuint program, GLint locations[3]);
+void disable_vertex_attributes(GLint locations[3]);
+
+/**
+ * Set the shadow uniforms of |program| and bind |shadow_map| to the texture
+ * unit |unit|
+ */
+void bind_shadow_map(GLuint program, int unit);
 
 /**
  * Callback for keyboard events
@@ -39,11 +122,104 @@ void display_handler(void);
  * - ``q w e r t y`` to translate the model in the +/- direction of the 3 axes
  * - ``a s d f g h`` to rotate the model in the +/- direction of the 3 axes
  * - ``(space)`` to reset to the default perspective
+ * - ``+ -`` to zoom in and out
+ * - ``c`` to start or stop recording frames to |capture_dir|
+ * - ``m`` to turn meshlet culling on or off
+ * - ``[ ]`` to halve or double the lights of the clustered shader
+ * - ``z`` to turn the depth pre-pass on or off
+ * - ``u`` to switch the mipmaps of the texture between none, box filtered
+ *   and generated by the driver
+ * - ``i`` to double the anisotropic filtering, 1x again after 16x
+ * - ``k`` to switch between block compressed and uncompressed textures
+ * - ``l`` to switch between loading textures and finishing models on the
+ *   workers of |jobs| and loading them while the frame waits
+ * - ``o`` to show the gallery of generated meshes instead of the model
+ * - ``b`` to switch between drawing the gallery in one multi-draw call and
+ *   one call per mesh
+ * - ``p`` to show or hide the overlay of frame timings, overdraw (or the
+ *   draw calls of the gallery) and texture cache stats
+ * - ``P`` to export the frame timings to |profile_csv| and |profile_json|
  */
 void keyboard_handler(unsigned char key, int x, int y);
 
+/**
+ * Callback for mouse events
+ * A click of the left button prints the triangle under the cursor, the
+ * barycentric coordinates of the point hit on it and its world position
+ * (the right button opens the menu)
+ */
+void mouse_handler(int button, int state, int x, int y);
+
+/**
+ * Find the triangle of the mesh under the window coordinates |x y|
+ * Casts the cursor's line of sight through |mesh_bvh|, the hierarchy built
+ * over the mesh once it has loaded; |position| is the hit in world
+ * coordinates. Returns false if nothing is under the cursor
+ */
+bool pick_triangle(int x, int y, RayHit &hit, glm::vec3 &position);
+
+/**
+ * Choose the level of detail to draw (see TriangleMesh::Lods)
+ * Picks the coarsest level whose error covers less than |lod_error_pixels|
+ * on screen, projecting the error at the nearest point of the mesh's
+ * bounding sphere, unless |forced_lod| selects one
+ */
+int select_lod(void);
+
+/**
+ * Draw the meshlets of |lod| that survive frustum and normal cone culling
+ * with one ``glMultiDrawElementsIndirect`` call, or ``glMultiDrawElements``
+ * where indirect draws aren't supported
+ * The commands go into this frame's region of |draw_command_stream| (see
+ * StreamBuffer), so the draws of the last frames needn't be done with them
+ * The index buffer must be bound
+ */
+void draw_meshlets(const MeshLod &lod);
+
+/**
+ * The bounding sphere of the mesh in view coordinates - while it streams in,
+ * of the box it is being normalized into
+ */
+void mesh_bounds(glm::vec3 &center, float &radius);
+
+/**
+ * Scatter |light_count| point lights through and around the mesh for the
+ * clustered shader (see generate_lights)
+ */
+void place_lights(void);
+
+/**
+ * Sort |scene_lights| into the clusters of the current view, slicing the
+ * depths the mesh covers, on up to |threads| threads - all there are if 0
+ */
+void assign_lights(int threads = 0);
+
+/**
+ * Draw the depths of the mesh as seen from |lightPosition| into
+ * |shadow_map| with |depth_shader|, reusing the vertex buffers of the scene
+ * Only does so when the map is out of date - the mesh changed or moved
+ * relative to the light - so a still scene pays for it once
+ */
+void render_shadow_map(void);
+
+/**
+ * Callback for idle time
+ * Uploads the chunks of the model that finished loading and runs the
+ * completions of the finished |jobs|, together for no more than
+ * |upload_budget_ms|, and requests a redraw, so frames keep coming while a
+ * model streams in, files load or a recording runs
+ */
+void idle_handler(void);
+
+/**
+ * Register |idle_handler| while a model is streaming, jobs are pending or
+ * frames are being recorded, unregister it otherwise
+ */
+void update_idle_func(void);
+
 /**
  * The function that is called after the application closes
+ * Finishes any recording that is still running
  */
 void cleanup(void);
 
@@ -52,15 +228,54 @@ void cleanup(void);
 //                              Helper functions                             //
 ///////////////////////////////////////////////////////////////////////////////
 
+/** BC5 for the normal maps, which keep two channels, BC1 for the rest **/
+Block_Format texture_block_format(const char *path);
+
+/**
+ * Read a ``bmp`` file from |path| (see load_bmp_texture) into |texture|,
+ * with the mipmaps of |texture_mipmaps|
+ * With |use_compressed_textures| it is block compressed (see
+ * load_compressed_texture) to texture_block_format(|path|)
+ */
+bool load_texture_file(const char *path, GLuint texture);
+
 /**
- * Read a ``bmp`` file from |texture_path|
- * Load the texture into video memory and bind it to |textureID|
+ * Make the texture at |texture_path| - none if NULL - the one in |textureID|
+ * and bind it, with |texture_anisotropy| times anisotropic filtering
+ * Textures come from |texture_cache|, loaded with load_texture_file only if
+ * they aren't resident; the texture |textureID| held before goes back to it.
+ * They are cached per block format and mipmap mode, so the same bytes used
+ * as a normal map and as a color map are two textures
+ *
+ * With |use_async_loading| a texture that isn't resident is decoded on the
+ * workers (see load_wanted_texture) and the last one stays in use until it
+ * has been uploaded
  */
 void setup_texture(char *texture_path, GLuint *textureID);
 
+/**
+ * Release the texture in |textureID| to |texture_cache| and put |texture|,
+ * acquired from it, there instead, bound and filtered
+ */
+void use_texture(GLuint *textureID, GLuint texture);
+
+/**
+ * Load the texture setup_texture asked for last on a worker of |jobs|: the
+ * file is hashed and decoded - block compressed or read into BGRA pixels -
+ * there, and uploaded into a new texture handed to |texture_cache| when the
+ * job completes. Only one texture loads at a time; if another one has been
+ * asked for meanwhile the one that arrived stays in the cache and that one
+ * is loaded next
+ */
+void load_wanted_texture(GLuint *textureID);
+
 /**
  * Create a buffer object for vertex positions
  * Bind it to the |vertex_position_buffer| global variable
+ *
+ * Like the other vertex buffers it is filled straight from the mesh's arrays
+ * through write_buffer, mapped unless |use_buffer_mapping| is off, so the
+ * vertices gathered for indexed draws are written to the buffer itself
  */
 void setup_vertex_position_buffer_object(void);
 
@@ -71,17 +286,79 @@ void setup_vertex_position_buffer_object(void);
 void setup_vertex_uv_buffer_object(void);
 
 /**
- * Compute normals for all the vertices in the application's triangle mesh
+ * Create a buffer object for the triangles of the optimized mesh
+ * Bind it to the |vertex_index_buffer| global variable
+ * Does nothing unless use_indexed_draw is true
+ */
+void setup_vertex_index_buffer_object(void);
+
+/**
+ * Whether the mesh is drawn from its optimized index buffer
+ * That is the case for the render modes with smoothed normals once the mesh
+ * has been optimized (see TriangleMesh::Optimize); flat shading draws the
+ * corners of the triangles separately
  *
- * If |smoothed| is set, the vertex normals are the average of the face normals
- * of the triangles that vertex participates in. If |smoothed| is not set, the
- * averaging step is left out.
+ * The vertex buffers hold the indexed vertices or the corners in triangle
+ * order accordingly
+ */
+bool use_indexed_draw(void);
+
+/**
+ * Compute normals for all the vertices in the application's triangle mesh
+ * (see TriangleMesh::ComputeNormals for the meaning of |smoothed|)
  *
  * Create a buffer object for vertex normals
  * Bind it to the |vertex_normal_buffer| global variable
  */
 void setup_vertex_normal_buffer_object(bool smoothed);
 
+/**
+ * Compile the current shader, load the current texture and upload the mesh
+ * Also resets the camera and object transformation matrices
+ */
+void setup_data(void);
+
+/**
+ * Start loading the model at |path| into the application's triangle mesh on
+ * a background thread. The triangles are drawn as they arrive
+ */
+void load_model(char *path);
+
+/**
+ * Append the triangles of |chunk| to the application's triangle mesh and to
+ * the vertex buffers, growing the buffers when they are full
+ * Until the model is complete |modelMatrix| does its normalization
+ */
+void append_mesh_chunk(MeshChunk &chunk);
+
+/**
+ * Normalize and optimize the completely loaded mesh and build its levels of
+ * detail, their meshlets and the picking hierarchy - on a copy, on a worker
+ * of |jobs| with |use_async_loading|, while the streamed triangles are drawn
+ * - then upload it with upload_finished_mesh. The levels of detail and the
+ * hierarchy are built at the same time, as a TaskGraph
+ */
+void finish_mesh_stream(void);
+
+/**
+ * Upload the finished mesh again with the normals of the current render
+ * mode and place the lights around it
+ */
+void upload_finished_mesh(void);
+
+/**
+ * Callbacks for the "Shaders" and "Textures" menus
+ * Select the shader, normals and texture of the render mode |id|
+ */
+void menu1(int id);
+void menu2(int id);
+
+/**
+ * Callback for the "Pipeline" menu
+ * Switches between forward (1) and deferred (2) shading
+ */
+void menu3(int id);
+
 /**
  * Returns the projection matrix as it was at the start of the application
  * The projection matrix is used to convert from view to screen coordinates
@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cmath>
+
+#include "mesh_generator.h"
+
+static const float PI = 3.14159265358979f;
+
+// A parametric surface - maps (u, v) in [0, 1] x [0, 1] to a position
+// The derivative along u crossed with the derivative along v must point
+// outwards so that the triangles are wound counter clockwise
+typedef glm::vec3 (*Surface)(float u, float v, const void *data);
+
+// Tessellate |surface| into |rows| x |cols| quads and append them to |mesh|
+static void add_grid(GeneratedMesh &mesh, int rows, int cols, Surface surface, const void *data) {
+    unsigned int base = mesh.positions.size();
+    for (int i = 0; i <= rows; i++) {
+        for (int j = 0; j <= cols; j++) {
+            float u = (float)j / cols;
+            float v = (float)i / rows;
+            mesh.positions.push_back(surface(u, v, data));
+            mesh.uvs.push_back(glm::vec2(u, v));
+        }
+    }
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            unsigned int a = base + i * (cols + 1) + j;
+            unsigned int b = a + 1;
+            unsigned int c = a + cols + 1;
+            unsigned int d = c + 1;
+            mesh.indices.push_back(a);
+            mesh.indices.push_back(b);
+            mesh.indices.push_back(c);
+            mesh.indices.push_back(b);
+            mesh.indices.push_back(d);
+            mesh.indices.push_back(c);
+        }
+    }
+}
+
+static void clear(GeneratedMesh &mesh) {
+    mesh.positions.clear();
+    mesh.uvs.clear();
+    mesh.indices.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                   Sphere                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+// one face of the cube - its normal is u_axis x v_axis
+struct CubeFace {
+    glm::vec3 normal, u_axis, v_axis;
+};
+
+static glm::vec3 sphere_surface(float u, float v, const void *data) {
+    const CubeFace *face = (const CubeFace *)data;
+    glm::vec3 p = face->normal + face->u_axis * (2.0f * u - 1.0f) + face->v_axis * (2.0f * v - 1.0f);
+    return glm::normalize(p) * 100.0f;
+}
+
+void generate_sphere(int triangles, GeneratedMesh &mesh) {
+    static const CubeFace faces[6] = {
+        { glm::vec3( 1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) },
+        { glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0) },
+        { glm::vec3( 0, 1, 0), glm::vec3(0, 0, 1), glm::vec3(1, 0, 0) },
+        { glm::vec3( 0,-1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1) },
+        { glm::vec3( 0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0) },
+        { glm::vec3( 0, 0,-1), glm::vec3(0, 1, 0), glm::vec3(1, 0, 0) },
+    };
+    // six faces of n x n quads, two triangles each
+    int n = (int)(sqrt(triangles / 12.0) + 0.5);
+    if (n < 1) n = 1;
+    clear(mesh);
+    for (int i = 0; i < 6; i++) add_grid(mesh, n, n, sphere_surface, &faces[i]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                   Torus                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+static glm::vec3 torus_surface(float u, float v, const void *) {
+    const float R = 75.0f, r = 25.0f;
+    float theta = 2.0f * PI * u;
+    float phi = 2.0f * PI * v;
+    float ring = R + r * cos(phi);
+    return glm::vec3(ring * cos(theta), -r * sin(phi), ring * sin(theta));
+}
+
+void generate_torus(int triangles, GeneratedMesh &mesh) {
+    // three times as many segments around the ring as around the tube
+    int rows = (int)(sqrt(triangles / 6.0) + 0.5);
+    if (rows < 3) rows = 3;
+    clear(mesh);
+    add_grid(mesh, rows, 3 * rows, torus_surface, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                   Teapot                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+// cubic Bezier profile curve (radius, height) revolved around the y axis
+struct Profile {
+    float r[4], y[4];
+};
+
+static float bezier(const float p[4], float t) {
+    float s = 1.0f - t;
+    return s * s * s * p[0] + 3 * s * s * t * p[1] + 3 * s * t * t * p[2] + t * t * t * p[3];
+}
+
+static glm::vec3 teapot_surface(float u, float v, const void *data) {
+    const Profile *profile = (const Profile *)data;
+    // keep the patches that touch the axis from collapsing into points
+    float r = bezier(profile->r, v);
+    if (r < 0.001f) r = 0.001f;
+    float y = bezier(profile->y, v);
+    float theta = 2.0f * PI * u;
+    return glm::vec3(r * cos(theta), y, r * sin(theta)) * 40.0f;
+}
+
+void generate_teapot(int triangles, GeneratedMesh &mesh) {
+    // control points of the rotationally symmetric Newell teapot patches,
+    // each traced so that the outside of the pot is on its left
+    static const Profile profiles[6] = {
+        { { 1.4f, 1.3375f, 1.4375f, 1.5f }, { 2.4f, 2.53125f, 2.53125f, 2.4f } },  // rim
+        { { 1.5f, 1.75f, 2.0f, 2.0f },      { 2.4f, 1.875f, 1.35f, 0.9f } },       // upper body
+        { { 2.0f, 2.0f, 1.5f, 1.5f },       { 0.9f, 0.45f, 0.225f, 0.15f } },      // lower body
+        { { 1.5f, 1.5f, 0.8f, 0.0f },       { 0.15f, 0.0f, 0.0f, 0.0f } },         // bottom
+        { { 0.0f, 0.8f, 0.0f, 0.2f },       { 3.15f, 3.15f, 2.85f, 2.7f } },       // lid knob
+        { { 0.2f, 0.4f, 1.3f, 1.3f },       { 2.7f, 2.55f, 2.55f, 2.4f } },        // lid
+    };
+    // six patches of rows x (2 * rows) quads, two triangles each
+    int rows = (int)(sqrt(triangles / 24.0) + 0.5);
+    if (rows < 2) rows = 2;
+    clear(mesh);
+    for (int i = 0; i < 6; i++) add_grid(mesh, rows, 2 * rows, teapot_surface, &profiles[i]);
+}
+
+bool write_obj(const char *path, const GeneratedMesh &mesh) {
+    FILE *file = fopen(path, "w");
+    if (!file) return false;
+    for (size_t i = 0; i < mesh.positions.size(); i++) {
+        const glm::vec3 &p = mesh.positions[i];
+        fprintf(file, "v %.9g %.9g %.9g\n", p.x, p.y, p.z);
+    }
+    for (size_t i = 0; i < mesh.uvs.size(); i++) {
+        fprintf(file, "vt %.6f %.6f\n", mesh.uvs[i].x, mesh.uvs[i].y);
+    }
+    // obj indices start at 1, positions and uvs share the same index
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        unsigned int a = mesh.indices[i] + 1, b = mesh.indices[i + 1] + 1, c = mesh.indices[i + 2] + 1;
+        fprintf(file, "f %u/%u %u/%u %u/%u\n", a, a, b, b, c, c);
+    }
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef _mesh_generator_H
+#define _mesh_generator_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * An indexed triangle mesh produced by one of the generators below
+ * Every vertex has a position and a uv coordinate
+ */
+struct GeneratedMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;
+    std::vector<unsigned int> indices;
+
+    int TriangleCount() const { return indices.size() / 3; }
+};
+
+/**
+ * The generators are deterministic and choose their tessellation so that
+ * the result has close to |triangles| triangles. None of them produce
+ * degenerate triangles, so every face has a well defined normal.
+ */
+
+/** A sphere made of the six faces of a subdivided cube pushed outwards **/
+void generate_sphere(int triangles, GeneratedMesh &mesh);
+
+/** A torus with a 3:1 ratio between its radii **/
+void generate_torus(int triangles, GeneratedMesh &mesh);
+
+/**
+ * The rim, body, bottom and lid of the Utah teapot as bicubic patches of
+ * revolution around the vertical axis (the handle and spout are left out)
+ */
+void generate_teapot(int triangles, GeneratedMesh &mesh);
+
+/** Write |mesh| as an ``obj`` file with ``v/vt`` faces **/
+bool write_obj(const char *path, const GeneratedMesh &mesh);
+
+#endif
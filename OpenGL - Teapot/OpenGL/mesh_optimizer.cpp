@@ -0,0 +1,236 @@
+#include <cmath>
+#include <algorithm>
+
+#include "mesh_optimizer.h"
+
+VertexCacheStats analyze_vertex_cache(const std::vector<unsigned int> &indices, int vertex_count,
+                                      int cache_size) {
+    // the time each vertex entered the cache, it is cached while that
+    // happened less than |cache_size| misses ago
+    std::vector<int> entered(vertex_count, -1 - cache_size);
+    int misses = 0;
+    for (size_t i = 0; i < indices.size(); i++) {
+        unsigned int v = indices[i];
+        if (misses - entered[v] > cache_size) {
+            entered[v] = misses;
+            misses++;
+        }
+    }
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    if (!indices.empty()) stats.acmr = (float)misses / (indices.size() / 3);
+    if (vertex_count > 0) stats.atvr = (float)misses / vertex_count;
+    return stats;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                               Vertex cache                                //
+///////////////////////////////////////////////////////////////////////////////
+
+// the LRU cache the scores are modelled on, plus room for one triangle
+static const int FORSYTH_CACHE_SIZE = 32;
+
+// how much drawing a triangle of this vertex next is worth
+static float forsyth_score(int cache_position, int live_triangles) {
+    if (live_triangles == 0) return -1.0f;
+    float score = 0.0f;
+    if (cache_position >= 0) {
+        // the last triangle's vertices are scored lower so that strips
+        // don't just go back and forth
+        if (cache_position < 3) {
+            score = 0.75f;
+        } else {
+            float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = pow(1.0f - (cache_position - 3) * scale, 1.5f);
+        }
+    }
+    // favour vertices with few triangles left so none are left stranded
+    return score + 2.0f / sqrt((float)live_triangles);
+}
+
+void optimize_vertex_cache(std::vector<unsigned int> &indices, int vertex_count) {
+    int triangle_count = indices.size() / 3;
+    if (triangle_count == 0) return;
+
+    // triangles of each vertex, the first |live| of them not yet drawn
+    std::vector<int> live(vertex_count, 0), offset(vertex_count + 1, 0);
+    for (size_t i = 0; i < indices.size(); i++) live[indices[i]]++;
+    for (int v = 0; v < vertex_count; v++) offset[v + 1] = offset[v] + live[v];
+    std::vector<int> adjacency(indices.size());
+    std::vector<int> filled(offset.begin(), offset.end() - 1);
+    for (int t = 0; t < triangle_count; t++) {
+        for (int k = 0; k < 3; k++) adjacency[filled[indices[3 * t + k]]++] = t;
+    }
+
+    std::vector<float> vertex_score(vertex_count), triangle_score(triangle_count, 0.0f);
+    for (int v = 0; v < vertex_count; v++) vertex_score[v] = forsyth_score(-1, live[v]);
+    for (int t = 0; t < triangle_count; t++) {
+        for (int k = 0; k < 3; k++) triangle_score[t] += vertex_score[indices[3 * t + k]];
+    }
+    std::vector<bool> drawn(triangle_count, false);
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    std::vector<unsigned int> cache, next_cache;
+    int best = -1, cursor = 0;
+    while ((int)result.size() < 3 * triangle_count) {
+        // without a good candidate around the cache continue in file order
+        if (best < 0) {
+            while (drawn[cursor]) cursor++;
+            best = cursor;
+        }
+        drawn[best] = true;
+        const unsigned int *triangle = &indices[3 * best];
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = triangle[k];
+            result.push_back(v);
+            // take the triangle off the vertex' live list
+            int *begin = &adjacency[offset[v]];
+            int *end = begin + live[v];
+            *std::find(begin, end, best) = end[-1];
+            live[v]--;
+        }
+
+        // the triangle's vertices move to the front of the cache
+        next_cache.clear();
+        for (int k = 0; k < 3; k++) {
+            if (std::find(next_cache.begin(), next_cache.end(), triangle[k]) == next_cache.end()) {
+                next_cache.push_back(triangle[k]);
+            }
+        }
+        for (size_t i = 0; i < cache.size(); i++) {
+            unsigned int v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) next_cache.push_back(v);
+        }
+        // the vertices that fall out of it lose their cache bonus
+        for (size_t i = FORSYTH_CACHE_SIZE; i < next_cache.size(); i++) {
+            unsigned int v = next_cache[i];
+            float score = forsyth_score(-1, live[v]);
+            float delta = score - vertex_score[v];
+            vertex_score[v] = score;
+            for (int j = 0; j < live[v]; j++) triangle_score[adjacency[offset[v] + j]] += delta;
+        }
+        if (next_cache.size() > FORSYTH_CACHE_SIZE) next_cache.resize(FORSYTH_CACHE_SIZE);
+        cache.swap(next_cache);
+
+        // rescore the vertices in the cache and pick the best of their triangles
+        best = -1;
+        float best_score = -1.0f;
+        for (size_t i = 0; i < cache.size(); i++) {
+            unsigned int v = cache[i];
+            float score = forsyth_score(i, live[v]);
+            float delta = score - vertex_score[v];
+            vertex_score[v] = score;
+            for (int j = 0; j < live[v]; j++) {
+                int t = adjacency[offset[v] + j];
+                triangle_score[t] += delta;
+            }
+        }
+        for (size_t i = 0; i < cache.size(); i++) {
+            unsigned int v = cache[i];
+            for (int j = 0; j < live[v]; j++) {
+                int t = adjacency[offset[v] + j];
+                if (triangle_score[t] > best_score) {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+    }
+    indices.swap(result);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 Overdraw                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+struct Cluster {
+    int first, count;  // in triangles
+    float sort_key;
+};
+
+static bool cluster_before(const Cluster &a, const Cluster &b) {
+    return a.sort_key > b.sort_key;
+}
+
+void optimize_overdraw(std::vector<unsigned int> &indices, const std::vector<glm::vec3> &positions,
+                       int cache_size) {
+    int triangle_count = indices.size() / 3;
+    if (triangle_count == 0) return;
+
+    // a cluster ends where the cache starts over, at a triangle whose
+    // vertices all miss, so moving clusters around keeps the cache hits
+    std::vector<Cluster> clusters;
+    std::vector<int> entered(positions.size(), -1 - cache_size);
+    int misses = 0;
+    for (int t = 0; t < triangle_count; t++) {
+        int triangle_misses = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[3 * t + k];
+            if (misses - entered[v] > cache_size) {
+                entered[v] = misses;
+                misses++;
+                triangle_misses++;
+            }
+        }
+        if (t == 0 || triangle_misses == 3) {
+            Cluster cluster = { t, 0, 0.0f };
+            clusters.push_back(cluster);
+        }
+        clusters.back().count++;
+    }
+
+    // area weighted centroids and normals
+    glm::vec3 mesh_center(0.0f);
+    float mesh_area = 0.0f;
+    std::vector<glm::vec3> centers(clusters.size()), normals(clusters.size());
+    for (size_t c = 0; c < clusters.size(); c++) {
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (int t = clusters[c].first; t < clusters[c].first + clusters[c].count; t++) {
+            const glm::vec3 &a = positions[indices[3 * t]];
+            const glm::vec3 &b = positions[indices[3 * t + 1]];
+            const glm::vec3 &d = positions[indices[3 * t + 2]];
+            glm::vec3 n = glm::cross(b - a, d - a);
+            float triangle_area = glm::length(n);
+            center += (a + b + d) * (triangle_area / 3.0f);
+            normal += n;
+            area += triangle_area;
+        }
+        mesh_center += center;
+        mesh_area += area;
+        centers[c] = area > 0.0f ? center / area : center;
+        normals[c] = normal;
+    }
+    if (mesh_area > 0.0f) mesh_center /= mesh_area;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        float length = glm::length(normals[c]);
+        clusters[c].sort_key = length > 0.0f ? glm::dot(centers[c] - mesh_center, normals[c] / length) : 0.0f;
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), cluster_before);
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c = 0; c < clusters.size(); c++) {
+        result.insert(result.end(), indices.begin() + 3 * clusters[c].first,
+                      indices.begin() + 3 * (clusters[c].first + clusters[c].count));
+    }
+    indices.swap(result);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                               Vertex fetch                                //
+///////////////////////////////////////////////////////////////////////////////
+
+void optimize_vertex_fetch(std::vector<unsigned int> &indices, int vertex_count,
+                           std::vector<unsigned int> &remap) {
+    std::vector<int> new_index(vertex_count, -1);
+    remap.clear();
+    for (size_t i = 0; i < indices.size(); i++) {
+        unsigned int v = indices[i];
+        if (new_index[v] < 0) {
+            new_index[v] = remap.size();
+            remap.push_back(v);
+        }
+        indices[i] = new_index[v];
+    }
+}
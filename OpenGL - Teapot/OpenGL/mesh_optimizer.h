@@ -0,0 +1,56 @@
+#ifndef _mesh_optimizer_H
+#define _mesh_optimizer_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * Reordering passes for indexed triangle lists, meant to be run in this
+ * order once a mesh has been loaded:
+ * - optimize_vertex_cache for reuse in the post-transform vertex cache
+ * - optimize_overdraw to draw the outward facing parts of the mesh first
+ * - optimize_vertex_fetch to lay the vertices out in the order they are used
+ *
+ * Each pass keeps the winding of every triangle.
+ */
+
+/** Vertex cache efficiency of an index buffer **/
+struct VertexCacheStats {
+    float acmr;  // vertices transformed per triangle, 0.5 at best and 3 at worst
+    float atvr;  // vertices transformed per vertex of the mesh, 1 at best
+};
+
+/** Size of the FIFO cache the statistics and the overdraw pass assume **/
+const int VERTEX_CACHE_SIZE = 16;
+
+/**
+ * Simulate a FIFO cache of |cache_size| entries while drawing |indices|,
+ * which index |vertex_count| vertices
+ */
+VertexCacheStats analyze_vertex_cache(const std::vector<unsigned int> &indices, int vertex_count,
+                                      int cache_size = VERTEX_CACHE_SIZE);
+
+/**
+ * Reorder the triangles of |indices| for vertex cache reuse with Tom
+ * Forsyth's linear-speed algorithm, which doesn't depend on the exact size
+ * of the cache
+ */
+void optimize_vertex_cache(std::vector<unsigned int> &indices, int vertex_count);
+
+/**
+ * Split the cache optimized |indices| into clusters where the cache starts
+ * over and sort the clusters so that the ones facing away from the center of
+ * the mesh come first - they are the most likely to occlude the rest
+ */
+void optimize_overdraw(std::vector<unsigned int> &indices, const std::vector<glm::vec3> &positions,
+                       int cache_size = VERTEX_CACHE_SIZE);
+
+/**
+ * Renumber the vertices in the order |indices| first uses them
+ * |remap| receives the old index of every new vertex; vertices that no
+ * triangle uses are dropped
+ */
+void optimize_vertex_fetch(std::vector<unsigned int> &indices, int vertex_count,
+                           std::vector<unsigned int> &remap);
+
+#endif
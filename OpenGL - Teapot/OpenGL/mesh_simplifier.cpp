@@ -0,0 +1,201 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#include "mesh_simplifier.h"
+
+// Sum of the squared distances to a set of planes, weighted by the area of
+// the triangles they came from. Only the upper half of the symmetric 4x4
+// matrix is stored.
+struct Quadric {
+    double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+    double area;
+};
+
+static Quadric plane_quadric(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+    glm::vec3 n = glm::cross(b - a, c - a);
+    double length = glm::length(n);
+    Quadric q;
+    memset(&q, 0, sizeof(q));
+    if (length == 0.0) return q;
+    double x = n.x / length, y = n.y / length, z = n.z / length;
+    double w = -(x * a.x + y * a.y + z * a.z);
+    double area = length * 0.5;
+    q.xx = area * x * x; q.xy = area * x * y; q.xz = area * x * z; q.xw = area * x * w;
+    q.yy = area * y * y; q.yz = area * y * z; q.yw = area * y * w;
+    q.zz = area * z * z; q.zw = area * z * w;
+    q.ww = area * w * w;
+    q.area = area;
+    return q;
+}
+
+static void quadric_add(Quadric &q, const Quadric &r) {
+    q.xx += r.xx; q.xy += r.xy; q.xz += r.xz; q.xw += r.xw;
+    q.yy += r.yy; q.yz += r.yz; q.yw += r.yw;
+    q.zz += r.zz; q.zw += r.zw;
+    q.ww += r.ww;
+    q.area += r.area;
+}
+
+// the mean squared distance of |p| to the planes of |q|
+static double quadric_error(const Quadric &q, const glm::vec3 &p) {
+    double x = p.x, y = p.y, z = p.z;
+    double error = q.xx * x * x + 2 * q.xy * x * y + 2 * q.xz * x * z + 2 * q.xw * x
+                 + q.yy * y * y + 2 * q.yz * y * z + 2 * q.yw * y
+                 + q.zz * z * z + 2 * q.zw * z
+                 + q.ww;
+    return q.area > 0.0 ? fabs(error) / q.area : 0.0;
+}
+
+struct PositionHash {
+    size_t operator()(const glm::vec3 &p) const {
+        unsigned int bits[3];
+        memcpy(bits, &p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+struct PositionEqual {
+    bool operator()(const glm::vec3 &a, const glm::vec3 &b) const {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+};
+
+// An edge that can be collapsed by moving |from| onto |to|
+struct Collapse {
+    unsigned int from, to;
+    double cost;
+};
+
+static bool cheaper(const Collapse &a, const Collapse &b) {
+    return a.cost < b.cost;
+}
+
+// Whether moving |from| onto |to| keeps every other triangle around |from|
+// facing the same way
+static bool keeps_orientation(const std::vector<unsigned int> &indices, const std::vector<glm::vec3> &positions,
+                              const int *triangles, int count, unsigned int from, unsigned int to) {
+    for (int i = 0; i < count; i++) {
+        const unsigned int *t = &indices[3 * triangles[i]];
+        if (t[0] == to || t[1] == to || t[2] == to) continue;  // collapses away
+        glm::vec3 p[3], moved[3];
+        for (int k = 0; k < 3; k++) {
+            p[k] = positions[t[k]];
+            moved[k] = t[k] == from ? positions[to] : p[k];
+        }
+        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+        if (glm::dot(before, after) <= 0.0f) return false;
+    }
+    return true;
+}
+
+float simplify_mesh(const std::vector<unsigned int> &indices, const std::vector<glm::vec3> &positions,
+                    size_t target_index_count, std::vector<unsigned int> &result) {
+    int vertex_count = positions.size();
+    result = indices;
+    if (indices.empty()) return 0.0f;
+
+    // vertices that share a position, the first of them stands for all
+    std::vector<unsigned int> canonical(vertex_count);
+    std::vector<int> siblings(vertex_count, 0);
+    std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> first_at;
+    for (int v = 0; v < vertex_count; v++) {
+        canonical[v] = first_at.insert(std::make_pair(positions[v], (unsigned int)v)).first->second;
+        siblings[canonical[v]]++;
+    }
+
+    // lock the seams and the borders - an edge with one triangle
+    std::vector<bool> locked(vertex_count, false);
+    std::unordered_map<unsigned long long, int> edge_triangles;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        for (int k = 0; k < 3; k++) {
+            unsigned long long a = canonical[indices[i + k]], b = canonical[indices[i + (k + 1) % 3]];
+            edge_triangles[a < b ? (a << 32) | b : (b << 32) | a]++;
+        }
+    }
+    for (std::unordered_map<unsigned long long, int>::iterator it = edge_triangles.begin(); it != edge_triangles.end(); ++it) {
+        if (it->second == 1) {
+            locked[it->first >> 32] = true;
+            locked[it->first & 0xffffffffu] = true;
+        }
+    }
+    for (int v = 0; v < vertex_count; v++) {
+        if (siblings[canonical[v]] > 1 || locked[canonical[v]]) locked[v] = true;
+    }
+
+    std::vector<Quadric> quadrics(vertex_count);
+    memset(&quadrics[0], 0, sizeof(Quadric) * vertex_count);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        Quadric q = plane_quadric(positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]]);
+        for (int k = 0; k < 3; k++) quadric_add(quadrics[indices[i + k]], q);
+    }
+
+    double max_cost = 0.0;
+    std::vector<unsigned int> collapse_to(vertex_count);
+    std::vector<bool> touched(vertex_count);
+    std::vector<int> offset(vertex_count + 1), adjacency;
+    std::vector<Collapse> collapses;
+    while (result.size() > target_index_count) {
+        // triangles around each vertex
+        std::fill(offset.begin(), offset.end(), 0);
+        for (size_t i = 0; i < result.size(); i++) offset[result[i] + 1]++;
+        for (int v = 0; v < vertex_count; v++) offset[v + 1] += offset[v];
+        adjacency.resize(result.size());
+        std::vector<int> filled(offset.begin(), offset.end() - 1);
+        for (size_t i = 0; i < result.size(); i++) adjacency[filled[result[i]]++] = i / 3;
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int a = result[i + k], b = result[i + (k + 1) % 3];
+                for (int direction = 0; direction < 2; direction++) {
+                    if (!locked[a]) {
+                        Quadric q = quadrics[a];
+                        quadric_add(q, quadrics[b]);
+                        Collapse collapse = { a, b, quadric_error(q, positions[b]) };
+                        collapses.push_back(collapse);
+                    }
+                    std::swap(a, b);
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), cheaper);
+
+        // every collapse removes about two triangles; a vertex takes part in
+        // at most one collapse per pass so the rings they check stay valid
+        size_t budget = (result.size() - target_index_count) / 6 + 1;
+        size_t done = 0;
+        for (int v = 0; v < vertex_count; v++) collapse_to[v] = v;
+        std::fill(touched.begin(), touched.end(), false);
+        for (size_t i = 0; i < collapses.size() && done < budget; i++) {
+            const Collapse &c = collapses[i];
+            if (touched[c.from] || touched[c.to]) continue;
+            const int *ring = &adjacency[offset[c.from]];
+            int ring_size = offset[c.from + 1] - offset[c.from];
+            if (!keeps_orientation(result, positions, ring, ring_size, c.from, c.to)) continue;
+            collapse_to[c.from] = c.to;
+            quadric_add(quadrics[c.to], quadrics[c.from]);
+            for (int j = 0; j < ring_size; j++) {
+                for (int k = 0; k < 3; k++) touched[result[3 * ring[j] + k]] = true;
+            }
+            touched[c.to] = true;
+            max_cost = std::max(max_cost, c.cost);
+            done++;
+        }
+        if (done == 0) break;
+
+        // move the collapsed vertices and drop the triangles that vanished
+        size_t kept = 0;
+        for (size_t i = 0; i < result.size(); i += 3) {
+            unsigned int a = collapse_to[result[i]], b = collapse_to[result[i + 1]], c = collapse_to[result[i + 2]];
+            if (a == b || b == c || a == c) continue;
+            result[kept++] = a;
+            result[kept++] = b;
+            result[kept++] = c;
+        }
+        result.resize(kept);
+    }
+    return sqrt(max_cost);
+}
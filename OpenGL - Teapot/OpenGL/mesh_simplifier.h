@@ -0,0 +1,34 @@
+#ifndef _mesh_simplifier_H
+#define _mesh_simplifier_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * One level of detail of an indexed mesh
+ * The levels share the vertices and store their triangles one after the
+ * other in the same index buffer
+ */
+struct MeshLod {
+    unsigned int first, count;  // range of the index buffer, in indices
+    float error;                // how far the surface may have moved, in model units
+    unsigned int first_meshlet, meshlet_count;  // its meshlets, if any were built
+};
+
+/**
+ * Simplify the triangles |indices| of the vertices at |positions| down to
+ * about |target_index_count| indices with quadric error metric edge
+ * collapses, writing the new triangles to |result|
+ *
+ * Vertices are only ever collapsed into one of their neighbours, so the
+ * result uses a subset of the original vertices. Vertices on a uv or normal
+ * seam (several vertices at the same position) or on the border of the mesh
+ * are never moved, which keeps the seams and the outline intact - the
+ * result may stay above the target when they are all that is left.
+ *
+ * Returns the largest error of a collapse, in the units of |positions|
+ */
+float simplify_mesh(const std::vector<unsigned int> &indices, const std::vector<glm::vec3> &positions,
+                    size_t target_index_count, std::vector<unsigned int> &result);
+
+#endif
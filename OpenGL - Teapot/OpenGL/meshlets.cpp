@@ -0,0 +1,128 @@
+#include <cmath>
+#include <algorithm>
+
+#include "meshlets.h"
+
+// Compute the bounds and normal cone of |meshlet| from its triangles
+static void finish_meshlet(Meshlet &meshlet, const std::vector<unsigned int> &indices,
+                           const std::vector<glm::vec3> &positions) {
+    glm::vec3 min(positions[indices[meshlet.first]]), max(min);
+    glm::vec3 axis(0.0f);
+    std::vector<glm::vec3> normals;
+    for (unsigned int i = meshlet.first; i < meshlet.first + meshlet.count; i += 3) {
+        const glm::vec3 &a = positions[indices[i]];
+        const glm::vec3 &b = positions[indices[i + 1]];
+        const glm::vec3 &c = positions[indices[i + 2]];
+        min = glm::min(min, glm::min(a, glm::min(b, c)));
+        max = glm::max(max, glm::max(a, glm::max(b, c)));
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float length = glm::length(n);
+        if (length == 0.0f) continue;
+        normals.push_back(n / length);
+        axis += normals.back();
+    }
+
+    meshlet.center = (min + max) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (unsigned int i = meshlet.first; i < meshlet.first + meshlet.count; i++) {
+        meshlet.radius = std::max(meshlet.radius, glm::length(positions[indices[i]] - meshlet.center));
+    }
+
+    // the cone spans the normal furthest from the average; past a right
+    // angle some triangle always faces the viewer
+    meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.cone_cutoff = 2.0f;
+    float length = glm::length(axis);
+    if (length == 0.0f) return;
+    axis /= length;
+    float min_dot = 1.0f;
+    for (size_t i = 0; i < normals.size(); i++) min_dot = std::min(min_dot, glm::dot(axis, normals[i]));
+    if (min_dot <= 0.0f) return;
+    meshlet.cone_axis = axis;
+    meshlet.cone_cutoff = sqrt(1.0f - min_dot * min_dot);
+}
+
+void build_meshlets(const std::vector<unsigned int> &indices, unsigned int first, unsigned int count,
+                    const std::vector<glm::vec3> &positions, std::vector<Meshlet> &meshlets) {
+    // the meshlet each vertex was last counted in
+    std::vector<int> used_by(positions.size(), -1);
+    int id = meshlets.size();
+    int vertices = 0;
+    Meshlet meshlet = { first, 0, glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), 0.0f };
+    for (unsigned int i = first; i < first + count; i += 3) {
+        int added = 0;
+        for (int k = 0; k < 3; k++) {
+            if (used_by[indices[i + k]] != id) added++;
+        }
+        if (meshlet.count > 0 && (vertices + added > MESHLET_MAX_VERTICES || meshlet.count / 3 == MESHLET_MAX_TRIANGLES)) {
+            finish_meshlet(meshlet, indices, positions);
+            meshlets.push_back(meshlet);
+            meshlet.first = i;
+            meshlet.count = 0;
+            vertices = 0;
+            id++;
+        }
+        for (int k = 0; k < 3; k++) {
+            if (used_by[indices[i + k]] != id) {
+                used_by[indices[i + k]] = id;
+                vertices++;
+            }
+        }
+        meshlet.count += 3;
+    }
+    if (meshlet.count > 0) {
+        finish_meshlet(meshlet, indices, positions);
+        meshlets.push_back(meshlet);
+    }
+}
+
+int cull_meshlets(const Meshlet *meshlets, int count, const glm::mat4 &projection, const glm::mat4 &modelview,
+                  std::vector<DrawElementsIndirectCommand> &commands) {
+    commands.clear();
+
+    // the frustum planes in model space, from the rows of the matrix
+    glm::mat4 mvp = projection * modelview;
+    glm::vec4 planes[6];
+    for (int i = 0; i < 3; i++) {
+        glm::vec4 row(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+        glm::vec4 w(mvp[0][3], mvp[1][3], mvp[2][3], mvp[3][3]);
+        planes[2 * i] = w + row;
+        planes[2 * i + 1] = w - row;
+    }
+    float plane_scale[6];
+    for (int i = 0; i < 6; i++) plane_scale[i] = glm::length(glm::vec3(planes[i]));
+
+    // where the viewer is in model space - a point for a perspective
+    // projection, only a direction for an orthographic one
+    glm::mat4 inverse = glm::inverse(modelview);
+    bool orthographic = projection[2][3] == 0.0f;
+    glm::vec3 eye = glm::vec3(inverse * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    glm::vec3 view_direction = glm::normalize(glm::vec3(inverse * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)));
+
+    int drawn = 0;
+    for (int m = 0; m < count; m++) {
+        const Meshlet &meshlet = meshlets[m];
+        bool visible = true;
+        for (int i = 0; i < 6 && visible; i++) {
+            if (glm::dot(glm::vec3(planes[i]), meshlet.center) + planes[i].w < -meshlet.radius * plane_scale[i]) visible = false;
+        }
+        if (visible && meshlet.cone_cutoff <= 1.0f) {
+            if (orthographic) {
+                visible = glm::dot(view_direction, meshlet.cone_axis) < meshlet.cone_cutoff;
+            } else {
+                // the sphere makes the test hold for every point of the meshlet
+                glm::vec3 to_center = meshlet.center - eye;
+                visible = glm::dot(to_center, meshlet.cone_axis) < meshlet.cone_cutoff * glm::length(to_center) + meshlet.radius;
+            }
+        }
+        if (!visible) continue;
+        drawn++;
+        if (!commands.empty() && commands.back().firstIndex + commands.back().count == meshlet.first) {
+            commands.back().count += meshlet.count;
+        } else {
+            DrawElementsIndirectCommand command = { meshlet.count, 1, meshlet.first, 0, 0 };
+            commands.push_back(command);
+        }
+    }
+    return drawn;
+}
@@ -0,0 +1,55 @@
+#ifndef _meshlets_H
+#define _meshlets_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/** Limits of a meshlet, chosen to fit mesh shader friendly hardware sizes **/
+const int MESHLET_MAX_VERTICES = 64;
+const int MESHLET_MAX_TRIANGLES = 124;
+
+/**
+ * A small cluster of consecutive triangles of an index buffer
+ *
+ * The normals of all its triangles lie within |cone_axis|; the cluster faces
+ * away from a viewer looking along d (unit length, from the eye) when
+ * dot(d, cone_axis) >= cone_cutoff. A cutoff above 1 never culls.
+ */
+struct Meshlet {
+    unsigned int first, count;  // range of the index buffer, in indices
+    glm::vec3 center;
+    float radius;
+    glm::vec3 cone_axis;
+    float cone_cutoff;
+};
+
+/** The layout ``glMultiDrawElementsIndirect`` reads its commands in **/
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    unsigned int baseVertex;
+    unsigned int baseInstance;
+};
+
+/**
+ * Split the triangles in indices |first| to |first + count| of |indices|
+ * into meshlets, in order, and append them to |meshlets|
+ * The triangles should already be ordered for locality (see
+ * optimize_vertex_cache), as a meshlet ends once the next triangle doesn't
+ * fit into it
+ */
+void build_meshlets(const std::vector<unsigned int> &indices, unsigned int first, unsigned int count,
+                    const std::vector<glm::vec3> &positions, std::vector<Meshlet> &meshlets);
+
+/**
+ * Replace |commands| with draws of the |count| meshlets at |meshlets| that
+ * are inside the view frustum and not facing away from the viewer, for the
+ * given |projection| and |modelview| matrices. Meshlets that follow each
+ * other in the index buffer share a command
+ * Returns the number of meshlets drawn
+ */
+int cull_meshlets(const Meshlet *meshlets, int count, const glm::mat4 &projection, const glm::mat4 &modelview,
+                  std::vector<DrawElementsIndirectCommand> &commands);
+
+#endif
@@ -0,0 +1,83 @@
+#include <vector>
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "mipmaps.h"
+
+int mip_level_count(int width, int height) {
+    int levels = 1;
+    for (int size = std::max(width, height); size > 1; size /= 2) levels++;
+    return levels;
+}
+
+// |sums| = |a| + |b| as 16 bit integers, 16 bytes at a time
+static void add_rows(const unsigned char *a, const unsigned char *b, int count, unsigned short *sums) {
+    int i = 0;
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(y, zero));
+        __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(y, zero));
+        _mm_storeu_si128((__m128i *)(sums + i), low);
+        _mm_storeu_si128((__m128i *)(sums + i + 8), high);
+    }
+    for (; i < count; i++) sums[i] = a[i] + b[i];
+}
+
+void downsample_box(const unsigned char *src, ptrdiff_t src_stride, int width, int height, int channels,
+                    unsigned char *dst, size_t dst_row) {
+    int half_width = std::max(1, width / 2), half_height = std::max(1, height / 2);
+    std::vector<unsigned short> sums(width * channels);
+    for (int y = 0; y < half_height; y++) {
+        // the two rows summed vertically, then pairs of pixels across
+        const unsigned char *row0 = src + 2 * y * src_stride;
+        const unsigned char *row1 = 2 * y + 1 < height ? row0 + src_stride : row0;
+        add_rows(row0, row1, width * channels, &sums[0]);
+        unsigned char *out = dst + y * dst_row;
+        for (int x = 0; x < half_width; x++) {
+            const unsigned short *left = &sums[2 * x * channels];
+            const unsigned short *right = 2 * x + 1 < width ? left + channels : left;
+            for (int k = 0; k < channels; k++) out[x * channels + k] = (left[k] + right[k] + 2) >> 2;
+        }
+    }
+}
+
+int build_mipmaps(Mipmap_Mode mode, const unsigned char *pixels, ptrdiff_t stride, int width, int height,
+                  GLint internal_format, GLenum format) {
+    if (mode == MIPMAPS_GPU && !(GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object)) mode = MIPMAPS_CPU;
+    int levels = mode == MIPMAPS_NONE ? 1 : mip_level_count(width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    if (mode == MIPMAPS_GPU) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+    } else if (mode == MIPMAPS_CPU) {
+        // every level is made from the one before, in two buffers taking turns
+        int channels = format == GL_BGRA ? 4 : 3;
+        std::vector<unsigned char> buffers[2];
+        for (int level = 1; level < levels; level++) {
+            int half_width = std::max(1, width / 2), half_height = std::max(1, height / 2);
+            size_t row = (half_width * channels + 3) & ~3;
+            std::vector<unsigned char> &out = buffers[level % 2];
+            out.resize(row * half_height);
+            downsample_box(pixels, stride, width, height, channels, &out[0], row);
+            glTexImage2D(GL_TEXTURE_2D, level, internal_format, half_width, half_height, 0, format,
+                         GL_UNSIGNED_BYTE, &out[0]);
+            pixels = &out[0];
+            stride = row;
+            width = half_width;
+            height = half_height;
+        }
+    }
+    return levels;
+}
+
+void set_texture_filtering(bool mipmapped, float anisotropy) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    if (GLEW_EXT_texture_filter_anisotropic) {
+        float most;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &most);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::max(1.0f, std::min(anisotropy, most)));
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef _mipmaps_H
+#define _mipmaps_H
+
+#include <cstddef>
+#include <GL/glew.h>
+
+/** How the levels below level 0 of a texture are made **/
+enum Mipmap_Mode {
+    MIPMAPS_NONE, // level 0 only, sampled with GL_LINEAR
+    MIPMAPS_CPU,  // 2x2 box filtered here, the same on every driver
+    MIPMAPS_GPU   // glGenerateMipmap, where supported
+};
+
+/** Levels of a full chain for |width| x |height|, down to 1 x 1 **/
+int mip_level_count(int width, int height);
+
+/**
+ * Halve an image of |width| x |height| pixels of |channels| bytes into |dst|
+ * with rows of |dst_row| bytes, averaging every 2 x 2 block. A level is half
+ * the size rounded down, as OpenGL sizes them, so an odd last row or column
+ * is left out - unless the side is 1, when it is averaged with itself
+ * Rows of the source start at |src| and are |src_stride| bytes apart - a
+ * negative stride reads a top-down image bottom-up
+ */
+void downsample_box(const unsigned char *src, ptrdiff_t src_stride, int width, int height, int channels,
+                    unsigned char *dst, size_t dst_row);
+
+/**
+ * Fill levels 1 and up of the bound ``GL_TEXTURE_2D`` from its level 0, which
+ * is |width| x |height| pixels in |format| (``GL_BGR`` or ``GL_BGRA``)
+ * For MIPMAPS_CPU the level 0 pixels are read from |pixels| and |stride| as
+ * in downsample_box, for MIPMAPS_GPU from the texture itself. Also sets the
+ * highest level of the texture, so levels left from an earlier image are
+ * never sampled. Returns the number of levels
+ */
+int build_mipmaps(Mipmap_Mode mode, const unsigned char *pixels, ptrdiff_t stride, int width, int height,
+                  GLint internal_format, GLenum format);
+
+/**
+ * Set the filters of the bound ``GL_TEXTURE_2D``: trilinear if |mipmapped|,
+ * bilinear otherwise, and up to |anisotropy| samples along the direction the
+ * texture is squeezed in where anisotropic filtering is supported (1 is off)
+ */
+void set_texture_filtering(bool mipmapped, float anisotropy);
+
+#endif
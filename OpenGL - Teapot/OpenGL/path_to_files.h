@@ -6,6 +6,11 @@ char* bump_map1 = "res/bump_map.bmp";
 char* bump_map2 = "res/brickwall_normal.bmp";
 char* bump_map3 = "res/texture_normal.bmp";
 
+// output
+char* capture_dir = "capture";
+char* profile_csv = "profile.csv";
+char* profile_json = "profile.json";
+
 //shaders
 char* simple_shader_v = "shaders/simpleShader.vert";
 char* simple_shader_f = "shaders/simpleShader.frag";
@@ -14,4 +19,14 @@ char* phong_shader_f = "shaders/phongShader.frag";
 char* bump_map_v = "shaders/bumpmapShader.vert";
 char* bump_map_f = "shaders/bumpmapShader.frag";
 char* spherical_map_v = "shaders/environmentmapShader.vert";
-char* spherical_map_f = "shaders/environmentmapShader.frag";
\ No newline at end of file
+char* spherical_map_f = "shaders/environmentmapShader.frag";
+char* depth_shader_v = "shaders/depthShader.vert";
+char* depth_shader_f = "shaders/depthShader.frag";
+char* clustered_shader_v = "shaders/clusteredShader.vert";
+char* clustered_shader_f = "shaders/clusteredShader.frag";
+char* gbuffer_shader_v = "shaders/gbufferShader.vert";
+char* gbuffer_shader_f = "shaders/gbufferShader.frag";
+char* deferred_shader_v = "shaders/deferredShader.vert";
+char* deferred_shader_f = "shaders/deferredShader.frag";
+char* gallery_shader_v = "shaders/galleryShader.vert";
+char* gallery_shader_f = "shaders/galleryShader.frag";
\ No newline at end of file
@@ -5,9 +5,27 @@ uniform vec3 materialSpecular, lightSpecular, lightPosition;
 uniform float materialShininess, constantAttenuation, linearAttenuation;
 uniform int useTexture;
 uniform sampler2D texture0;
+uniform int useShadow;
+uniform sampler2DShadow shadowMap;
+uniform float shadowTexel;
 
 varying vec3 diffuse, ambientGlobal, ambient, position, normal, tangent, binormal;
 varying vec2 uv;
+varying vec4 shadowCoord;
+
+// fraction of the light that reaches the pixel, from 3x3 filtered lookups
+// around it in the shadow map
+float shadow(void) {
+    if (useShadow == 0 || shadowCoord.w <= 0.0) return 1.0;
+    float lit = 0.0;
+    for (int x = -1; x <= 1; x++) {
+        for (int y = -1; y <= 1; y++) {
+            vec4 offset = vec4(float(x), float(y), 0.0, 0.0) * shadowTexel * shadowCoord.w;
+            lit += shadow2DProj(shadowMap, shadowCoord + offset).r;
+        }
+    }
+    return lit / 9.0;
+}
 
 void main(void) {
     // do lighting computation
@@ -28,6 +46,7 @@ void main(void) {
 
     vec3 color = ambientGlobal;
     if (cosTheta > 0.0) {
+        attenuation *= shadow();
         color += attenuation * (diffuse * cosTheta + ambient);
         color +=   attenuation
                  * materialSpecular
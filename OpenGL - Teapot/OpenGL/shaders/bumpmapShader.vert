@@ -3,6 +3,7 @@
 
 uniform mat4 projectionMatrix, viewMatrix, modelMatrix;
 uniform mat3 normalMatrix;
+uniform mat4 shadowMatrix;
 uniform vec3 materialAmbient, materialDiffuse;
 uniform vec3 lightAmbient, lightDiffuse, lightPosition, lightGlobal;
 
@@ -11,6 +12,9 @@ attribute vec2 vertex_uv;
 
 varying vec3 ambientGlobal, ambient, diffuse, position, normal, tangent, binormal;
 varying vec2 uv;
+varying vec4 shadowCoord;
+
+invariant gl_Position;
 
 void main(void) {
     vec4 vertex = vec4(vertex_position, 1.0);
@@ -30,6 +34,9 @@ void main(void) {
     vec3 T = normalize(length(c1) > length(c2) ? c1 : c2);
     vec3 B = normalize(cross(vertex_normal, T));
 
+    // where the vertex lands in the shadow map
+    shadowCoord = shadowMatrix * vec4(position, 1.0);
+
     // pass variables
     uv = vertex_uv;
     tangent = T;
@@ -0,0 +1,63 @@
+// Phong shading lit by many point lights, sorted into clusters on the CPU
+// Only the lights of the cluster the pixel falls in are visited
+#version 140
+
+uniform vec3 materialAmbient, materialDiffuse, materialSpecular, lightGlobal;
+uniform float materialShininess;
+uniform int useTexture;
+uniform sampler2D texture0;
+
+// see LightClusters for the layout
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterRanges, lightIndices;
+uniform ivec3 clusterGrid;
+uniform vec2 clusterDepth;  // nearest depth of the grid, log(far / near)
+uniform vec4 viewport;
+
+in vec3 position, normal;
+in vec2 uv;
+
+out vec4 fragColor;
+
+// the cluster the pixel falls in
+int cluster(void) {
+    vec2 tile = (gl_FragCoord.xy - viewport.xy) / viewport.zw * vec2(clusterGrid.xy);
+    float depth = max(-position.z, clusterDepth.x);
+    float slice = log(depth / clusterDepth.x) / clusterDepth.y * float(clusterGrid.z);
+    ivec3 cell = clamp(ivec3(int(tile.x), int(tile.y), int(slice)), ivec3(0), clusterGrid - ivec3(1));
+    return (cell.z * clusterGrid.y + cell.y) * clusterGrid.x + cell.x;
+}
+
+void main(void) {
+    vec3 N = normalize(normal);
+    vec3 V = normalize(-position);
+
+    vec3 color = materialAmbient * lightGlobal;
+    uvec2 range = texelFetch(clusterRanges, cluster()).xy;
+    for (uint i = 0u; i < range.y; i++) {
+        int light = int(texelFetch(lightIndices, int(range.x + i)).r);
+        vec4 light_position = texelFetch(lightData, 2 * light);
+        vec3 light_color = texelFetch(lightData, 2 * light + 1).rgb;
+
+        vec3 L = light_position.xyz - position;
+        float distance = length(L);
+        if (distance >= light_position.w) continue;
+        L /= distance;
+
+        // fades out smoothly at the edge of its reach
+        float falloff = 1.0 - distance * distance / (light_position.w * light_position.w);
+        falloff *= falloff;
+
+        float cosTheta = dot(L, N);
+        if (cosTheta <= 0.0) continue;
+        float cosAlpha = max(dot(reflect(-L, N), V), 0.0);
+        color += falloff * light_color * (materialDiffuse * cosTheta
+                                          + materialSpecular * pow(cosAlpha, materialShininess));
+    }
+
+    // mix in texture color if required
+    if (useTexture != 0) color *= texture(texture0, uv.st).rgb;
+
+    // set pixel color in OpenGL
+    fragColor = vec4(color, 1.0);
+}
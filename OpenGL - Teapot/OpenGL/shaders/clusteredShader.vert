@@ -0,0 +1,27 @@
+// Phong shading lit by many point lights, sorted into clusters on the CPU
+#version 140
+
+uniform mat4 projectionMatrix, viewMatrix, modelMatrix;
+uniform mat3 normalMatrix;
+
+in vec3 vertex_position, vertex_normal;
+in vec2 vertex_uv;
+
+out vec3 position, normal;
+out vec2 uv;
+
+invariant gl_Position;
+
+void main(void) {
+    vec4 vertex = vec4(vertex_position, 1.0);
+
+    // transform normal and position for fragment shader
+    normal = normalize(normalMatrix * vertex_normal);
+    position = vec3(viewMatrix * modelMatrix * vertex);
+
+    // pass variables
+    uv = vertex_uv;
+
+    // set vertex position in OpenGL
+    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vertex;
+}
@@ -0,0 +1,81 @@
+// Lighting pass of deferred shading, drawn over the whole screen
+// Does the same phong illumination as phongShader.frag, once per visible
+// pixel, from the surfaces stored in the G-buffer
+#version 120
+
+uniform mat4 inverseProjectionMatrix;
+uniform vec3 materialAmbient, materialDiffuse, materialSpecular;
+uniform vec3 lightAmbient, lightDiffuse, lightSpecular, lightPosition, lightGlobal;
+uniform float materialShininess, constantAttenuation, linearAttenuation;
+uniform sampler2D gAlbedo, gNormal, gDepth;
+uniform mat4 shadowMatrix;
+uniform int useShadow;
+uniform sampler2DShadow shadowMap;
+uniform float shadowTexel;
+
+varying vec2 uv;
+
+// -1 or 1, never 0
+vec2 sign_not_zero(vec2 v) {
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// the inverse of octahedron_encode in gbufferShader.frag
+vec3 octahedron_decode(vec2 e) {
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * sign_not_zero(n.xy);
+    return normalize(n);
+}
+
+// fraction of the light that reaches |position|, as in phongShader.frag
+float shadow(vec3 position) {
+    vec4 shadowCoord = shadowMatrix * vec4(position, 1.0);
+    if (useShadow == 0 || shadowCoord.w <= 0.0) return 1.0;
+    float lit = 0.0;
+    for (int x = -1; x <= 1; x++) {
+        for (int y = -1; y <= 1; y++) {
+            vec4 offset = vec4(float(x), float(y), 0.0, 0.0) * shadowTexel * shadowCoord.w;
+            lit += shadow2DProj(shadowMap, shadowCoord + offset).r;
+        }
+    }
+    return lit / 9.0;
+}
+
+void main(void) {
+    // nothing was drawn here, keep the background
+    vec4 albedo = texture2D(gAlbedo, uv);
+    if (albedo.a == 0.0) discard;
+
+    // back from the depth buffer to view coordinates
+    float depth = texture2D(gDepth, uv).r;
+    vec4 view = inverseProjectionMatrix * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 position = view.xyz / view.w;
+
+    // do lighting computation
+    vec3 N = octahedron_decode(texture2D(gNormal, uv).rg);
+    vec3 L = normalize(lightPosition - position);
+    vec3 R = 2 * dot(L, N) * N - L;
+
+    float cosTheta = max(dot(L, N), 0.0);
+    float cosAlpha = max(dot(N, R), 0.0);
+
+    float attenuation = 1.0 / (constantAttenuation + length(L) * linearAttenuation);
+
+    vec3 color = materialAmbient * lightGlobal;
+    if (cosTheta > 0.0) {
+        attenuation *= shadow(position);
+        color += attenuation * (materialDiffuse * lightDiffuse * cosTheta + materialAmbient * lightAmbient);
+        color +=   attenuation
+                 * albedo.a
+                 * materialSpecular
+                 * lightSpecular
+                 * pow(cosAlpha, materialShininess);
+    }
+
+    // mix in the surface color
+    color *= albedo.rgb;
+
+    // set pixel color in OpenGL
+    gl_FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,14 @@
+// Lighting pass of deferred shading, drawn over the whole screen
+#version 120
+
+attribute vec2 vertex_position;
+
+varying vec2 uv;
+
+void main(void) {
+    // pass variables
+    uv = vertex_position * 0.5 + 0.5;
+
+    // set vertex position in OpenGL
+    gl_Position = vec4(vertex_position, 0.0, 1.0);
+}
@@ -7,6 +7,8 @@ attribute vec3 vertex_position;
 
 varying float depth;
 
+invariant gl_Position;
+
 void main(void) {
     vec4 position = projectionMatrix * viewMatrix * modelMatrix * vec4(vertex_position, 1.0);
 
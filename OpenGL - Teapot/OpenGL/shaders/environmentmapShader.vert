@@ -10,6 +10,8 @@ attribute vec3 vertex_position, vertex_normal;
 
 varying vec3 ambientGlobal, ambient, diffuse, position, normal;
 
+invariant gl_Position;
+
 void main(void) {
     vec4 vertex = vec4(vertex_position, 1.0);
 
@@ -0,0 +1,29 @@
+// Phong shading of the meshes of a geometry pool, each placed by its own
+// model matrix
+#version 120
+
+uniform mat4 projectionMatrix, viewMatrix;
+uniform vec3 materialAmbient, materialDiffuse;
+uniform vec3 lightAmbient, lightDiffuse, lightGlobal;
+
+// one per draw - stepped once per instance when the draws are batched
+attribute mat4 drawModelMatrix;
+attribute vec3 vertex_position, vertex_normal;
+
+varying vec3 ambientGlobal, ambient, diffuse, position, normal;
+
+void main(void) {
+    mat4 modelView = viewMatrix * drawModelMatrix;
+    vec4 vertex = modelView * vec4(vertex_position, 1.0);
+
+    // the meshes are only moved and scaled evenly, so the normals can be
+    // transformed like the positions
+    normal = normalize(mat3(modelView) * vertex_normal);
+    position = vec3(vertex);
+
+    ambient = materialAmbient * lightAmbient;
+    diffuse = materialDiffuse * lightDiffuse;
+    ambientGlobal = materialAmbient * lightGlobal;
+
+    gl_Position = projectionMatrix * vertex;
+}
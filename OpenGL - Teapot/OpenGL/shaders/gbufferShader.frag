@@ -0,0 +1,31 @@
+// Geometry pass of deferred shading: stores what the lighting needs
+// The position isn't stored, the lighting pass gets it back from the depth
+#version 120
+
+uniform int useTexture;
+uniform sampler2D texture0;
+
+varying vec3 normal;
+varying vec2 uv;
+
+// -1 or 1, never 0
+vec2 sign_not_zero(vec2 v) {
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// A unit vector as a point on an octahedron, unfolded onto a square in
+// [0, 1] - two channels with about even precision in every direction
+vec2 octahedron_encode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * sign_not_zero(n.xy);
+    return e * 0.5 + 0.5;
+}
+
+void main(void) {
+    // albedo and specular intensity
+    vec3 albedo = vec3(1.0);
+    if (useTexture != 0) albedo = texture2D(texture0, uv.st).rgb;
+    gl_FragData[0] = vec4(albedo, 1.0);
+
+    gl_FragData[1] = vec4(octahedron_encode(normalize(normal)), 0.0, 0.0);
+}
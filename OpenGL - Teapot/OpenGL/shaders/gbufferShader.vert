@@ -0,0 +1,24 @@
+// Geometry pass of deferred shading: stores what the lighting needs
+#version 120
+
+uniform mat4 projectionMatrix, viewMatrix, modelMatrix;
+uniform mat3 normalMatrix;
+
+attribute vec3 vertex_position, vertex_normal;
+attribute vec2 vertex_uv;
+
+varying vec3 normal;
+varying vec2 uv;
+
+void main(void) {
+    vec4 vertex = vec4(vertex_position, 1.0);
+
+    // transform normal for fragment shader
+    normal = normalize(normalMatrix * vertex_normal);
+
+    // pass variables
+    uv = vertex_uv;
+
+    // set vertex position in OpenGL
+    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vertex;
+}
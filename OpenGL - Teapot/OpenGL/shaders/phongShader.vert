@@ -3,6 +3,7 @@
 
 uniform mat4 projectionMatrix, viewMatrix, modelMatrix;
 uniform mat3 normalMatrix;
+uniform mat4 shadowMatrix;
 uniform vec3 materialAmbient, materialDiffuse;
 uniform vec3 lightAmbient, lightDiffuse, lightPosition, lightGlobal;
 
@@ -11,6 +12,9 @@ attribute vec2 vertex_uv;
 
 varying vec3 ambientGlobal, ambient, diffuse, position, normal;
 varying vec2 uv;
+varying vec4 shadowCoord;
+
+invariant gl_Position;
 
 void main(void) {
     vec4 vertex = vec4(vertex_position, 1.0);
@@ -24,6 +28,9 @@ void main(void) {
     diffuse = materialDiffuse * lightDiffuse;
     ambientGlobal = materialAmbient * lightGlobal;
 
+    // where the vertex lands in the shadow map
+    shadowCoord = shadowMatrix * vec4(position, 1.0);
+
     // pass variables
     uv = vertex_uv;
 
@@ -12,6 +12,8 @@ attribute vec2 vertex_uv;
 varying vec3 vertex_color, position, normal;
 varying vec2 uv;
 
+invariant gl_Position;
+
 void main(void) {
     vec4 vertex = vec4(vertex_position, 1.0);
 
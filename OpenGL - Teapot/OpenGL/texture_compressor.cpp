@@ -0,0 +1,191 @@
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "texture_compressor.h"
+#include "ThreadPool.h"
+
+int block_bytes(Block_Format format) {
+    return format == BLOCK_BC1 ? 8 : 16;
+}
+
+size_t compressed_size(Block_Format format, int width, int height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * block_bytes(format);
+}
+
+// 5:6:5 bits of the BGRA |color|, and back to 8 bits a channel
+static unsigned short to_565(const unsigned char *color) {
+    return (unsigned short)(((color[2] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 |
+                            ((color[0] * 31 + 127) / 255));
+}
+
+static void from_565(unsigned short c, int *color) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    color[0] = (b << 3) | (b >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (r << 3) | (r >> 2);
+}
+
+// dot products of the 16 pixels at |bgra| with |axis|, ignoring alpha
+static void dot_pixels(const unsigned char *bgra, const int *axis, int *dots) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i weights = _mm_setr_epi16(axis[0], axis[1], axis[2], 0, axis[0], axis[1], axis[2], 0);
+    for (int i = 0; i < 16; i += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(bgra + 4 * i));
+        // b*x + g*y and r*z + 0 for two pixels a register, then their sums
+        __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+        __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+        low = _mm_add_epi32(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+        high = _mm_add_epi32(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(2, 3, 0, 1)));
+        int sums[8];
+        _mm_storeu_si128((__m128i *)sums, low);
+        _mm_storeu_si128((__m128i *)(sums + 4), high);
+        dots[i] = sums[0];
+        dots[i + 1] = sums[2];
+        dots[i + 2] = sums[4];
+        dots[i + 3] = sums[6];
+    }
+}
+
+static void put_le16(unsigned char *out, unsigned int value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+}
+
+void encode_bc1_block(const unsigned char *bgra, unsigned char *out) {
+    // the principal axis of the colors, by power iteration on their
+    // covariance starting from the diagonal of their bounding box
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    int low[3] = { 255, 255, 255 }, high[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++) {
+        for (int k = 0; k < 3; k++) {
+            mean[k] += bgra[4 * i + k];
+            low[k] = std::min(low[k], (int)bgra[4 * i + k]);
+            high[k] = std::max(high[k], (int)bgra[4 * i + k]);
+        }
+    }
+    for (int k = 0; k < 3; k++) mean[k] /= 16.0f;
+    float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++) {
+        float d[3] = { bgra[4 * i] - mean[0], bgra[4 * i + 1] - mean[1], bgra[4 * i + 2] - mean[2] };
+        covariance[0] += d[0] * d[0];
+        covariance[1] += d[0] * d[1];
+        covariance[2] += d[0] * d[2];
+        covariance[3] += d[1] * d[1];
+        covariance[4] += d[1] * d[2];
+        covariance[5] += d[2] * d[2];
+    }
+    float axis[3] = { (float)(high[0] - low[0]), (float)(high[1] - low[1]), (float)(high[2] - low[2]) };
+    for (int iteration = 0; iteration < 4; iteration++) {
+        float next[3] = {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+        };
+        float length = std::max(fabs(next[0]), std::max(fabs(next[1]), fabs(next[2])));
+        if (length < 1e-6f) break;
+        for (int k = 0; k < 3; k++) axis[k] = next[k] / length;
+    }
+
+    // the pixels at both ends of the axis
+    int ends[2] = { 0, 0 };
+    float lowest = 1e30f, highest = -1e30f;
+    for (int i = 0; i < 16; i++) {
+        float t = bgra[4 * i] * axis[0] + bgra[4 * i + 1] * axis[1] + bgra[4 * i + 2] * axis[2];
+        if (t < lowest) { lowest = t; ends[1] = i; }
+        if (t > highest) { highest = t; ends[0] = i; }
+    }
+    unsigned short c0 = to_565(bgra + 4 * ends[0]), c1 = to_565(bgra + 4 * ends[1]);
+    // four color mode needs the first endpoint greater
+    if (c0 < c1) std::swap(c0, c1);
+    put_le16(out, c0);
+    put_le16(out + 2, c1);
+    unsigned int indices = 0;
+    if (c0 != c1) {
+        // every pixel's position between the endpoints as they will be
+        // decoded, rounded to thirds
+        int p0[3], p1[3], direction[3];
+        from_565(c0, p0);
+        from_565(c1, p1);
+        for (int k = 0; k < 3; k++) direction[k] = p1[k] - p0[k];
+        int dots[16];
+        dot_pixels(bgra, direction, dots);
+        int start = p0[0] * direction[0] + p0[1] * direction[1] + p0[2] * direction[2];
+        int length = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+        // thirds 0 to 3 are the palette entries 0, 2, 3, 1
+        static const unsigned int CODES[4] = { 0, 2, 3, 1 };
+        for (int i = 0; i < 16; i++) {
+            int third = (int)floor((3.0 * (dots[i] - start)) / length + 0.5);
+            indices |= CODES[std::max(0, std::min(3, third))] << (2 * i);
+        }
+    }
+    for (int b = 0; b < 4; b++) out[4 + b] = (indices >> (8 * b)) & 0xFF;
+}
+
+void encode_bc4_block(const unsigned char *values, unsigned char *out) {
+    int lowest = 255, highest = 0;
+    for (int i = 0; i < 16; i++) {
+        lowest = std::min(lowest, (int)values[i]);
+        highest = std::max(highest, (int)values[i]);
+    }
+    // eight values mode: the first endpoint is the greater
+    out[0] = (unsigned char)highest;
+    out[1] = (unsigned char)lowest;
+    unsigned long long indices = 0;
+    if (highest > lowest) {
+        // steps 0 to 7 from the highest down are the codes 0, 2 to 7 and 1
+        static const unsigned int CODES[8] = { 0, 2, 3, 4, 5, 6, 7, 1 };
+        int range = highest - lowest;
+        for (int i = 0; i < 16; i++) {
+            int step = ((highest - values[i]) * 7 + range / 2) / range;
+            indices |= (unsigned long long)CODES[step] << (3 * i);
+        }
+    }
+    for (int b = 0; b < 6; b++) out[2 + b] = (indices >> (8 * b)) & 0xFF;
+}
+
+// the 4 x 4 pixels of the block at |bx by|, repeating the last row and column
+static void fetch_block(const unsigned char *bgra, int width, int height, size_t stride, int bx, int by,
+                        unsigned char *block) {
+    for (int y = 0; y < 4; y++) {
+        const unsigned char *row = bgra + std::min(4 * by + y, height - 1) * stride;
+        for (int x = 0; x < 4; x++) {
+            const unsigned char *pixel = row + 4 * std::min(4 * bx + x, width - 1);
+            for (int k = 0; k < 4; k++) block[4 * (4 * y + x) + k] = pixel[k];
+        }
+    }
+}
+
+static void encode_block(Block_Format format, const unsigned char *block, unsigned char *out) {
+    unsigned char channel[16];
+    if (format == BLOCK_BC1) {
+        encode_bc1_block(block, out);
+    } else if (format == BLOCK_BC3) {
+        for (int i = 0; i < 16; i++) channel[i] = block[4 * i + 3];
+        encode_bc4_block(channel, out);
+        encode_bc1_block(block, out + 8);
+    } else {
+        // red, then green
+        for (int i = 0; i < 16; i++) channel[i] = block[4 * i + 2];
+        encode_bc4_block(channel, out);
+        for (int i = 0; i < 16; i++) channel[i] = block[4 * i + 1];
+        encode_bc4_block(channel, out + 8);
+    }
+}
+
+void compress_image(Block_Format format, const unsigned char *bgra, int width, int height, size_t stride,
+                    unsigned char *out, int threads) {
+    int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    int bytes = block_bytes(format);
+    // every task a band of block rows
+    parallel_for(blocks_y, threads, [&](int begin, int end) {
+        unsigned char block[64];
+        for (int by = begin; by < end; by++) {
+            for (int bx = 0; bx < blocks_x; bx++) {
+                fetch_block(bgra, width, height, stride, bx, by, block);
+                encode_block(format, block, out + ((size_t)by * blocks_x + bx) * bytes);
+            }
+        }
+    });
+}
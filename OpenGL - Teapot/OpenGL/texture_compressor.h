@@ -0,0 +1,49 @@
+#ifndef _texture_compressor_H
+#define _texture_compressor_H
+
+#include <cstddef>
+
+/**
+ * The block compressed formats textures can be encoded to, every one of
+ * them in blocks of 4 x 4 pixels
+ */
+enum Block_Format {
+    BLOCK_BC1, // color, 8 bytes a block (DXT1)
+    BLOCK_BC3, // color and alpha, 16 bytes a block (DXT5)
+    BLOCK_BC5  // two channels - the x and y of a normal map, 16 bytes a block
+};
+
+/** Bytes of one block of |format| **/
+int block_bytes(Block_Format format);
+
+/** Bytes of an image of |width| x |height| pixels in |format| **/
+size_t compressed_size(Block_Format format, int width, int height);
+
+/**
+ * Encode 16 pixels, in BGRA order row after row, as a BC1 block
+ *
+ * The endpoints are the pixels farthest apart along the principal axis of
+ * the colors, and every pixel gets the one of the four palette colors it
+ * projects nearest to on the line between them - the projections are done
+ * four pixels at a time with SSE2. Always in four color mode, so the block
+ * also serves as the color half of BC3.
+ */
+void encode_bc1_block(const unsigned char *bgra, unsigned char *out);
+
+/**
+ * Encode 16 single channel values as a BC4 block - the alpha half of BC3 and
+ * either half of BC5 - between their minimum and maximum in eight steps
+ */
+void encode_bc4_block(const unsigned char *values, unsigned char *out);
+
+/**
+ * Encode an image of |width| x |height| BGRA pixels with rows of |stride|
+ * bytes into |out|, compressed_size bytes, blocks in rows from the first row
+ * of pixels on. Blocks over the edge repeat the last row and column
+ * BC5 keeps the red and green channels. The rows of blocks are shared out
+ * among |threads| threads of the shared ThreadPool, all of them if 0
+ */
+void compress_image(Block_Format format, const unsigned char *bgra, int width, int height, size_t stride,
+                    unsigned char *out, int threads = 0);
+
+#endif